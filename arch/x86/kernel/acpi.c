@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "acpi.h"
+#include "string.h"
+
+/*
+ * ACPI MADT discovery.
+ *
+ * The RSDP sits on a 16-byte boundary in the first KiB of the EBDA or in
+ * the BIOS area 0xE0000-0xFFFFF. From there the RSDT (32-bit pointers,
+ * present on every ACPI revision) leads to the "APIC" table.
+ */
+
+#define ACPI_BIOS_START  0xE0000u
+#define ACPI_BIOS_END    0x100000u
+#define ACPI_EBDA_PTR    0x40Eu         /* real-mode segment of the EBDA */
+
+typedef struct acpi_rsdp {
+    char     signature[8];              /* "RSD PTR " */
+    uint8_t  checksum;
+    char     oem_id[6];
+    uint8_t  revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct acpi_header {
+    char     signature[4];
+    uint32_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct acpi_madt {
+    acpi_header_t header;
+    uint32_t      lapic_addr;
+    uint32_t      flags;
+} __attribute__((packed)) acpi_madt_t;
+
+enum {
+    MADT_LAPIC = 0,
+    MADT_IOAPIC = 1,
+    MADT_ISO = 2,                       /* interrupt source override */
+};
+
+#define MADT_LAPIC_ENABLED 1u
+
+static int acpi_checksum_ok(const void* p, uint32_t len)
+{
+    const uint8_t* b = (const uint8_t*)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        sum = (uint8_t)(sum + b[i]);
+    }
+    return sum == 0;
+}
+
+static const acpi_rsdp_t* acpi_scan_rsdp(uint32_t start, uint32_t end)
+{
+    for (uint32_t p = start; p + sizeof(acpi_rsdp_t) <= end; p += 16) {
+        const acpi_rsdp_t* r = (const acpi_rsdp_t*)p;
+        if (memcmp(r->signature, "RSD PTR ", 8) == 0 && acpi_checksum_ok(r, sizeof(*r))) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+static const acpi_header_t* acpi_find_table(const char* sig)
+{
+    /* The BIOS data area sits in what GCC takes for the null page. */
+    const volatile uint16_t* bda = (const volatile uint16_t*)ACPI_EBDA_PTR;
+    __asm__ ("" : "+r"(bda));
+    uint32_t ebda = (uint32_t)*bda << 4;
+    const acpi_rsdp_t* rsdp = 0;
+    if (ebda >= 0x80000u && ebda < 0xA0000u) {
+        rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+    }
+    if (!rsdp) {
+        rsdp = acpi_scan_rsdp(ACPI_BIOS_START, ACPI_BIOS_END);
+    }
+    if (!rsdp) {
+        return 0;
+    }
+
+    const acpi_header_t* rsdt = (const acpi_header_t*)rsdp->rsdt_addr;
+    if (!rsdt || memcmp(rsdt->signature, "RSDT", 4) != 0 ||
+        !acpi_checksum_ok(rsdt, rsdt->length)) {
+        return 0;
+    }
+
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    uint32_t count = (rsdt->length - sizeof(*rsdt)) / sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; ++i) {
+        const acpi_header_t* t = (const acpi_header_t*)entries[i];
+        if (t && memcmp(t->signature, sig, 4) == 0 && acpi_checksum_ok(t, t->length)) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+int acpi_read_madt(acpi_madt_info_t* out)
+{
+    const acpi_madt_t* madt = (const acpi_madt_t*)acpi_find_table("APIC");
+    if (!madt) {
+        return -1;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->lapic_addr = madt->lapic_addr;
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; ++irq) {
+        out->isa_gsi[irq] = irq;
+    }
+
+    const uint8_t* p = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        switch (p[0]) {
+        case MADT_LAPIC:
+            /* processor id, APIC id, flags */
+            if ((*(const uint32_t*)(p + 4) & MADT_LAPIC_ENABLED) &&
+                out->cpu_count < ACPI_MAX_CPUS) {
+                out->apic_ids[out->cpu_count++] = p[3];
+            }
+            break;
+        case MADT_IOAPIC:
+            /* The first I/O APIC is the one with the ISA inputs. */
+            if (!out->ioapic_addr) {
+                out->ioapic_addr = *(const uint32_t*)(p + 4);
+                out->ioapic_gsi_base = *(const uint32_t*)(p + 8);
+            }
+            break;
+        case MADT_ISO:
+            /* bus, source IRQ, GSI, flags */
+            if (p[3] < ACPI_ISA_IRQS) {
+                out->isa_gsi[p[3]] = *(const uint32_t*)(p + 4);
+                out->isa_flags[p[3]] = *(const uint16_t*)(p + 8);
+            }
+            break;
+        }
+        p += p[1];
+    }
+    return out->cpu_count ? 0 : -1;
+}
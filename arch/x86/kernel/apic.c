@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "paging.h"
+#include "pmm.h"
+#include "timer.h"
+
+/*
+ * Local APIC and I/O APIC programming.
+ *
+ * Both are memory mapped. paging_map_mmio() identity maps their register
+ * pages uncached, so the physical addresses from the MADT are used as
+ * pointers. Every access is a 32-bit volatile load or store, which is all
+ * the APIC register blocks allow.
+ */
+
+/* Local APIC registers (byte offsets). */
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_ICR_LOW   0x300
+#define LAPIC_ICR_HIGH  0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR 0x390
+#define LAPIC_TIMER_DIV 0x3E0
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_ICR_PENDING   0x1000
+#define LAPIC_ICR_ASSERT    0x4000
+#define LAPIC_ICR_INIT      0x0500
+#define LAPIC_ICR_STARTUP   0x0600
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_LVT_PERIODIC  0x20000
+#define LAPIC_TIMER_DIV_16  0x3
+
+/* I/O APIC: index/data window and redirection table. */
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WIN      0x10
+#define IOAPIC_VER      0x01
+#define IOAPIC_REDIR(n) (0x10 + 2 * (n))
+
+#define IOAPIC_ACTIVE_LOW   (1u << 13)
+#define IOAPIC_LEVEL        (1u << 15)
+#define IOAPIC_MASKED       (1u << 16)
+
+#define CPUID_APIC          (1u << 9)
+
+static acpi_madt_info_t apic_info;
+static volatile uint32_t* lapic = 0;
+static volatile uint32_t* ioapic = 0;
+static uint32_t ioapic_inputs = 0;
+static uint32_t bsp_apic_id = 0;
+static uint32_t lapic_timer_count = 0;  /* initial count for one tick */
+
+static uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t v)
+{
+    lapic[reg / 4] = v;
+}
+
+static uint32_t ioapic_read(uint32_t reg)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t v)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WIN / 4] = v;
+}
+
+/* ---------- Local APIC ---------- */
+
+void lapic_enable(void)
+{
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | VECTOR_SPURIOUS);
+}
+
+uint32_t lapic_id(void)
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void lapic_icr(uint32_t apic_id, uint32_t low)
+{
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ __volatile__("pause");
+    }
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, low);    /* this write sends it */
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector)
+{
+    lapic_icr(apic_id, LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+    lapic_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_INIT);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint32_t page)
+{
+    lapic_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_STARTUP | (page & 0xFF));
+}
+
+void lapic_timer_calibrate(void)
+{
+    /* Count down from the top for 10 ms of TSC time. */
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | VECTOR_LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFFu);
+    timer_udelay(10000);
+    uint32_t elapsed = 0xFFFFFFFFu - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    lapic_timer_count = elapsed / 10 * (1000 / TIMER_HZ);
+}
+
+void lapic_timer_start(void)
+{
+    if (!lapic_timer_count) {
+        return;
+    }
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_PERIODIC | VECTOR_LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/* ---------- I/O APIC ---------- */
+
+void ioapic_set_irq(unsigned irq, int enabled)
+{
+    if (irq >= ACPI_ISA_IRQS) {
+        return;
+    }
+    uint32_t pin = apic_info.isa_gsi[irq] - apic_info.ioapic_gsi_base;
+    if (pin >= ioapic_inputs) {
+        return;
+    }
+
+    /* ISA defaults are edge triggered, active high, unless overridden. */
+    uint32_t low = IRQ_BASE + irq;
+    if (apic_info.isa_flags[irq] & ACPI_IRQ_ACTIVE_LOW) {
+        low |= IOAPIC_ACTIVE_LOW;
+    }
+    if (apic_info.isa_flags[irq] & ACPI_IRQ_LEVEL) {
+        low |= IOAPIC_LEVEL;
+    }
+    if (!enabled) {
+        low |= IOAPIC_MASKED;
+    }
+
+    /* Fixed delivery, physical destination: the BSP handles device IRQs. */
+    ioapic_write(IOAPIC_REDIR(pin) + 1, bsp_apic_id << 24);
+    ioapic_write(IOAPIC_REDIR(pin), low);
+}
+
+int apic_init(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_APIC) || acpi_read_madt(&apic_info) != 0 || !apic_info.ioapic_addr) {
+        return -1;
+    }
+
+    paging_map_mmio(apic_info.lapic_addr, PAGE_SIZE);
+    paging_map_mmio(apic_info.ioapic_addr, PAGE_SIZE);
+
+    lapic = (volatile uint32_t*)apic_info.lapic_addr;
+    lapic_enable();
+    bsp_apic_id = lapic_id();
+
+    ioapic = (volatile uint32_t*)apic_info.ioapic_addr;
+    ioapic_inputs = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+    for (uint32_t pin = 0; pin < ioapic_inputs; ++pin) {
+        ioapic_write(IOAPIC_REDIR(pin), IOAPIC_MASKED);
+    }
+
+    irq_use_ioapic();
+    return 0;
+}
+
+int apic_active(void)
+{
+    return ioapic != 0;
+}
+
+const acpi_madt_info_t* apic_madt(void)
+{
+    return &apic_info;
+}
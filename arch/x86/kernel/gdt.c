@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include "idt.h"
+
+/*
+ * Flat protected-mode GDT. GRUB leaves a usable one loaded, but the
+ * Multiboot spec does not promise it stays valid, and the IDT needs known
+ * selectors. Three descriptors: null, ring-0 code, ring-0 data, each
+ * covering the full 4 GiB.
+ */
+
+typedef struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static const uint64_t gdt[] = {
+    0x0000000000000000ull,   /* null */
+    0x00CF9A000000FFFFull,   /* 0x08: code, base 0, limit 4 GiB, 32-bit */
+    0x00CF92000000FFFFull,   /* 0x10: data, base 0, limit 4 GiB */
+};
+
+void gdt_init(void)
+{
+    static gdt_ptr_t ptr;
+    ptr.limit = sizeof(gdt) - 1;
+    ptr.base = (uint32_t)gdt;
+
+    __asm__ __volatile__(
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "mov %2, %%ax\n\t"
+        "mov %%ax, %%ds\n\t"
+        "mov %%ax, %%es\n\t"
+        "mov %%ax, %%fs\n\t"
+        "mov %%ax, %%gs\n\t"
+        "mov %%ax, %%ss\n\t"
+        :
+        : "m"(ptr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+        : "eax", "memory");
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include "idt.h"
+#include "console.h"
+#include "power.h"
+#include "sched.h"
+#include "apic.h"
+
+/*
+ * Interrupt descriptor table and C-level dispatch.
+ *
+ * All 64 used vectors are 32-bit interrupt gates (IF cleared on entry),
+ * so handlers run with interrupts off and never nest. IRQ handlers are
+ * looked up in irq_handlers[] and the PIC (or, once apic_init() has
+ * switched over, the local APIC) is acknowledged afterwards;
+ * an unhandled CPU exception prints the vector and halts the machine
+ * (or exits QEMU with a failure status in batch mode, see power.h).
+ * Every interrupt ends in sched_preempt(), which may hand back another
+ * thread's frame than the one that came in.
+ */
+
+#define IDT_ENTRIES   256
+#define IDT_VECTORS   64            /* exceptions, 16 IRQs, kernel vectors */
+#define IDT_GATE_INT  0x8E          /* present, ring 0, 32-bit interrupt gate */
+#define IRQ_LINES     16
+
+typedef struct idt_entry {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t  zero;
+    uint8_t  type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct idt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+extern const uint32_t isr_stub_table[IDT_VECTORS];   /* isr.S */
+
+static idt_entry_t   idt[IDT_ENTRIES];
+static irq_handler_t irq_handlers[IRQ_LINES];
+static int           irq_on_ioapic = 0;
+
+static const char* const exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow",
+    "bound range", "invalid opcode", "device not available",
+    "double fault", "coprocessor overrun", "invalid TSS",
+    "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 FPU error", "alignment check",
+    "machine check", "SIMD FP exception", "virtualization",
+    "control protection", "reserved", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "hypervisor injection",
+    "VMM communication", "security", "reserved",
+};
+
+static void idt_set_gate(unsigned vec, uint32_t handler)
+{
+    idt[vec].offset_low = (uint16_t)(handler & 0xFFFF);
+    idt[vec].selector = GDT_KERNEL_CODE;
+    idt[vec].zero = 0;
+    idt[vec].type_attr = IDT_GATE_INT;
+    idt[vec].offset_high = (uint16_t)(handler >> 16);
+}
+
+void idt_init(void)
+{
+    for (unsigned v = 0; v < IDT_VECTORS; ++v) {
+        idt_set_gate(v, isr_stub_table[v]);
+    }
+
+    pic_remap(IRQ_BASE, IRQ_BASE + 8);
+
+    idt_load();
+}
+
+void idt_load(void)
+{
+    static idt_ptr_t ptr;
+    ptr.limit = sizeof(idt) - 1;
+    ptr.base = (uint32_t)idt;
+    __asm__ __volatile__("lidt %0" : : "m"(ptr));
+}
+
+void irq_use_ioapic(void)
+{
+    for (unsigned irq = 0; irq < IRQ_LINES; ++irq) {
+        pic_mask(irq);
+        ioapic_set_irq(irq, irq_handlers[irq] != 0);
+    }
+    irq_on_ioapic = 1;
+}
+
+void irq_install_handler(unsigned irq, irq_handler_t handler)
+{
+    if (irq >= IRQ_LINES) {
+        return;
+    }
+    irq_handlers[irq] = handler;
+    if (irq_on_ioapic) {
+        ioapic_set_irq(irq, handler != 0);
+    } else if (handler) {
+        pic_unmask(irq);
+    } else {
+        pic_mask(irq);
+    }
+}
+
+static void exception_halt(const interrupt_frame_t* frame)
+{
+    console_redirect(0);    /* the report must reach the screen, not a pipe */
+    console_write("\nCPU exception ");
+    console_write_dec(frame->vector);
+    console_write(" (");
+    console_write(exception_names[frame->vector]);
+    console_write(") at eip ");
+    console_write_hex(frame->eip);
+    console_write(", error ");
+    console_write_hex(frame->error_code);
+    if (frame->vector == 14) {
+        uint32_t cr2;
+        __asm__ __volatile__("mov %%cr2, %0" : "=r"(cr2));
+        console_write(", address ");
+        console_write_hex(cr2);
+    }
+    console_write_line("");
+    console_write_line("System halted.");
+    power_fatal();
+}
+
+interrupt_frame_t* interrupt_dispatch(interrupt_frame_t* frame)
+{
+    if (frame->vector < IRQ_BASE) {
+        exception_halt(frame);
+    }
+
+    unsigned irq = frame->vector - IRQ_BASE;
+    if (irq < IRQ_LINES) {
+        if (!irq_on_ioapic && pic_is_spurious(irq)) {
+            return frame;
+        }
+        if (irq_handlers[irq]) {
+            irq_handlers[irq](frame);
+        }
+        if (irq_on_ioapic) {
+            lapic_eoi();
+        } else {
+            pic_send_eoi(irq);
+        }
+    } else if (frame->vector == VECTOR_LAPIC_TIMER) {
+        sched_tick();
+        lapic_eoi();
+    } else if (frame->vector == VECTOR_RESCHED) {
+        lapic_eoi();    /* sched_preempt() sees the vector */
+    } else if (frame->vector == VECTOR_SPURIOUS) {
+        return frame;   /* never acknowledged */
+    }
+    return sched_preempt(frame);
+}
@@ -0,0 +1,222 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "paging.h"
+#include "pmm.h"
+#include "string.h"
+
+/*
+ * Page tables for Enixnel.
+ *
+ * Everything lives in one directory: the static low table for the first
+ * 4 MiB, 4 MiB PSE pages for the rest of RAM, and page tables from the
+ * page allocator only where a 4 MiB range needs finer control (device
+ * registers, or all of RAM on a CPU without PSE).
+ *
+ * Memory types come from PAT entry 1, reprogrammed from write-through to
+ * write-combining, and selected with PWT alone; PCD|PWT (entry 3) stays
+ * uncached. Without PAT, PWT gives write-through instead, which is still
+ * correct for the VGA window. BIOS MTRRs keep marking MMIO holes UC, so
+ * a write-back mapping over one is harmless.
+ *
+ * Mappings are only ever added, never removed, so CPUs need no TLB
+ * shootdown: a not-present entry is not cached.
+ */
+
+#define PTE_PRESENT   0x001u
+#define PTE_WRITE     0x002u
+#define PTE_PWT       0x008u
+#define PTE_PCD       0x010u
+#define PTE_LARGE     0x080u    /* PDE: 4 MiB page */
+#define PTE_GLOBAL    0x100u
+
+#define PTE_KERNEL_RO (PTE_PRESENT | PTE_GLOBAL)
+#define PTE_KERNEL_RW (PTE_PRESENT | PTE_WRITE | PTE_GLOBAL)
+#define PTE_WC        PTE_PWT               /* PAT entry 1 */
+#define PTE_UC        (PTE_PCD | PTE_PWT)   /* PAT entry 3 */
+
+#define LARGE_SIZE    0x400000u
+#define PAGING_ENTRIES 1024
+
+#define CPUID_PSE     (1u << 3)
+#define CPUID_PGE     (1u << 13)
+#define CPUID_PAT     (1u << 16)
+
+#define CR0_WP        (1u << 16)
+#define CR0_PG        (1u << 31)
+#define CR4_PSE       (1u << 4)
+#define CR4_PGE       (1u << 7)
+
+/* PA0 WB, PA1 WC, PA2 UC-, PA3 UC, repeated for PA4-PA7. */
+#define MSR_PAT       0x277u
+#define PAT_VALUE     0x00070106u
+
+#define VGA_START     0xA0000u
+#define VGA_END       0xC0000u
+#define BIOS_END      0x100000u
+
+/* Linker-provided bounds (linker.ld). */
+extern char _kernel_start[];
+extern char _kernel_ro_end[];
+
+static uint32_t paging_dir[PAGING_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t paging_low[PAGING_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t paging_cpu_features = 0;
+static int      paging_on = 0;
+
+/* ---------- Device ranges requested before paging_init() ---------- */
+
+#define PAGING_MAX_MMIO 8
+
+typedef struct paging_range {
+    uint32_t start;
+    uint32_t end;   /* exclusive */
+} paging_range_t;
+
+static paging_range_t paging_mmio[PAGING_MAX_MMIO];
+static int            paging_mmio_count = 0;
+
+/* ---------- Table management ---------- */
+
+static void paging_invlpg(uint32_t addr)
+{
+    if (paging_on) {
+        __asm__ __volatile__("invlpg (%0)" : : "r"(addr) : "memory");
+    }
+}
+
+/*
+ * Page table covering addr, allocated (or split out of a 4 MiB page, with
+ * the same attributes) if the directory has none yet. 0 when out of memory.
+ */
+static uint32_t* paging_table(uint32_t addr)
+{
+    uint32_t* pde = &paging_dir[addr >> 22];
+    if ((*pde & PTE_PRESENT) && !(*pde & PTE_LARGE)) {
+        return (uint32_t*)(*pde & ~(uint32_t)(PAGE_SIZE - 1));
+    }
+
+    uint32_t* table = (uint32_t*)pmm_alloc_pages(0);
+    if (!table) {
+        return 0;
+    }
+    if (*pde & PTE_PRESENT) {
+        uint32_t base = *pde & ~(LARGE_SIZE - 1);
+        uint32_t flags = *pde & (PTE_WRITE | PTE_PWT | PTE_PCD | PTE_GLOBAL | PTE_PRESENT);
+        for (uint32_t i = 0; i < PAGING_ENTRIES; ++i) {
+            table[i] = (base + i * PAGE_SIZE) | flags;
+        }
+    } else {
+        memset(table, 0, PAGE_SIZE);
+    }
+    *pde = (uint32_t)table | PTE_PRESENT | PTE_WRITE;
+    return table;
+}
+
+/* Identity map [start, end) with flags, in 4 MiB pages where allowed. */
+static int paging_map_range(uint32_t start, uint32_t end, uint32_t flags)
+{
+    uint32_t addr = start & ~(uint32_t)(PAGE_SIZE - 1);
+    while (addr < end) {
+        uint32_t* pde = &paging_dir[addr >> 22];
+        if ((paging_cpu_features & CPUID_PSE) && (addr & (LARGE_SIZE - 1)) == 0 &&
+            end - addr >= LARGE_SIZE && !(*pde & PTE_PRESENT)) {
+            *pde = addr | flags | PTE_LARGE;
+            addr += LARGE_SIZE;
+        } else {
+            uint32_t* table = paging_table(addr);
+            if (!table) {
+                return -1;
+            }
+            table[(addr >> PAGE_SHIFT) & (PAGING_ENTRIES - 1)] = addr | flags;
+            paging_invlpg(addr);
+            addr += PAGE_SIZE;
+        }
+        if (addr == 0) {
+            break;  /* wrapped past 4 GiB */
+        }
+    }
+    return 0;
+}
+
+/* ---------- Setup ---------- */
+
+void paging_enable_cpu(void)
+{
+    uint32_t cr0, cr4;
+
+    if (paging_cpu_features & CPUID_PAT) {
+        __asm__ __volatile__("wrmsr" : : "c"(MSR_PAT), "a"(PAT_VALUE), "d"(PAT_VALUE));
+    }
+
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    if (paging_cpu_features & CPUID_PSE) {
+        cr4 |= CR4_PSE;
+    }
+    __asm__ __volatile__("mov %0, %%cr4" : : "r"(cr4));
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(paging_dir) : "memory");
+
+    /* WP makes read-only pages binding on the kernel too. */
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= CR0_PG | CR0_WP;
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0) : "memory");
+
+    if (paging_cpu_features & CPUID_PGE) {
+        cr4 |= CR4_PGE;
+        __asm__ __volatile__("mov %0, %%cr4" : : "r"(cr4));
+    }
+}
+
+int paging_init(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    paging_cpu_features = edx & (CPUID_PSE | CPUID_PGE | CPUID_PAT);
+
+    /* First 4 MiB: page 0 stays unmapped. */
+    paging_dir[0] = (uint32_t)paging_low | PTE_PRESENT | PTE_WRITE;
+    uint32_t ro_start = (uint32_t)_kernel_start;
+    uint32_t ro_end = (uint32_t)_kernel_ro_end;
+    paging_map_range(PAGE_SIZE, VGA_START, PTE_KERNEL_RW);
+    paging_map_range(VGA_START, VGA_END, PTE_KERNEL_RW | PTE_WC);
+    paging_map_range(VGA_END, BIOS_END, PTE_KERNEL_RO);
+    paging_map_range(BIOS_END, ro_start, PTE_KERNEL_RW);
+    paging_map_range(ro_start, ro_end, PTE_KERNEL_RO);
+    paging_map_range(ro_end, LARGE_SIZE, PTE_KERNEL_RW);
+
+    /* Device registers first, so their 4 MiB ranges get page tables. */
+    for (int i = 0; i < paging_mmio_count; ++i) {
+        if (paging_map_range(paging_mmio[i].start, paging_mmio[i].end,
+                             PTE_KERNEL_RW | PTE_UC) != 0) {
+            return -1;
+        }
+    }
+
+    uint32_t ram_end = pmm_memory_end();
+    if (ram_end > LARGE_SIZE && paging_map_range(LARGE_SIZE, ram_end, PTE_KERNEL_RW) != 0) {
+        return -1;
+    }
+
+    paging_enable_cpu();
+    paging_on = 1;
+    return 0;
+}
+
+int paging_enabled(void)
+{
+    return paging_on;
+}
+
+int paging_map_mmio(uint32_t phys, uint32_t size)
+{
+    uint32_t end = phys + size;
+    if (paging_on) {
+        return paging_map_range(phys, end, PTE_KERNEL_RW | PTE_UC);
+    }
+    if (paging_mmio_count >= PAGING_MAX_MMIO) {
+        return -1;
+    }
+    paging_mmio[paging_mmio_count].start = phys;
+    paging_mmio[paging_mmio_count].end = end;
+    ++paging_mmio_count;
+    return 0;
+}
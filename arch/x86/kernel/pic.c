@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include "idt.h"
+#include "io.h"
+
+/*
+ * 8259A programmable interrupt controller pair.
+ *
+ * By default the BIOS maps IRQ 0-7 onto vectors 8-15, which collide with
+ * CPU exceptions, so pic_remap() moves both chips. Every line starts
+ * masked except the cascade (IRQ 2); drivers unmask what they handle.
+ */
+
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
+
+#define PIC_EOI        0x20
+#define PIC_READ_ISR   0x0B
+#define ICW1_INIT_ICW4 0x11
+#define ICW4_8086      0x01
+
+void pic_remap(uint8_t master_base, uint8_t slave_base)
+{
+    outb(PIC1_CMD, ICW1_INIT_ICW4);
+    io_wait();
+    outb(PIC2_CMD, ICW1_INIT_ICW4);
+    io_wait();
+    outb(PIC1_DATA, master_base);
+    io_wait();
+    outb(PIC2_DATA, slave_base);
+    io_wait();
+    outb(PIC1_DATA, 1u << 2);   /* slave on IRQ 2 */
+    io_wait();
+    outb(PIC2_DATA, 2);         /* slave cascade identity */
+    io_wait();
+    outb(PIC1_DATA, ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, ICW4_8086);
+    io_wait();
+
+    outb(PIC1_DATA, (uint8_t)~(1u << 2));
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask(unsigned irq)
+{
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & (uint8_t)~(1u << (irq & 7)));
+}
+
+void pic_mask(unsigned irq)
+{
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (uint8_t)(1u << (irq & 7)));
+}
+
+void pic_send_eoi(unsigned irq)
+{
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI);
+    }
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+/*
+ * IRQ 7 and 15 also fire when a request goes away before the CPU takes
+ * it. The in-service register tells a real one from a spurious one.
+ */
+int pic_is_spurious(unsigned irq)
+{
+    if (irq != 7 && irq != 15) {
+        return 0;
+    }
+
+    uint16_t cmd = irq == 7 ? PIC1_CMD : PIC2_CMD;
+    outb(cmd, PIC_READ_ISR);
+    if (inb(cmd) & 0x80) {
+        return 0;
+    }
+
+    if (irq == 15) {
+        outb(PIC1_CMD, PIC_EOI);   /* the master did see the cascade */
+    }
+    return 1;
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "smp.h"
+#include "apic.h"
+#include "idt.h"
+#include "paging.h"
+#include "pmm.h"
+#include "sched.h"
+#include "timer.h"
+#include "string.h"
+
+/*
+ * Application processor startup.
+ *
+ * APs are started one at a time: the BSP writes the AP's stack into the
+ * trampoline, sends INIT, waits 10 ms, sends two startup IPIs 200 us
+ * apart (the sequence from the Intel MP specification) and waits up to
+ * 100 ms for the AP to report in. An AP that never does is left alone.
+ */
+
+#define SMP_START_TIMEOUT_US 100000
+
+extern const uint8_t ap_trampoline_start[];
+extern const uint8_t ap_trampoline_end[];
+extern uint8_t ap_trampoline_gdtr[];
+extern uint8_t ap_trampoline_stack[];
+
+static uint32_t smp_apic_ids[SMP_MAX_CPUS];
+static uint8_t  smp_cpu_of_apic[256];       /* APIC ID -> CPU number */
+static volatile uint32_t smp_online = 1;
+static volatile uint32_t smp_ap_ready = 0;
+static int      smp_started = 0;            /* smp_cpu_id() uses the APIC */
+
+static void* smp_tramp(const void* sym)
+{
+    return (uint8_t*)SMP_TRAMPOLINE_ADDR + ((const uint8_t*)sym - ap_trampoline_start);
+}
+
+uint32_t smp_cpu_id(void)
+{
+    if (!smp_started) {
+        return 0;
+    }
+    return smp_cpu_of_apic[lapic_id() & 0xFF];
+}
+
+uint32_t smp_cpu_count(void)
+{
+    return smp_online;
+}
+
+void smp_send_resched(uint32_t cpu)
+{
+    if (smp_started && cpu < smp_online) {
+        lapic_send_ipi(smp_apic_ids[cpu], VECTOR_RESCHED);
+    }
+}
+
+/* C entry for an AP, from ap_entry in ap_boot.S on its own stack. */
+void smp_ap_main(void)
+{
+    if (paging_enabled()) {
+        paging_enable_cpu();
+    }
+    idt_load();
+    lapic_enable();
+
+    if (sched_init_cpu() != 0) {
+        return;     /* halts in ap_boot.S */
+    }
+    lapic_timer_start();
+
+    __asm__ __volatile__("" ::: "memory");
+    smp_ap_ready = 1;
+    interrupts_enable();
+    sched_idle();
+}
+
+static int smp_start_ap(uint32_t cpu, uint32_t apic_id)
+{
+    uint8_t* stack = (uint8_t*)pmm_alloc_pages(THREAD_STACK_ORDER);
+    if (!stack) {
+        return -1;
+    }
+    *(uint32_t*)smp_tramp(ap_trampoline_stack) =
+        (uint32_t)(stack + ((size_t)PAGE_SIZE << THREAD_STACK_ORDER));
+
+    smp_apic_ids[cpu] = apic_id;
+    smp_cpu_of_apic[apic_id] = (uint8_t)cpu;
+    smp_ap_ready = 0;
+
+    lapic_send_init(apic_id);
+    timer_udelay(10000);
+    lapic_send_startup(apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+    timer_udelay(200);
+    lapic_send_startup(apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+
+    for (uint32_t waited = 0; !smp_ap_ready; waited += 100) {
+        if (waited >= SMP_START_TIMEOUT_US) {
+            pmm_free_pages(stack, THREAD_STACK_ORDER);  /* never started */
+            return -1;
+        }
+        timer_udelay(100);
+    }
+    return 0;
+}
+
+void smp_init(void)
+{
+    if (!apic_active()) {
+        return;
+    }
+    const acpi_madt_info_t* madt = apic_madt();
+
+    lapic_timer_calibrate();
+
+    uint32_t bsp = lapic_id();
+    smp_apic_ids[0] = bsp;
+    smp_cpu_of_apic[bsp & 0xFF] = 0;
+
+    /* Trampoline below 1 MiB, with the GDT the BSP is running on. */
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, ap_trampoline_start,
+           (size_t)(ap_trampoline_end - ap_trampoline_start));
+    __asm__ __volatile__("sgdt %0" : "=m"(*(uint8_t(*)[6])smp_tramp(ap_trampoline_gdtr)));
+
+    smp_started = 1;
+    for (uint32_t i = 0; i < madt->cpu_count && smp_online < SMP_MAX_CPUS; ++i) {
+        uint32_t id = madt->apic_ids[i];
+        if (id == bsp) {
+            continue;
+        }
+        /* CPU numbers stay dense: a failed AP's slot is reused. */
+        if (smp_start_ap(smp_online, id) == 0) {
+            smp_online = smp_online + 1;
+        }
+    }
+}
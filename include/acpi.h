@@ -0,0 +1,34 @@
+#ifndef ENIXNEL_ACPI_H
+#define ENIXNEL_ACPI_H
+
+#include <stdint.h>
+
+/*
+ * ACPI table lookup (implemented in arch/x86/kernel/acpi.c).
+ *
+ * Only the MADT is read: it lists the local APIC of every CPU, the I/O
+ * APIC and how ISA IRQs map onto I/O APIC inputs. Tables are read in
+ * place through physical addresses.
+ */
+
+#define ACPI_MAX_CPUS        16
+#define ACPI_ISA_IRQS        16
+
+/* MPS INTI flags from an interrupt source override. */
+#define ACPI_IRQ_ACTIVE_LOW  0x0002
+#define ACPI_IRQ_LEVEL       0x0008
+
+typedef struct acpi_madt_info {
+    uint32_t lapic_addr;
+    uint32_t cpu_count;                     /* enabled CPUs, BSP included */
+    uint8_t  apic_ids[ACPI_MAX_CPUS];
+    uint32_t ioapic_addr;                   /* 0 when there is none */
+    uint32_t ioapic_gsi_base;
+    uint32_t isa_gsi[ACPI_ISA_IRQS];        /* identity unless overridden */
+    uint16_t isa_flags[ACPI_ISA_IRQS];      /* ACPI_IRQ_* */
+} acpi_madt_info_t;
+
+/* Find and parse the MADT. Returns 0 on success, <0 without ACPI/MADT. */
+int acpi_read_madt(acpi_madt_info_t* out);
+
+#endif /* ENIXNEL_ACPI_H */
@@ -0,0 +1,42 @@
+#ifndef ENIXNEL_APIC_H
+#define ENIXNEL_APIC_H
+
+#include <stdint.h>
+#include "acpi.h"
+
+/*
+ * Local APIC and I/O APIC (implemented in arch/x86/kernel/apic.c).
+ *
+ * apic_init() switches interrupt delivery from the 8259 to the I/O APIC
+ * when the MADT describes one: ISA IRQ n still arrives on IRQ_BASE + n,
+ * now at the BSP's local APIC, and is acknowledged with lapic_eoi().
+ * Without a MADT (or a CPU without an APIC) everything stays on the 8259
+ * and only the BSP runs.
+ */
+
+/* Parse the MADT, enable the BSP's local APIC and route ISA IRQs through
+ * the I/O APIC. Call after idt_init(), before any irq_install_handler().
+ * Returns 0 when the APICs are in use, <0 when staying on the 8259.
+ */
+int  apic_init(void);
+int  apic_active(void);
+const acpi_madt_info_t* apic_madt(void);
+
+/* Local APIC of the calling CPU. */
+void     lapic_enable(void);        /* software enable, spurious vector */
+uint32_t lapic_id(void);
+void     lapic_eoi(void);
+void     lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void     lapic_send_init(uint32_t apic_id);
+void     lapic_send_startup(uint32_t apic_id, uint32_t page);
+
+/* Periodic local APIC timer on VECTOR_LAPIC_TIMER at TIMER_HZ. Calibrate
+ * once on the BSP (needs timer_init()), then start it on each AP.
+ */
+void lapic_timer_calibrate(void);
+void lapic_timer_start(void);
+
+/* Unmask (enabled) or mask ISA IRQ irq at the I/O APIC. */
+void ioapic_set_irq(unsigned irq, int enabled);
+
+#endif /* ENIXNEL_APIC_H */
@@ -0,0 +1,37 @@
+#ifndef ENIXNEL_ATA_H
+#define ENIXNEL_ATA_H
+
+#include <stdint.h>
+
+/*
+ * ATA disk on the primary IDE channel (implemented in kernel/ata.c).
+ *
+ * Only the master drive is used, addressed with 28-bit LBAs. Transfers
+ * move whole pages (ATA_PAGE_SECTORS sectors each) so the block cache can
+ * hand its buffers over directly; consecutive pages on disk may come from
+ * scattered pages in memory. Bus-master DMA is used when the PCI IDE
+ * controller supports it, PIO otherwise. Completion is polled, so callers
+ * block the CPU (not interrupts) for the length of a transfer.
+ */
+
+#define ATA_SECTOR_SIZE   512
+#define ATA_PAGE_SECTORS  8             /* one 4 KiB page */
+#define ATA_MAX_PAGES     32            /* 256 sectors: one LBA28 command */
+
+/* Probe the drive. Returns 0 if a disk answered IDENTIFY, <0 otherwise. */
+int      ata_init(void);
+int      ata_present(void);
+int      ata_dma(void);                 /* 1 when bus-master DMA is in use */
+uint32_t ata_sectors(void);             /* disk size in sectors */
+
+/* Transfer count pages starting at sector lba; page i goes to or comes
+ * from pages[i]. count is 1 .. ATA_MAX_PAGES. Returns 0 on success, <0 on
+ * a device error or timeout.
+ */
+int ata_read_pages(uint32_t lba, void* const* pages, uint32_t count);
+int ata_write_pages(uint32_t lba, void* const* pages, uint32_t count);
+
+/* Drain the drive's write cache. Returns 0 on success, <0 on error. */
+int ata_flush(void);
+
+#endif /* ENIXNEL_ATA_H */
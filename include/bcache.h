@@ -0,0 +1,107 @@
+#ifndef ENIXNEL_BCACHE_H
+#define ENIXNEL_BCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Write-back block cache over the ATA disk (implemented in kernel/bcache.c).
+ *
+ * The disk is seen as BCACHE_BLOCK_SIZE blocks, each cached in one page.
+ * A miss reads up to BCACHE_READAHEAD following blocks in the same
+ * request. Writes only dirty the buffer; bcache_sync() writes every dirty
+ * block in disk order, merging neighbours into one request. Eviction is
+ * least recently used among unpinned buffers, writing the victim first if
+ * it is dirty.
+ *
+ * A dirtied buffer is also pending until the journal (journal.h) has
+ * committed it: pending buffers are never written home, by eviction or by
+ * bcache_sync(), so the disk only ever sees committed contents. When
+ * every buffer is pinned or pending, the cache borrows pages for more, up
+ * to BCACHE_MAX_BUFFERS, so a whole sync can be staged before any of it
+ * is committed; bcache_trim() gives them back.
+ *
+ * Like the fs it sits under, the cache takes no locks: callers hold
+ * fs_mutex (or run before the scheduler starts).
+ */
+
+#define BCACHE_BLOCK_SIZE  4096
+#define BCACHE_BUFFERS     256          /* 1 MiB of cache */
+#define BCACHE_MAX_BUFFERS 3072         /* with borrowed ones, 12 MiB */
+#define BCACHE_READAHEAD   8
+
+typedef struct bcache_buf {
+    uint32_t blkno;
+    uint8_t* data;                      /* BCACHE_BLOCK_SIZE bytes */
+    uint16_t flags;                     /* BCACHE_* below */
+    uint16_t pins;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_next;        /* most recently used first */
+    struct bcache_buf* lru_prev;
+} bcache_buf_t;
+
+#define BCACHE_VALID    0x01
+#define BCACHE_DIRTY    0x02            /* differs from the home block */
+#define BCACHE_PENDING  0x04            /* changed since the journal commit */
+#define BCACHE_LOGGED   0x08            /* in the journal group being written */
+
+typedef struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead;                 /* blocks read before being asked for */
+    uint32_t read_requests;
+    uint32_t write_requests;
+    uint32_t blocks_written;
+} bcache_stats_t;
+
+/* Allocate the buffers for a disk of block_count blocks. Needs pmm_init()
+ * and ata_init(). Returns 0 on success, <0 when out of memory.
+ */
+int      bcache_init(uint32_t block_count);
+uint32_t bcache_block_count(void);
+
+/* Pin block blkno, reading it (and read-ahead) on a miss. NULL on an I/O
+ * error. bcache_get_zero() skips the read for a block about to be fully
+ * overwritten and returns it zero-filled.
+ */
+bcache_buf_t* bcache_read(uint32_t blkno);
+bcache_buf_t* bcache_get_zero(uint32_t blkno);
+void          bcache_release(bcache_buf_t* b);
+
+static inline void bcache_mark_dirty(bcache_buf_t* b)
+{
+    b->flags |= BCACHE_DIRTY | BCACHE_PENDING;
+}
+
+/* Up to max pending buffers not logged yet, in block order. Returns how
+ * many. The journal writes a group out a batch at a time, marking each
+ * batch with bcache_log(), and ends it with bcache_log_done(): committed,
+ * the logged buffers stop being pending; otherwise they are unlogged for
+ * the next try.
+ */
+uint32_t bcache_pending(bcache_buf_t** out, uint32_t max);
+uint32_t bcache_pending_count(void);
+void     bcache_log_done(int committed);
+
+static inline void bcache_log(bcache_buf_t* b)
+{
+    b->flags |= BCACHE_LOGGED;
+}
+
+static inline void bcache_commit(bcache_buf_t* b)
+{
+    b->flags &= (uint16_t)~BCACHE_PENDING;
+}
+
+/* Write all committed dirty blocks home and flush the drive. Returns 0 on
+ * success, <0 on an I/O error (the failed blocks stay dirty).
+ */
+int  bcache_sync(void);
+
+/* Write back and free the borrowed buffers that are not pinned or pending.
+ * Returns 0 on success, <0 on an I/O error.
+ */
+int  bcache_trim(void);
+void bcache_get_stats(bcache_stats_t* out);
+
+#endif /* ENIXNEL_BCACHE_H */
@@ -0,0 +1,21 @@
+#ifndef ENIXNEL_BENCH_H
+#define ENIXNEL_BENCH_H
+
+/*
+ * Built-in microbenchmarks (implemented in kernel/bench.c).
+ *
+ * Each benchmark times a few hundred single operations with the TSC and
+ * reports min, median and 99th percentile cycles per operation. The fs
+ * benchmarks work in a scratch directory "benchtmp" at the root, which
+ * is removed afterwards.
+ */
+
+/* Lists directory dir the way the sdir command does. */
+typedef void (*bench_list_fn)(int dir);
+
+/* Run the benchmark group named by which ("fs", "sdir", "console"), or
+ * all of them for an empty string. Returns -1 for an unknown group.
+ */
+int bench_run(const char* which, bench_list_fn list_dir);
+
+#endif /* ENIXNEL_BENCH_H */
@@ -0,0 +1,26 @@
+#ifndef ENIXNEL_CLI_HASH_H
+#define ENIXNEL_CLI_HASH_H
+
+#include <stdint.h>
+
+/*
+ * Hash used for shell command dispatch. Shared by the kernel and the
+ * build-time generator (tools/gen_cli_hash.c), which searches for a seed
+ * under which every name in kernel/cli_commands.def lands in its own
+ * slot, and writes the slot table to $(BUILDDIR)/gen/cli_hash_table.h.
+ */
+
+#define CLI_HASH_EMPTY 0xFF   /* slot holds no command */
+
+/* FNV-1a, with the seed folded into the offset basis. */
+static inline uint32_t cli_command_hash(const char* name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+#endif /* ENIXNEL_CLI_HASH_H */
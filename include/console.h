@@ -0,0 +1,75 @@
+#ifndef ENIXNEL_CONSOLE_H
+#define ENIXNEL_CONSOLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * VGA text-mode console (implemented in kernel/console.c).
+ *
+ * 80x25 cells, output scrolls when the cursor runs off the last row.
+ * Output is drawn into a RAM shadow and reaches the screen at each '\n'
+ * from console_putc(), at the end of every console_write*() call, or on
+ * console_flush().
+ * Output is mirrored to COM1 when serial_init() found a UART, and
+ * console_read_line() accepts input from the keyboard or the serial line,
+ * echoing it with basic line editing, and sleeps while there is none.
+ */
+
+void console_clear(void);
+void console_putc(char c);
+/* len bytes as by console_putc(), but the screen is only updated by the
+ * next flush, however many lines they fill (bulk output such as sfile).
+ */
+void console_put_n(const char* s, size_t len);
+void console_write(const char* s);
+void console_write_line(const char* s);
+void console_write_dec(uint32_t v);
+void console_write_dec64(uint64_t v);
+void console_write_hex(uint32_t v);     /* "0x" + 8 digits */
+void console_backspace(void);
+void console_flush(void);               /* copy pending rows to VGA memory */
+
+/* Output redirection (shell pipes): while a pipe is set, everything
+ * printed above is appended to its buffer instead of reaching the screen
+ * and COM1. Bytes past size are counted in dropped rather than stored.
+ * Returns the pipe set before, 0 for the screen. The pipe is global, not
+ * per thread, so fatal paths (exception_halt(), power_fatal()) set 0
+ * before they print.
+ */
+typedef struct console_pipe {
+    char*  buf;
+    size_t size;
+    size_t len;
+    size_t dropped;
+} console_pipe_t;
+
+console_pipe_t* console_redirect(console_pipe_t* p);
+
+/* Keys the input drivers deliver besides printable characters, '\n' and
+ * '\b'. Up and Down arrive as Ctrl-P and Ctrl-N, which a terminal can
+ * also send directly.
+ */
+#define CONSOLE_KEY_TAB  '\t'
+#define CONSOLE_KEY_UP   0x10
+#define CONSOLE_KEY_DOWN 0x0E
+
+/* Read one line into buffer (always '\0'-terminated), without the '\n'.
+ * Up and Down step through the last CONSOLE_HISTORY lines read.
+ */
+#define CONSOLE_HISTORY  16
+void console_read_line(char* buffer, size_t buflen);
+
+/* Tab completion for console_read_line(): fn gets the line typed so far
+ * (len bytes plus a '\0', room for buflen), may extend it in place and
+ * returns the new length; the editor echoes what was added. again is set
+ * for a second Tab in a row. fn may print (a list of choices, say) if it
+ * leaves the prompt and the line so far on the last row. 0 disables it.
+ */
+typedef size_t (*console_complete_fn)(char* buf, size_t len, size_t buflen, int again);
+void console_set_completer(console_complete_fn fn);
+
+/* Input arrived (keyboard and serial IRQ handlers): wake blocked readers. */
+void console_input_ready(void);
+
+#endif /* ENIXNEL_CONSOLE_H */
@@ -6,34 +6,352 @@
 
 /* Simple in-memory filesystem entry used by the CLI. */
 
+/* Initial entry table size; the table doubles on the kernel heap when full. */
 #define ENIXNEL_MAX_FS_ENTRIES 128
 #define ENIXNEL_MAX_NAME_LEN   31
-#define ENIXNEL_MAX_FILE_SIZE  512
 
+/*
+ * File data lives in fixed-size blocks from the kernel heap (kernel/fsblock.c).
+ * Files up to FS_INLINE_SIZE bytes are stored inside the entry itself.
+ * Larger files map their blocks through FS_DIRECT_BLOCKS direct pointers,
+ * one indirect block and one double-indirect block.
+ */
+#define FS_BLOCK_SIZE      128
+#define FS_DIRECT_BLOCKS   6
+
+typedef uint16_t fs_blkno_t;       /* 0 = no block */
+
+#define FS_PTRS_PER_BLOCK  (FS_BLOCK_SIZE / sizeof(fs_blkno_t))
+#define FS_INLINE_SIZE     ((FS_DIRECT_BLOCKS + 2) * sizeof(fs_blkno_t))
+
+/* Largest file the block map can describe (the pool may run out first). */
+#define ENIXNEL_MAX_FILE_SIZE \
+    ((FS_DIRECT_BLOCKS + FS_PTRS_PER_BLOCK + FS_PTRS_PER_BLOCK * FS_PTRS_PER_BLOCK) \
+     * FS_BLOCK_SIZE)
+
+/* Round x up to the next power of two (x >= 1, constant expression). */
+#define ENIXNEL_POW2_1(x) ((x) | ((x) >> 1))
+#define ENIXNEL_POW2_2(x) (ENIXNEL_POW2_1(x) | (ENIXNEL_POW2_1(x) >> 2))
+#define ENIXNEL_POW2_4(x) (ENIXNEL_POW2_2(x) | (ENIXNEL_POW2_2(x) >> 4))
+#define ENIXNEL_POW2_8(x) (ENIXNEL_POW2_4(x) | (ENIXNEL_POW2_4(x) >> 8))
+#define ENIXNEL_POW2_16(x) (ENIXNEL_POW2_8(x) | (ENIXNEL_POW2_8(x) >> 16))
+#define ENIXNEL_ROUNDUP_POW2(x) (ENIXNEL_POW2_16((x) - 1) + 1)
+
+/* Initial hash index slots: power of two, at least twice the entry count. */
+#define ENIXNEL_FS_INDEX_SLOTS ENIXNEL_ROUNDUP_POW2(2 * ENIXNEL_MAX_FS_ENTRIES)
+
+/* Slot 0 is the root directory (name ""); FS_NONE terminates tree links. */
+#define FS_ROOT_INDEX 0
+#define FS_NONE       (-1)
+
+/*
+ * Entry metadata. File contents live in the block pool; only the block map
+ * (or a tiny file's bytes) is kept here, so scans over this table stay
+ * within a few KB instead of striding over the file data.
+ *
+ * A file created from the boot image (initrd.h) has in_image set and reads
+ * its bytes from the module memory left by GRUB. The first change copies
+ * them into inline or block storage like any other file's.
+ *
+ * Names are IDs into the intern arena (kernel/fsname.c): each distinct
+ * component is stored once however many entries carry it.
+ *
+ * Entries also form a tree: each directory keeps a list of its children
+ * (first_child, then next_sibling). The sibling list is doubly linked,
+ * and the first child's prev_sibling points at the last child, so both
+ * appending and unlinking are O(1).
+ */
 typedef struct fs_entry {
-    uint8_t used;
-    uint8_t is_dir;   /* 1 = directory, 0 = file */
-    char    name[ENIXNEL_MAX_NAME_LEN + 1];
+    uint8_t  used;
+    uint8_t  is_dir;   /* 1 = directory, 0 = file */
+    uint8_t  in_image; /* contents are data.image[0..size) */
+    uint32_t hash;     /* fs_name_hash(parent, name), cached for the index */
+    uint32_t size;     /* file length in bytes; <= FS_INLINE_SIZE means inline */
+
+    int32_t  parent;        /* FS_NONE only for the root */
+    int32_t  first_child;   /* FS_NONE if empty or not a directory */
+    int32_t  next_sibling;  /* FS_NONE for the last child */
+    int32_t  prev_sibling;  /* the last sibling, for the first child */
+
+    uint32_t name;          /* interned last path component, FS_NAME_EMPTY for root */
+    int32_t  name_next;     /* next entry with the same name (fs_name_first()) */
+    int32_t  name_prev;     /* FS_NONE for the first */
 
     /* File contents (only valid when is_dir == 0) */
-    uint32_t size;
-    char     data[ENIXNEL_MAX_FILE_SIZE];
+    union {
+        char inline_data[FS_INLINE_SIZE];
+        struct {
+            fs_blkno_t direct[FS_DIRECT_BLOCKS];
+            fs_blkno_t indirect;
+            fs_blkno_t dindirect;
+        } map;
+        const uint8_t* image;
+    } data;
 } fs_entry_t;
 
-/* Global table of entries, defined in crtfiles.c */
-extern fs_entry_t fs_entries[ENIXNEL_MAX_FS_ENTRIES];
+/* Global table of entries and its current size, defined in crtfiles.c.
+ * The table may move when it grows, so keep indices, not pointers, across
+ * calls that can create entries.
+ */
+extern fs_entry_t* fs_entries;
+extern int         fs_entry_capacity;
+
+/* Most slots the table may grow to, 0 for no limit. A mounted disk sets
+ * it to the size of its entry table, so every entry can be persisted.
+ */
+extern int         fs_entry_limit;
+
+/* Block pool and per-file block maps (implemented in kernel/fsblock.c). */
+fs_blkno_t fs_block_alloc(void);       /* zero-filled block, or 0 when out of memory */
+int        fs_block_share(fs_blkno_t blk); /* one more reference; <0 if blk is not in use */
+void       fs_block_free(fs_blkno_t blk);  /* drop a reference; the last frees the block */
+uint8_t*   fs_block_data(fs_blkno_t blk);
+uint32_t   fs_block_refcount(fs_blkno_t blk);  /* 0 if not in use (self-checks) */
+size_t     fs_blocks_used(void);
+
+/* Record that a block's bytes changed since the last fs_sync(). The block
+ * code marks everything it writes itself; callers only need this when
+ * they store through fs_block_data().
+ */
+void       fs_block_mark_dirty(fs_blkno_t blk);
+size_t     fs_blocks_dirty(void);      /* marked since the last fs_sync() */
+
+/* Call store for every dirty block still in use and clear its mark.
+ * Stops at the first store that fails (that block stays dirty) and
+ * returns <0; returns 0 otherwise.
+ */
+typedef int (*fs_block_store_fn)(fs_blkno_t blk, const uint8_t* data);
+int        fs_block_drain_dirty(fs_block_store_fn store);
+
+/* Loading from disk: claim block number blk with the given contents, then
+ * rebuild the free numbers once every block is in. fs_block_load()
+ * returns <0 when out of memory or if blk is already taken (a block that
+ * several files share is loaded once and fs_block_share()d after that).
+ */
+int        fs_block_load(fs_blkno_t blk, const void* data);
+void       fs_block_load_done(void);
+
+/* Call fn for every block a file's map refers to, data and indirect, each
+ * indirect block before the blocks it lists. When fn returns >0 for an
+ * indirect block, the blocks it lists are skipped. Stops early and returns
+ * <0 if fn does.
+ */
+typedef int (*fs_block_fn)(fs_blkno_t blk);
+int        fs_file_for_each_block(int idx, fs_block_fn fn);
+
+/* Grow or shrink a file to new_size, allocating or freeing blocks and
+ * moving between inline and block storage as needed. Grown bytes are zero.
+ * On failure (out of memory, too large) the file is left unchanged.
+ * Returns 0 on success, <0 on error.
+ */
+int    fs_file_resize(int idx, size_t new_size);
+
+/* Copy bytes between a buffer and [offset, offset + len) of a file.
+ * Reads stop at the end of file and return the number of bytes copied;
+ * writes must lie within the current size (resize first). A write copies
+ * the blocks it touches that are shared with a clone, and returns <0 if
+ * that runs out of memory (the bytes before that point are written).
+ */
+size_t fs_file_read(int idx, size_t offset, void* buf, size_t len);
+int    fs_file_write(int idx, size_t offset, const void* buf, size_t len);
+
+/* Give the empty file dst the contents of src by sharing src's blocks;
+ * either file copies a block when it first writes it. Boot image files
+ * are copied outright. Returns 0 on success, <0 on error.
+ */
+int    fs_file_clone(int dst, int src);
+
+/* Point *data at the bytes stored from offset on and return how many
+ * follow contiguously there (up to the end of a block), or 0 at the end
+ * of file. Valid until the file is next changed.
+ */
+size_t fs_file_span(int idx, size_t offset, const uint8_t** data);
+
+/* Set up the root directory and the name index. Call once before use. */
+void fs_init(void);
 
-/* Lookup helper shared between create/delete code. Returns index or -1. */
+/* Loading from disk: grow the table to at least capacity slots, and take
+ * slot idx off the free bitmap. fs_entries_reserve() returns <0 when out
+ * of memory or past fs_entry_limit.
+ */
+int  fs_entries_reserve(int capacity);
+void fs_entry_mark_used(int idx);
+
+/*
+ * Disk backing (implemented in kernel/fsdisk.c).
+ *
+ * fs_mount() loads the tree from the ATA disk through the block cache, or
+ * formats the disk when it holds no Enixnel fs (*formatted is set then).
+ * Afterwards the in-memory tables stay the working copy, and fs_sync()
+ * commits the entries and blocks that changed to the disk journal as one
+ * transaction; mounting replays it. Returns 0 when the disk
+ * is in use, <0 without a usable disk (the fs is then memory only).
+ * Call right after fs_init().
+ */
+int  fs_mount(int* formatted);
+int  fs_disk_mounted(void);
+int  fs_sync(void);                 /* 0 on success or without a disk */
+
+/* Kernel thread body: fs_sync() under fs_mutex once FS_SYNC_INTERVAL_MS
+ * have passed or FS_SYNC_DIRTY_BLOCKS blocks are dirty, whichever is first.
+ */
+#define FS_SYNC_INTERVAL_MS  5000
+#define FS_SYNC_POLL_MS      100
+#define FS_SYNC_DIRTY_BLOCKS 2048   /* 256 KiB */
+void fs_sync_thread(void* arg);
+
+/* The fs core takes no locks itself: kernel threads hold fs_mutex (a
+ * sched.h mutex_t, defined in kernel/main.c) around any sequence of fs
+ * calls, so lookups never see a half-linked entry or a table mid-grow.
+ */
+struct mutex;
+extern struct mutex fs_mutex;
+
+/* Lookup helper shared between create/delete code. Returns index or -1.
+ * Paths are '/'-separated components from the working directory, or from
+ * the root when they start with '/'; "" is the working directory itself.
+ * "." and ".." work as usual on lookups but cannot be created.
+ */
 int fs_find_index(const char* name);
 
+/*
+ * Working directory for relative paths, kept as an entry index so that
+ * relative calls resolve only their own components. fs_chdir() returns
+ * <0 if path is not a directory. Deleting the directory (or one above it)
+ * moves it back to the root, and renames do not affect it. fs_init()
+ * starts it at the root.
+ */
+int  fs_chdir(const char* path);
+int  fs_cwd(void);
+void fs_cwd_forget(int idx);
+
+/* Resolve everything but the last component of path (relative as for
+ * fs_find_index()). Returns the parent directory index and points *leaf
+ * and *leaf_len at the last component, or returns -1 if the parent does
+ * not exist.
+ */
+int fs_resolve_parent(const char* path, const char** leaf, size_t* leaf_len);
+
+/* Create an empty file or directory named leaf in directory parent; leaf
+ * must be a valid component, as from fs_resolve_parent(). Returns its
+ * index, or -1 if the name exists or when out of memory.
+ */
+int fs_create_child(int parent, const char* leaf, size_t leaf_len, uint8_t is_dir);
+
+/* Release an entry and, for a directory, everything below it, without a
+ * path lookup (implemented in kernel/delfiles.c).
+ */
+void fs_release_tree(int idx);
+
+/* Write the full path of an entry into out. Returns its length, or -1 if
+ * out_size is too small.
+ */
+int fs_build_path(int idx, char* out, size_t out_size);
+
+/* Return a slot to the free-slot bitmap (implemented in kernel/crtfiles.c). */
+void fs_entry_mark_free(int idx);
+
+/* Directory tree links (implemented in kernel/crtfiles.c). fs_is_within()
+ * returns 1 if dir is idx itself or lies somewhere below it.
+ */
+void fs_link_child(int parent, int idx);
+void fs_unlink_child(int idx);
+int  fs_is_within(int dir, int idx);
+
+/*
+ * Interned component names (implemented in kernel/fsname.c).
+ *
+ * fs_name_intern() returns the ID of the component (at most
+ * ENIXNEL_MAX_NAME_LEN bytes), adding it if new, and takes a reference;
+ * fs_name_release() drops one. FS_NAME_NONE means too long or out of
+ * memory. The string from fs_name_str() is NUL-terminated and valid until
+ * the next intern or release, which may move the arena.
+ */
+#define FS_NAME_EMPTY 0u            /* "", the root's name; never freed */
+#define FS_NAME_NONE  0xFFFFFFFFu
+
+void        fs_name_init(void);
+uint32_t    fs_name_intern(const char* s, size_t len);
+void        fs_name_release(uint32_t id);
+const char* fs_name_str(uint32_t id);
+size_t      fs_name_len(uint32_t id);
+
+/* Entries by name: the index links each entry into the list of its name
+ * (fs_name_link() from fs_index_insert(), fs_name_unlink() from
+ * fs_index_remove()). fs_name_first() returns the first entry called id,
+ * or FS_NONE; follow fs_entries[i].name_next from there.
+ */
+void        fs_name_link(int idx);
+void        fs_name_unlink(int idx);
+int         fs_name_first(uint32_t id);
+
+/*
+ * Prefix trie over the interned names (implemented in kernel/fstrie.c),
+ * kept up to date by fsname.c. fs_trie_walk() calls fn for every name
+ * starting with prefix, in byte order, until fn returns nonzero (and then
+ * returns 1; 0 otherwise). fs_find_names() does the same for a pattern:
+ * one with '*' or '?' must then match the whole name, otherwise it is a
+ * prefix. It walks only the names that start with the bytes before the
+ * first wildcard.
+ */
+typedef int (*fs_name_fn)(uint32_t name, void* ctx);
+
+void fs_trie_init(void);
+/* Add a name; *node is where it ends, for fs_trie_remove(). <0 out of memory. */
+int  fs_trie_insert(uint32_t name, const char* s, size_t len, uint32_t* node);
+void fs_trie_remove(uint32_t node);
+int  fs_trie_walk(const char* prefix, size_t len, fs_name_fn fn, void* ctx);
+int  fs_find_names(const char* pattern, fs_name_fn fn, void* ctx);
+
+/* Last path component of an entry ("c" for "a/b/c"). */
+static inline const char* fs_entry_basename(int idx)
+{
+    return fs_name_str(fs_entries[idx].name);
+}
+
+/* Name index (implemented in kernel/fsindex.c), keyed on (parent, name).
+ * fs_index_insert/fs_index_remove use fs_entries[idx].parent, .name and
+ * .hash, so the entry must be filled in before insert and still intact at
+ * remove.
+ */
+void fs_index_init(void);
+int  fs_index_resize(int entry_capacity);   /* 0 on success, <0 if out of memory */
+uint32_t fs_name_hash(int parent, const char* name, size_t len);
+int  fs_index_lookup(int parent, const char* name, size_t len, uint32_t hash);
+void fs_index_insert(int idx);
+void fs_index_remove(int idx);
+
 /* Create APIs (implemented in kernel/crtfiles.c) */
 int fs_create_dir(const char* name);
 int fs_create_file(const char* name);
 
-/* Delete APIs (implemented in kernel/delfiles.c) */
+/* Create a file whose contents are the size bytes at data, which must stay
+ * in place (the boot image). Nothing is copied until the file changes.
+ * Returns 0 on success, <0 on error (including when name exists).
+ */
+int fs_create_image_file(const char* name, const void* data, uint32_t size);
+
+/* Delete APIs (implemented in kernel/delfiles.c).
+ * fs_delete_dir removes the whole subtree below the directory.
+ */
 int fs_delete_dir(const char* name);
 int fs_delete_file(const char* name);
 
+/* Rename API (implemented in kernel/mvfiles.c).
+ * Moves an entry, and everything below it, to new_name. The target must
+ * not exist and its parent must be a directory outside the moved subtree.
+ * Returns 0 on success, <0 on error.
+ */
+int fs_rename(const char* old_name, const char* new_name);
+
+/* Clone API (implemented in kernel/cpfiles.c).
+ * Copies an entry, and everything below it, to new_name with the same
+ * rules for the target as fs_rename(). File blocks are shared rather than
+ * copied, so the cost is in entries, not bytes. Returns 0 on success,
+ * <0 on error (nothing is left behind then).
+ */
+int fs_clone(const char* old_name, const char* new_name);
+
 /* File content APIs (implemented in kernel/crtfiles.c) */
 
 /* Write data to file. If append != 0, append; otherwise overwrite.
@@ -41,9 +359,53 @@ int fs_delete_file(const char* name);
  */
 int fs_write_file(const char* name, const char* data, size_t len, int append);
 
-/* Read file contents. On success, *out_data points into internal storage and
- * *out_len is the length (not including a trailing '\0'). Returns 0 on success, <0 on error.
+/* Read up to len bytes starting at offset into buf. *out_len receives the
+ * number of bytes copied (0 at or past the end). Returns 0 on success, <0 on error.
+ */
+int fs_read_file(const char* name, size_t offset, char* buf, size_t len, size_t* out_len);
+
+/* Length of a file in bytes. Returns 0 on success, <0 on error. */
+int fs_file_size(const char* name, size_t* out_size);
+
+/*
+ * Open files (implemented in kernel/fsfd.c).
+ *
+ * fs_open() resolves name once and returns a descriptor (>= 0) that the
+ * calls below use without any path lookup. Directories cannot be opened.
+ * A descriptor stays valid across renames and is closed automatically
+ * when its file is deleted. Returns <0 on error or when all FS_MAX_OPEN
+ * descriptors are in use.
+ */
+#define FS_MAX_OPEN  32
+#define FS_O_CREATE  0x1    /* create the file if it does not exist */
+#define FS_O_TRUNC   0x2    /* cut it to length 0 */
+
+int  fs_open(const char* name, int flags);
+int  fs_close(int fd);
+void fs_fd_forget(int idx);     /* close every descriptor on entry idx */
+
+/* Copy up to len bytes at offset; returns the count (0 at or past the end
+ * of file), or <0 if fd is not open.
  */
-int fs_read_file(const char* name, const char** out_data, size_t* out_len);
+int  fs_pread(int fd, void* buf, size_t len, size_t offset);
+
+/* Write len bytes at offset, growing the file if they reach past its end
+ * (a gap reads as zeros). Returns len, or <0 on error (the file is then
+ * unchanged).
+ */
+int  fs_pwrite(int fd, const void* buf, size_t len, size_t offset);
+int  fs_fd_size(int fd, size_t* out_size);
+
+/* Streaming reads: each fs_stream_next() hands out the next run of the
+ * file straight from storage, with no copy, and returns its length (0 at
+ * the end). The data is valid until the file is next changed.
+ */
+typedef struct fs_stream {
+    int    fd;
+    size_t offset;
+} fs_stream_t;
+
+void   fs_stream_open(fs_stream_t* s, int fd, size_t offset);
+size_t fs_stream_next(fs_stream_t* s, const char** data);
 
 #endif /* ENIXNEL_FS_H */
\ No newline at end of file
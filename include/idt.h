@@ -0,0 +1,99 @@
+#ifndef ENIXNEL_IDT_H
+#define ENIXNEL_IDT_H
+
+#include <stdint.h>
+
+/*
+ * Descriptor tables and interrupt dispatch (arch/x86/kernel/).
+ *
+ * Vectors 0-31 are CPU exceptions; the 8259 PICs are remapped so that
+ * IRQ n arrives on vector IRQ_BASE + n, and the VECTOR_* kernel vectors
+ * follow them.
+ */
+
+#define IRQ_BASE     0x20
+#define IRQ_KEYBOARD 1
+#define IRQ_COM1     4
+
+/* Kernel vectors above the IRQs: thread_yield() (sched.h), and the
+ * local APIC's timer, reschedule IPI and spurious vector (apic.h).
+ */
+#define VECTOR_YIELD        0x30
+#define VECTOR_LAPIC_TIMER  0x31
+#define VECTOR_RESCHED      0x32
+#define VECTOR_SPURIOUS     0x3F
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+
+/* Register state pushed by the stubs in isr.S, lowest address first. */
+typedef struct interrupt_frame {
+    uint32_t xmm[16];           /* xmm0-xmm3, only saved once SSE is on */
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_dummy, ebx, edx, ecx, eax;   /* pusha */
+    uint32_t vector;
+    uint32_t error_code;        /* 0 for vectors without one */
+    uint32_t eip, cs, eflags;   /* pushed by the CPU */
+} interrupt_frame_t;
+
+typedef void (*irq_handler_t)(interrupt_frame_t* frame);
+
+void gdt_init(void);
+void idt_init(void);    /* also remaps the PIC, all IRQ lines masked */
+void idt_load(void);    /* lidt only, for application processors */
+
+/* Deliver IRQs through the I/O APIC from now on (called by apic_init()). */
+void irq_use_ioapic(void);
+
+/* Called from isr.S; returns the frame to resume. */
+interrupt_frame_t* interrupt_dispatch(interrupt_frame_t* frame);
+
+/* Route IRQ line irq to handler and unmask it at the PIC. */
+void irq_install_handler(unsigned irq, irq_handler_t handler);
+
+/* 8259 PIC (arch/x86/kernel/pic.c) */
+void pic_remap(uint8_t master_base, uint8_t slave_base);
+void pic_unmask(unsigned irq);
+void pic_mask(unsigned irq);
+void pic_send_eoi(unsigned irq);
+
+/* Returns 1 for a spurious IRQ 7/15, which must not be acknowledged
+ * (beyond the cascade EOI this function already sends for IRQ 15).
+ */
+int  pic_is_spurious(unsigned irq);
+
+static inline void interrupts_enable(void)
+{
+    __asm__ __volatile__("sti" ::: "memory");
+}
+
+static inline void interrupts_disable(void)
+{
+    __asm__ __volatile__("cli" ::: "memory");
+}
+
+/* Enable interrupts and halt until one arrives. sti takes effect only
+ * after the next instruction, so an IRQ that is already pending cannot
+ * slip in between a caller's check and the hlt.
+ */
+static inline void interrupts_enable_and_halt(void)
+{
+    __asm__ __volatile__("sti; hlt" ::: "memory");
+}
+
+/* Disable interrupts, returning the previous EFLAGS for irq_restore(). */
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    if (flags & 0x200) {    /* IF */
+        interrupts_enable();
+    }
+}
+
+#endif /* ENIXNEL_IDT_H */
@@ -0,0 +1,66 @@
+#ifndef ENIXNEL_INITRD_H
+#define ENIXNEL_INITRD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multiboot.h"
+
+/*
+ * Boot image ("initrd") loaded by GRUB as a Multiboot module
+ * (implemented in kernel/initrd.c, built by tools/mkinitrd.c).
+ *
+ * The image is index first, so it can be used where it lies:
+ *
+ *   initrd_header_t
+ *   initrd_entry_t[count]      sorted by path, bytewise
+ *   name bytes, names_size     paths relative to the root, no NULs
+ *   payload                    file contents, at payload_start
+ *
+ * A parent directory always sorts before its children, so walking the
+ * table in order creates every directory before what it holds. All
+ * offsets are from the start of the image.
+ */
+
+#define INITRD_MAGIC    0x44524E45u     /* "ENRD" */
+#define INITRD_VERSION  1
+#define INITRD_DIR      0x0001          /* initrd_entry_t.flags */
+#define INITRD_PATH_MAX 256             /* including the NUL */
+
+typedef struct initrd_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t names_start;
+    uint32_t names_size;
+    uint32_t payload_start;
+    uint32_t image_size;
+    uint32_t reserved;
+} initrd_header_t;
+
+typedef struct initrd_entry {
+    uint32_t name_off;          /* from names_start */
+    uint16_t name_len;
+    uint16_t flags;
+    uint32_t data_off;          /* from payload_start */
+    uint32_t size;
+} initrd_entry_t;
+
+/* Take the first module that holds a valid image. Returns 0 if one was
+ * found, <0 otherwise (the kernel then boots without one).
+ */
+int      initrd_init(const multiboot_info_t* mbi);
+uint32_t initrd_count(void);
+uint32_t initrd_size(void);
+
+/* Binary search for path[0..len). Returns the entry or 0. */
+const initrd_entry_t* initrd_find(const char* path, size_t len);
+const void*           initrd_data(const initrd_entry_t* e);
+
+/* Add every directory and file of the image that the fs does not have
+ * yet. Files are created over the image bytes (fs_create_image_file), so
+ * nothing is copied until one is modified. Returns the number added.
+ * Call with fs_mutex held, or before the scheduler starts.
+ */
+int      initrd_populate(void);
+
+#endif /* ENIXNEL_INITRD_H */
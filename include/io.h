@@ -0,0 +1,61 @@
+#ifndef ENIXNEL_IO_H
+#define ENIXNEL_IO_H
+
+#include <stdint.h>
+
+/* x86 port I/O helpers. */
+
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t value;
+    __asm__ __volatile__("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outb(uint16_t port, uint8_t value)
+{
+    __asm__ __volatile__("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port)
+{
+    uint16_t value;
+    __asm__ __volatile__("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outw(uint16_t port, uint16_t value)
+{
+    __asm__ __volatile__("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port)
+{
+    uint32_t value;
+    __asm__ __volatile__("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outl(uint16_t port, uint32_t value)
+{
+    __asm__ __volatile__("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+/* Block transfers of count 16-bit words (ATA PIO data port). */
+static inline void insw(uint16_t port, void* buf, uint32_t count)
+{
+    __asm__ __volatile__("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buf, uint32_t count)
+{
+    __asm__ __volatile__("rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+/* Short delay for devices that need time between port writes (8259). */
+static inline void io_wait(void)
+{
+    outb(0x80, 0);
+}
+
+#endif /* ENIXNEL_IO_H */
@@ -0,0 +1,57 @@
+#ifndef ENIXNEL_JOURNAL_H
+#define ENIXNEL_JOURNAL_H
+
+#include <stdint.h>
+#include "bcache.h"
+
+/*
+ * Write-ahead block journal (implemented in kernel/journal.c).
+ *
+ * journal_commit() takes every pending block cache buffer (bcache.h) and
+ * appends it to a circular region of the disk as one group of
+ * transactions of up to JOURNAL_MAX_BLOCKS blocks each: a descriptor
+ * listing the home block numbers, the block images, and a commit block
+ * with a checksum over them. Every commit block but the group's last says
+ * more follows. The group is written as one sequential run followed by a
+ * drive flush, and only then are the buffers merely dirty, free to reach
+ * their home locations whenever the cache writes them back. When the
+ * region cannot take the next group, journal_checkpoint() writes
+ * everything home and starts it over first, never in the middle of one.
+ *
+ * At mount, journal_replay() copies every complete group home in order
+ * and stops at the first one with a transaction missing or torn, so the
+ * disk ends up as of the last commit. Callers hold fs_mutex.
+ */
+
+#define JOURNAL_MAX_BLOCKS BCACHE_BUFFERS       /* per transaction */
+
+/* Journal blocks a group of n cache blocks takes. */
+#define JOURNAL_GROUP_SIZE(n) \
+    ((n) + 2 * (((n) + JOURNAL_MAX_BLOCKS - 1) / JOURNAL_MAX_BLOCKS))
+
+typedef struct journal_stats {
+    uint32_t commits;
+    uint32_t blocks_logged;
+    uint32_t checkpoints;
+    uint32_t replayed;                  /* groups applied at mount */
+} journal_stats_t;
+
+/* Use disk blocks [start, start + blocks) for the journal. Needs
+ * bcache_init(). Returns 0 on success, <0 when out of memory.
+ */
+int  journal_init(uint32_t start, uint32_t blocks);
+
+/* Apply committed transactions, then empty the journal. Formats the
+ * region if it holds no journal. Returns 0 on success, <0 on I/O error.
+ */
+int  journal_replay(void);
+
+/* Returns the number of blocks committed (0 if nothing was pending), or
+ * <0 on an I/O error or when the group is larger than the whole region
+ * (the buffers stay pending).
+ */
+int  journal_commit(void);
+int  journal_checkpoint(void);
+void journal_get_stats(journal_stats_t* out);
+
+#endif /* ENIXNEL_JOURNAL_H */
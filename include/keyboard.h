@@ -0,0 +1,24 @@
+#ifndef ENIXNEL_KEYBOARD_H
+#define ENIXNEL_KEYBOARD_H
+
+/*
+ * PS/2 keyboard (implemented in kernel/keyboard.c).
+ *
+ * IRQ 1 queues raw scancodes; keyboard_poll_char() translates them on
+ * the reader's side. Requires idt_init() first.
+ */
+
+void keyboard_init(void);
+
+/* Next typed character (printable, '\n', '\b', or one of the
+ * CONSOLE_KEY_* codes from console.h), or -1 if none is queued. Never
+ * blocks.
+ */
+int keyboard_poll_char(void);
+
+/* Nonzero while scancodes are queued. Check with interrupts disabled
+ * before halting to wait for more.
+ */
+int keyboard_input_pending(void);
+
+#endif /* ENIXNEL_KEYBOARD_H */
@@ -0,0 +1,35 @@
+#ifndef ENIXNEL_KMALLOC_H
+#define ENIXNEL_KMALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Kernel heap (implemented in kernel/kmalloc.c).
+ *
+ * Slab caches hand out fixed-size objects carved from pages of the buddy
+ * allocator (pmm.h): allocation and free are O(1), objects of one cache are
+ * packed together, and a cache only keeps a single empty slab around, so
+ * memory goes back to the page allocator as caches shrink.
+ *
+ * kmalloc() rounds small requests up to a power-of-two size class backed
+ * by its own cache; requests above KMALLOC_MAX_SLAB take whole pages.
+ */
+
+#define KMALLOC_MIN_SLAB 16
+#define KMALLOC_MAX_SLAB 1024
+
+typedef struct kmem_cache kmem_cache_t;
+
+/* Create a cache of obj_size-byte objects. name must stay valid. Returns
+ * NULL if no cache descriptor is left or obj_size does not fit a slab.
+ */
+kmem_cache_t* kmem_cache_create(const char* name, size_t obj_size);
+void*         kmem_cache_alloc(kmem_cache_t* cache);   /* NULL when out of memory */
+void          kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);    /* kmalloc + zero fill */
+void  kfree(void* ptr);
+
+#endif /* ENIXNEL_KMALLOC_H */
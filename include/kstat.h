@@ -0,0 +1,89 @@
+#ifndef ENIXNEL_KSTAT_H
+#define ENIXNEL_KSTAT_H
+
+#include <stdint.h>
+#include "timer.h"
+
+/*
+ * Always-on cycle accounting (implemented in kernel/kstat.c).
+ *
+ * A kstat_t slot counts calls, total and worst-case TSC cycles for one
+ * function. KSTAT_SCOPE(slot) at the top of a function times everything
+ * up to whichever return leaves it, using a cleanup variable, so bodies
+ * need no other changes. Times include nested instrumented calls.
+ *
+ * Built with STATS=0 (no ENIXNEL_STATS), KSTAT_SCOPE expands to nothing
+ * and neither the slots nor the report code exist.
+ */
+
+typedef struct kstat {
+    const char* name;
+    uint32_t    calls;
+    uint64_t    cycles;
+    uint64_t    max;
+} kstat_t;
+
+/* Instrumented fs.h entry points: X(id, name). */
+#define KSTAT_FS_LIST(X)                        \
+    X(FS_FIND_INDEX,  "fs_find_index")          \
+    X(FS_CREATE_DIR,  "fs_create_dir")          \
+    X(FS_CREATE_FILE, "fs_create_file")         \
+    X(FS_DELETE_DIR,  "fs_delete_dir")          \
+    X(FS_DELETE_FILE, "fs_delete_file")         \
+    X(FS_RENAME,      "fs_rename")              \
+    X(FS_CLONE,       "fs_clone")               \
+    X(FS_WRITE_FILE,  "fs_write_file")          \
+    X(FS_READ_FILE,   "fs_read_file")           \
+    X(FS_FILE_SIZE,   "fs_file_size")           \
+    X(FS_FILE_RESIZE, "fs_file_resize")         \
+    X(FS_FILE_READ,   "fs_file_read")           \
+    X(FS_FILE_WRITE,  "fs_file_write")          \
+    X(FS_OPEN,        "fs_open")                \
+    X(FS_PREAD,       "fs_pread")               \
+    X(FS_PWRITE,      "fs_pwrite")
+
+enum {
+#define KSTAT_ENUM(id, name) KSTAT_##id,
+    KSTAT_FS_LIST(KSTAT_ENUM)
+#undef KSTAT_ENUM
+    KSTAT_FS_COUNT
+};
+
+#ifdef ENIXNEL_STATS
+
+/* Print slots with at least one call; reset zeroes the counters. */
+void kstat_print(const kstat_t* slots, int count);
+void kstat_reset(kstat_t* slots, int count);
+
+extern kstat_t kstat_fs[KSTAT_FS_COUNT];
+
+struct kstat_scope {
+    kstat_t* slot;
+    uint64_t start;
+};
+
+static inline void kstat_scope_end(struct kstat_scope* s)
+{
+    uint64_t d = rdtsc() - s->start;
+    kstat_t* k = s->slot;
+    ++k->calls;
+    k->cycles += d;
+    if (d > k->max) {
+        k->max = d;
+    }
+}
+
+#define KSTAT_SCOPE(slot)                                                   \
+    struct kstat_scope kstat_scope_ __attribute__((cleanup(kstat_scope_end))) \
+        = { (slot), rdtsc() }
+
+#define KSTAT_FS(id) KSTAT_SCOPE(&kstat_fs[KSTAT_##id])
+
+#else
+
+#define KSTAT_SCOPE(slot) do { } while (0)
+#define KSTAT_FS(id)      do { } while (0)
+
+#endif /* ENIXNEL_STATS */
+
+#endif /* ENIXNEL_KSTAT_H */
@@ -0,0 +1,34 @@
+#ifndef ENIXNEL_MATH64_H
+#define ENIXNEL_MATH64_H
+
+#include <stdint.h>
+
+/*
+ * 64-bit division helpers. The kernel links without libgcc, so a plain
+ * '/' or '%' on uint64_t (which calls __udivdi3/__umoddi3) does not
+ * link; divide by 32-bit divisors with these instead.
+ */
+
+/* Return n / d and store n % d in *rem (if rem is non-NULL). */
+static inline uint64_t div64_u32_rem(uint64_t n, uint32_t d, uint32_t* rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+
+    /* r < d, so the 64 / 32 divl below cannot overflow. */
+    __asm__("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+    if (rem) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+static inline uint64_t div64_u32(uint64_t n, uint32_t d)
+{
+    return div64_u32_rem(n, d, 0);
+}
+
+#endif /* ENIXNEL_MATH64_H */
@@ -0,0 +1,54 @@
+#ifndef ENIXNEL_MULTIBOOT_H
+#define ENIXNEL_MULTIBOOT_H
+
+#include <stdint.h>
+
+/* Multiboot v1 structures handed to kernel_main() by boot.S. */
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+/* multiboot_info_t.flags bits */
+#define MULTIBOOT_INFO_MEMORY   (1u << 0)   /* mem_lower/mem_upper valid */
+#define MULTIBOOT_INFO_CMDLINE  (1u << 2)
+#define MULTIBOOT_INFO_MODS     (1u << 3)
+#define MULTIBOOT_INFO_MEM_MAP  (1u << 6)   /* mmap_addr/mmap_length valid */
+
+/* multiboot_mmap_entry_t.type */
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+typedef struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;     /* KiB below 1 MiB */
+    uint32_t mem_upper;     /* KiB above 1 MiB */
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+} __attribute__((packed)) multiboot_info_t;
+
+/* Memory map entries are variable length: the next one starts at
+ * (uint8_t*)entry + entry->size + sizeof(entry->size).
+ */
+typedef struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+typedef struct multiboot_module {
+    uint32_t mod_start;
+    uint32_t mod_end;
+    uint32_t string;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+#endif /* ENIXNEL_MULTIBOOT_H */
@@ -0,0 +1,33 @@
+#ifndef ENIXNEL_PAGING_H
+#define ENIXNEL_PAGING_H
+
+#include <stdint.h>
+
+/*
+ * Paging (implemented in arch/x86/kernel/paging.c).
+ *
+ * One page directory, shared by every CPU and thread, identity maps RAM
+ * so physical addresses from the page allocator stay usable pointers.
+ * The first 4 MiB use a 4 KiB page table: page 0 is left out to catch
+ * null pointers, kernel text and rodata are read-only, and the VGA window
+ * is write-combining. RAM above that uses 4 MiB pages when the CPU has
+ * PSE. Kernel mappings are global, so they survive CR3 reloads.
+ */
+
+/* Build the directory and turn paging on for the calling CPU (the BSP).
+ * Needs pmm_init() for page tables. Returns 0 on success, <0 if it stays
+ * off; the kernel then keeps running unpaged.
+ */
+int  paging_init(void);
+int  paging_enabled(void);
+
+/* Turn paging on for an AP with the directory paging_init() built. */
+void paging_enable_cpu(void);
+
+/* Identity map [phys, phys + size) uncached for device registers. May be
+ * called before paging_init(); the range is then mapped when it runs.
+ * Returns 0 on success, <0 when out of memory or slots.
+ */
+int  paging_map_mmio(uint32_t phys, uint32_t size);
+
+#endif /* ENIXNEL_PAGING_H */
@@ -0,0 +1,35 @@
+#ifndef ENIXNEL_PMM_H
+#define ENIXNEL_PMM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multiboot.h"
+
+/*
+ * Physical page frame allocator (implemented in kernel/pmm.c).
+ *
+ * A binary buddy allocator over the RAM reported by the Multiboot memory
+ * map. Blocks are 2^order contiguous pages, order 0 .. PMM_MAX_ORDER.
+ * RAM is identity mapped (paging.h), so the returned physical addresses
+ * are usable pointers.
+ */
+
+#define PAGE_SIZE     4096
+#define PAGE_SHIFT    12
+#define PMM_MAX_ORDER 10            /* largest block: 4 MiB */
+
+/* Build the free lists from the memory map. Returns 0 on success, <0 if
+ * the boot information has no usable memory description.
+ */
+int    pmm_init(const multiboot_info_t* mbi);
+
+void*  pmm_alloc_pages(unsigned order);          /* NULL when out of memory */
+void   pmm_free_pages(void* addr, unsigned order);
+
+size_t pmm_total_pages(void);   /* pages handed to the allocator at boot */
+size_t pmm_free_pages_count(void);
+
+/* End of the highest usable RAM region, page aligned. */
+uint32_t pmm_memory_end(void);
+
+#endif /* ENIXNEL_PMM_H */
@@ -0,0 +1,30 @@
+#ifndef ENIXNEL_POWER_H
+#define ENIXNEL_POWER_H
+
+#include <stdint.h>
+
+/*
+ * Halting and shutdown (implemented in kernel/power.c).
+ *
+ * power_exit() writes the code to QEMU's isa-debug-exit port, which ends
+ * the emulator with exit status (code << 1) | 1. Without that device the
+ * write goes nowhere and the machine halts instead.
+ *
+ * Batch mode (the "autorun" boot option) is for headless runs such as
+ * make perf: fatal errors then leave through power_exit(POWER_EXIT_FAULT)
+ * rather than halting, so the host sees a failure instead of a hang.
+ */
+
+#define POWER_EXIT_PORT   0xF4
+#define POWER_EXIT_FAULT  0x7F
+
+void power_set_batch(int on);
+int  power_batch(void);
+
+void power_halt(void) __attribute__((noreturn));
+void power_exit(uint8_t code) __attribute__((noreturn));
+
+/* Fatal error: exit with POWER_EXIT_FAULT in batch mode, else halt. */
+void power_fatal(void) __attribute__((noreturn));
+
+#endif /* ENIXNEL_POWER_H */
@@ -0,0 +1,106 @@
+#ifndef ENIXNEL_SCHED_H
+#define ENIXNEL_SCHED_H
+
+#include <stdint.h>
+#include "idt.h"
+
+/*
+ * Kernel threads and the scheduler (implemented in kernel/sched.c).
+ *
+ * Every thread has its own THREAD_STACK_ORDER stack from the page
+ * allocator and is switched by swapping the interrupt_frame_t that
+ * isr.S saved: a switch is interrupt_dispatch() returning another
+ * thread's frame. Each CPU runs its ready threads round robin for
+ * SCHED_QUANTUM_TICKS timer ticks each and steals from the busiest
+ * other CPU when it runs dry. The timer preempts threads, and
+ * thread_yield() gives up the CPU early through the VECTOR_YIELD
+ * software interrupt. The boot context of each CPU becomes its idle
+ * thread, which runs only when nothing else is ready.
+ *
+ * Threads block on a wait_queue_t through wait_event(). The waker may be
+ * an IRQ handler on any CPU.
+ */
+
+#define THREAD_STACK_ORDER  2       /* 16 KiB */
+#define SCHED_QUANTUM_TICKS 2       /* 20 ms at TIMER_HZ 100 */
+
+typedef struct thread thread_t;
+typedef void (*thread_fn)(void* arg);
+
+typedef struct wait_queue {
+    thread_t* head;
+    thread_t* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { 0, 0 }
+
+/* Sleeping lock for long critical sections (threads only, not IRQs). */
+typedef struct mutex {
+    volatile uint32_t locked;
+    wait_queue_t      wait;
+} mutex_t;
+
+#define MUTEX_INIT { 0, WAIT_QUEUE_INIT }
+
+/* Turn the running boot context into the idle thread of CPU 0. Needs the
+ * heap. Returns 0 on success, <0 when out of memory. APs join through
+ * sched_init_cpu() (smp.c).
+ */
+int  sched_init(void);
+int  sched_init_cpu(void);
+int  sched_running(void);
+
+/* Run the calling CPU's idle loop on its boot context; never returns. */
+void sched_idle(void) __attribute__((noreturn));
+
+/* Start fn(arg) on a new thread, on the least loaded CPU. name must stay
+ * valid. Returns NULL when out of memory. Returning from fn ends the
+ * thread, as does thread_exit().
+ */
+thread_t* thread_create(const char* name, thread_fn fn, void* arg);
+void      thread_exit(void) __attribute__((noreturn));
+void      thread_yield(void);
+void      thread_sleep_ms(uint32_t ms);
+
+/*
+ * Block until cond holds. cond is evaluated with the scheduler lock held
+ * and interrupts off, so it must be short and must not block; whoever
+ * makes it true calls wait_queue_wake_all(q) afterwards. Before
+ * sched_init() this halts until the next interrupt between checks.
+ */
+#define wait_event(q, cond)                                     \
+    do {                                                        \
+        for (;;) {                                              \
+            uint32_t wait_flags_ = sched_lock_irqsave();        \
+            if (cond) {                                         \
+                sched_unlock_irqrestore(wait_flags_);           \
+                break;                                          \
+            }                                                   \
+            wait_queue_sleep_locked((q), wait_flags_);          \
+        }                                                       \
+    } while (0)
+
+void wait_queue_wake_all(wait_queue_t* q);
+
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
+
+/* Building blocks of wait_event(). wait_queue_sleep_locked() drops the
+ * lock while asleep and returns without it, flags restored.
+ */
+uint32_t sched_lock_irqsave(void);
+void     sched_unlock_irqrestore(uint32_t flags);
+void     wait_queue_sleep_locked(wait_queue_t* q, uint32_t flags);
+
+/* Hooks for the interrupt path: the timer tick, the last step of
+ * interrupt_dispatch(), which returns the frame to resume, and the
+ * release after isr.S has switched stacks.
+ */
+void sched_tick(void);
+interrupt_frame_t* sched_preempt(interrupt_frame_t* frame);
+void sched_switch_finish(void);
+
+/* Print one line per thread: id, CPU, state, ticks run, name. */
+void sched_print(void);
+
+#endif /* ENIXNEL_SCHED_H */
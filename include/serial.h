@@ -0,0 +1,40 @@
+#ifndef ENIXNEL_SERIAL_H
+#define ENIXNEL_SERIAL_H
+
+#include <stddef.h>
+
+/*
+ * 16550 UART on COM1 (implemented in kernel/serial.c).
+ *
+ * Output is queued in a ring and drained by the THRE interrupt in FIFO
+ * sized bursts, so writers never wait for the line. Received bytes are
+ * queued by the same IRQ. Without a UART every call is a no-op.
+ */
+
+/* Probe and program COM1 for 115200 8N1. Returns 0, or -1 if absent.
+ * Requires idt_init() first.
+ */
+int  serial_init(void);
+int  serial_present(void);
+
+/* Queue one byte ('\n' goes out as "\r\n"). */
+void serial_putc(char c);
+
+/* Queue len bytes as serial_putc() would, with interrupts masked once. */
+void serial_write(const char* s, size_t len);
+
+/* Queue len bytes exactly as given, '\n' included (binary dumps). */
+void serial_write_raw(const void* data, size_t len);
+
+/* Push everything queued out by polling; for paths running with
+ * interrupts off (exceptions, panics).
+ */
+void serial_flush_sync(void);
+
+/* Next received character ('\r' becomes '\n', DEL becomes '\b', the
+ * cursor-up/down sequences CONSOLE_KEY_UP/DOWN), or -1.
+ */
+int  serial_poll_char(void);
+int  serial_input_pending(void);
+
+#endif /* ENIXNEL_SERIAL_H */
@@ -0,0 +1,29 @@
+#ifndef ENIXNEL_SMP_H
+#define ENIXNEL_SMP_H
+
+#include <stdint.h>
+#include "acpi.h"
+
+/*
+ * Multiprocessor bring-up (implemented in arch/x86/kernel/smp.c).
+ *
+ * CPUs are numbered 0 .. smp_cpu_count()-1, the BSP being 0. smp_init()
+ * wakes every other CPU in the MADT with INIT-SIPI-SIPI through the
+ * real-mode trampoline in arch/x86/boot/ap_boot.S; each AP enables its
+ * local APIC and timer, joins the scheduler and runs its idle loop.
+ * Device IRQs stay on the BSP.
+ */
+
+#define SMP_MAX_CPUS          ACPI_MAX_CPUS
+#define SMP_TRAMPOLINE_ADDR   0x8000    /* must match ap_boot.S */
+
+/* Start the APs. Needs apic_init(), timer_init() and sched_init(). */
+void     smp_init(void);
+
+uint32_t smp_cpu_id(void);          /* calling CPU, 0 before smp_init() */
+uint32_t smp_cpu_count(void);       /* CPUs online */
+
+/* Reschedule IPI to cpu (VECTOR_RESCHED). */
+void     smp_send_resched(uint32_t cpu);
+
+#endif /* ENIXNEL_SMP_H */
@@ -0,0 +1,57 @@
+#ifndef ENIXNEL_SPINLOCK_H
+#define ENIXNEL_SPINLOCK_H
+
+#include <stdint.h>
+#include "idt.h"
+
+/*
+ * Test-and-set spinlocks for data shared between CPUs.
+ *
+ * xchg is a full barrier on x86, and the release is a plain store after
+ * a compiler barrier, which TSO keeps ordered behind the critical
+ * section. Locks that an IRQ handler also takes must be held with
+ * interrupts off (spin_lock_irqsave), or the handler can spin on its own
+ * CPU's lock forever.
+ */
+
+typedef struct spinlock {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(spinlock_t* l)
+{
+    uint32_t v;
+    for (;;) {
+        v = 1;
+        __asm__ __volatile__("xchg %0, %1" : "+r"(v), "+m"(l->locked) : : "memory");
+        if (v == 0) {
+            return;
+        }
+        while (l->locked) {
+            __asm__ __volatile__("pause");
+        }
+    }
+}
+
+static inline void spin_unlock(spinlock_t* l)
+{
+    __asm__ __volatile__("" ::: "memory");
+    l->locked = 0;
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* l)
+{
+    uint32_t flags = irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* l, uint32_t flags)
+{
+    spin_unlock(l);
+    irq_restore(flags);
+}
+
+#endif /* ENIXNEL_SPINLOCK_H */
@@ -0,0 +1,28 @@
+#ifndef ENIXNEL_STRING_H
+#define ENIXNEL_STRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Freestanding memory and string routines (implemented in kernel/string.c).
+ *
+ * These use the standard names and semantics: GCC emits calls to memcpy,
+ * memmove, memset and memcmp on its own (struct copies, large
+ * initialisers), so the kernel has to provide them.
+ *
+ * Large copies and fills use SSE2 when boot.S found and enabled it.
+ */
+
+void*  memcpy(void* dst, const void* src, size_t n);
+void*  memmove(void* dst, const void* src, size_t n);
+void*  memset(void* dst, int c, size_t n);
+int    memcmp(const void* a, const void* b, size_t n);
+
+size_t strlen(const char* s);
+int    strcmp(const char* a, const char* b);
+
+/* Nonzero once boot.S has enabled SSE (CR4.OSFXSR); set before kernel_main. */
+extern uint32_t cpu_has_sse2;
+
+#endif /* ENIXNEL_STRING_H */
@@ -0,0 +1,31 @@
+#ifndef ENIXNEL_TIMER_H
+#define ENIXNEL_TIMER_H
+
+#include <stdint.h>
+
+/*
+ * Timekeeping (implemented in kernel/timer.c).
+ *
+ * The TSC is the clock: timer_init() measures its rate once against the
+ * 8254 PIT. PIT channel 0 also raises IRQ 0 at TIMER_HZ as a coarse tick
+ * for anything that wants periodic work. Requires idt_init() first.
+ */
+
+#define TIMER_HZ   100
+#define IRQ_TIMER  0
+
+void     timer_init(void);
+
+uint32_t timer_tsc_khz(void);       /* 0 until timer_init() */
+uint64_t timer_ticks(void);         /* IRQ 0 ticks since timer_init() */
+uint64_t timer_cycles_to_ns(uint64_t cycles);
+void     timer_udelay(uint32_t us);     /* busy-wait on the TSC */
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif /* ENIXNEL_TIMER_H */
@@ -0,0 +1,109 @@
+#ifndef ENIXNEL_TRACE_H
+#define ENIXNEL_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Static tracepoints (implemented in kernel/trace.c).
+ *
+ * TRACE_POINT(id, a0, a1) records one event: the TSC, the event id, a
+ * 16-bit and a 32-bit argument. TRACE_BEGIN/TRACE_END bracket a span, and
+ * TRACE_SCOPE(id, a0, a1) at the top of a function records BEGIN there
+ * and END at whichever return leaves it, like KSTAT_SCOPE. Events go to
+ * a ring per CPU that keeps the newest TRACE_RING_EVENTS and overwrites
+ * older ones; writers claim slots with one locked xadd and never wait.
+ *
+ * Sites cost one load and a branch not taken while tracing is stopped.
+ * Built with TRACE=0 (no ENIXNEL_TRACE), the macros expand to nothing and
+ * the rings do not exist.
+ *
+ * trace_dump() sends the rings over COM1, little-endian, untranslated:
+ *
+ *   "ENXTRACE" u16 version  u16 event size  u32 TSC kHz  u32 CPUs  u32 names
+ *   names times:  u8 length, the name (event id = position in the list)
+ *   CPUs times:   u32 cpu  u32 events  u32 lost, then the events, oldest
+ *                 first: u64 tsc  u8 id  u8 phase  u16 a0  u32 a1
+ *
+ * tools/trace.py finds the header in a capture of the serial line and
+ * turns it into a timeline.
+ */
+
+/* Tracepoints: X(id, name). New ones go at the end; ids are positions. */
+#define TRACE_LIST(X)                           \
+    X(FS_FIND_INDEX,  "fs_find_index")          \
+    X(FS_ALLOC_ENTRY, "fs_alloc_entry")         \
+    X(FS_WRITE_FILE,  "fs_write_file")          \
+    X(CONSOLE_SCROLL, "console_scroll")         \
+    X(KBD_IRQ,        "kbd_irq")                \
+    X(SCHED_SWITCH,   "sched_switch")
+
+enum {
+#define TRACE_ENUM(id, name) TRACE_##id,
+    TRACE_LIST(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACE_COUNT
+};
+
+#define TRACE_PHASE_POINT 0
+#define TRACE_PHASE_BEGIN 1
+#define TRACE_PHASE_END   2
+
+#define TRACE_VERSION     1
+#define TRACE_RING_ORDER  3     /* pages per CPU: 32 KiB, 2048 events */
+
+typedef struct trace_event {
+    uint64_t tsc;
+    uint8_t  id;
+    uint8_t  phase;
+    uint16_t a0;
+    uint32_t a1;
+} trace_event_t;
+
+#ifdef ENIXNEL_TRACE
+
+extern volatile uint32_t trace_on;
+
+/* Start empties the rings, allocating them the first time (<0 when out
+ * of memory); dump stops tracing and returns the events sent, or <0
+ * without a serial port.
+ */
+int  trace_start(void);
+void trace_stop(void);
+int  trace_dump(void);
+
+void trace_record(uint32_t id, uint32_t phase, uint32_t a0, uint32_t a1);
+
+static inline void trace_event(uint32_t id, uint32_t phase, uint32_t a0, uint32_t a1)
+{
+    if (__builtin_expect(trace_on, 0)) {
+        trace_record(id, phase, a0, a1);
+    }
+}
+
+struct trace_scope {
+    uint32_t id;
+};
+
+static inline void trace_scope_end(struct trace_scope* s)
+{
+    trace_event(s->id, TRACE_PHASE_END, 0, 0);
+}
+
+#define TRACE_POINT(id, a0, a1) trace_event(TRACE_##id, TRACE_PHASE_POINT, (a0), (a1))
+#define TRACE_BEGIN(id, a0, a1) trace_event(TRACE_##id, TRACE_PHASE_BEGIN, (a0), (a1))
+#define TRACE_END(id, a0, a1)   trace_event(TRACE_##id, TRACE_PHASE_END, (a0), (a1))
+
+#define TRACE_SCOPE(id, a0, a1)                                             \
+    struct trace_scope trace_scope_ __attribute__((cleanup(trace_scope_end))) \
+        = { (TRACE_BEGIN(id, a0, a1), TRACE_##id) }
+
+#else
+
+#define TRACE_POINT(id, a0, a1) do { } while (0)
+#define TRACE_BEGIN(id, a0, a1) do { } while (0)
+#define TRACE_END(id, a0, a1)   do { } while (0)
+#define TRACE_SCOPE(id, a0, a1) do { } while (0)
+
+#endif /* ENIXNEL_TRACE */
+
+#endif /* ENIXNEL_TRACE_H */
@@ -0,0 +1,326 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "ata.h"
+#include "io.h"
+#include "timer.h"
+
+/*
+ * ATA driver for the primary master drive.
+ *
+ * The drive runs with nIEN set and every command is polled: PIO moves one
+ * sector per DRQ through the data port, DMA hands the PIIX-style bus
+ * master a PRD table (one entry per page) and waits for it to go idle.
+ * The bus master is found by scanning PCI bus 0 for an IDE controller in
+ * compatibility mode whose BAR4 is an I/O range.
+ *
+ * The driver is not reentrant; its callers serialise (the block cache is
+ * only used under fs_mutex).
+ */
+
+#define ATA_BASE        0x1F0
+#define ATA_DATA        (ATA_BASE + 0)
+#define ATA_ERROR       (ATA_BASE + 1)
+#define ATA_COUNT       (ATA_BASE + 2)
+#define ATA_LBA0        (ATA_BASE + 3)
+#define ATA_LBA1        (ATA_BASE + 4)
+#define ATA_LBA2        (ATA_BASE + 5)
+#define ATA_DRIVE       (ATA_BASE + 6)
+#define ATA_STATUS      (ATA_BASE + 7)
+#define ATA_COMMAND     (ATA_BASE + 7)
+#define ATA_CTRL        0x3F6           /* alternate status / device control */
+
+#define ATA_SR_BSY      0x80
+#define ATA_SR_DF       0x20
+#define ATA_SR_DRQ      0x08
+#define ATA_SR_ERR      0x01
+#define ATA_CTRL_NIEN   0x02
+
+#define ATA_DRIVE_LBA   0xE0            /* master, LBA addressing */
+
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_WRITE_DMA   0xCA
+#define ATA_CMD_FLUSH       0xE7
+#define ATA_CMD_IDENTIFY    0xEC
+
+#define ATA_ID_CAPS         49          /* IDENTIFY words */
+#define ATA_ID_LBA28        60
+#define ATA_CAP_DMA         (1u << 8)
+#define ATA_CAP_LBA         (1u << 9)
+
+#define ATA_TIMEOUT_US      2000000     /* per sector or DMA transfer */
+
+/* Bus master registers, relative to BAR4. */
+#define BM_COMMAND      0
+#define BM_STATUS       2
+#define BM_PRDT         4
+#define BM_CMD_START    0x01
+#define BM_CMD_TO_MEM   0x08            /* device to memory (a read) */
+#define BM_SR_ACTIVE    0x01
+#define BM_SR_ERR       0x02
+#define BM_SR_IRQ       0x04
+#define BM_PRD_LAST     0x8000
+
+#define PCI_CONFIG_ADDR 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_COMMAND     0x04
+#define PCI_CLASS       0x08
+#define PCI_BAR4        0x20
+#define PCI_CMD_IO      0x0001
+#define PCI_CMD_MASTER  0x0004
+#define PCI_CLASS_IDE   0x0101          /* mass storage, IDE */
+#define PCI_IDE_NATIVE  0x01            /* prog IF: primary in native mode */
+#define PCI_IDE_MASTER  0x80            /* prog IF: bus master capable */
+
+typedef struct ata_prd {
+    uint32_t addr;
+    uint16_t bytes;             /* 0 means 64 KiB */
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+/* Aligned to its own size, so it never crosses a 64 KiB boundary. */
+static ata_prd_t ata_prdt[ATA_MAX_PAGES] __attribute__((aligned(sizeof(ata_prd_t) * ATA_MAX_PAGES)));
+
+static int      ata_ok = 0;
+static uint16_t ata_bm = 0;             /* bus master I/O base, 0 = PIO only */
+static uint32_t ata_size = 0;
+
+/* ---------- PCI configuration space ---------- */
+
+static uint32_t pci_read32(uint32_t dev, uint8_t reg)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000u | dev | (reg & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_write32(uint32_t dev, uint8_t reg, uint32_t v)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000u | dev | (reg & 0xFC));
+    outl(PCI_CONFIG_DATA, v);
+}
+
+/* Bus master base of the first compatibility-mode IDE controller, or 0. */
+static uint16_t ata_find_bus_master(void)
+{
+    for (uint32_t slot = 0; slot < 32 * 8; ++slot) {
+        uint32_t dev = slot << 8;       /* bus 0, device:function */
+        uint32_t cls = pci_read32(dev, PCI_CLASS);
+        if (cls == 0xFFFFFFFFu || (cls >> 16) != PCI_CLASS_IDE) {
+            continue;
+        }
+        uint8_t prog_if = (uint8_t)(cls >> 8);
+        uint32_t bar4 = pci_read32(dev, PCI_BAR4);
+        if ((prog_if & PCI_IDE_NATIVE) || !(prog_if & PCI_IDE_MASTER) ||
+            !(bar4 & 1) || (bar4 & ~3u) == 0) {
+            continue;   /* not one we can drive; a later one may be */
+        }
+        pci_write32(dev, PCI_COMMAND,
+                    pci_read32(dev, PCI_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+        return (uint16_t)(bar4 & ~3u);
+    }
+    return 0;
+}
+
+/* ---------- Status polling ---------- */
+
+/* 400 ns for the status register to settle after a drive select. */
+static void ata_delay(void)
+{
+    for (int i = 0; i < 4; ++i) {
+        (void)inb(ATA_CTRL);
+    }
+}
+
+/* Wait for BSY to clear, and for DRQ too when want_drq is set.
+ * Returns 0 when ready, <0 on ERR/DF or timeout.
+ */
+static int ata_wait(int want_drq)
+{
+    for (uint32_t waited = 0; waited < ATA_TIMEOUT_US; ++waited) {
+        uint8_t st = inb(ATA_CTRL);
+        if (!(st & ATA_SR_BSY)) {
+            if (st & (ATA_SR_ERR | ATA_SR_DF)) {
+                return -1;
+            }
+            if (!want_drq || (st & ATA_SR_DRQ)) {
+                return 0;
+            }
+        }
+        timer_udelay(1);
+    }
+    return -1;
+}
+
+static void ata_select(uint32_t lba, uint32_t sectors)
+{
+    outb(ATA_DRIVE, (uint8_t)(ATA_DRIVE_LBA | ((lba >> 24) & 0x0F)));
+    ata_delay();
+    outb(ATA_COUNT, (uint8_t)sectors);  /* 256 is sent as 0 */
+    outb(ATA_LBA0, (uint8_t)lba);
+    outb(ATA_LBA1, (uint8_t)(lba >> 8));
+    outb(ATA_LBA2, (uint8_t)(lba >> 16));
+}
+
+/* ---------- Transfers ---------- */
+
+static int ata_pio(uint32_t lba, void* const* pages, uint32_t count, int write)
+{
+    uint32_t sectors = count * ATA_PAGE_SECTORS;
+    if (ata_wait(0) != 0) {
+        return -1;
+    }
+    ata_select(lba, sectors);
+    outb(ATA_COMMAND, write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO);
+
+    for (uint32_t s = 0; s < sectors; ++s) {
+        uint8_t* buf = (uint8_t*)pages[s / ATA_PAGE_SECTORS] +
+                       (s % ATA_PAGE_SECTORS) * ATA_SECTOR_SIZE;
+        ata_delay();
+        if (ata_wait(1) != 0) {
+            return -1;
+        }
+        if (write) {
+            outsw(ATA_DATA, buf, ATA_SECTOR_SIZE / 2);
+        } else {
+            insw(ATA_DATA, buf, ATA_SECTOR_SIZE / 2);
+        }
+    }
+    ata_delay();
+    return ata_wait(0);
+}
+
+static int ata_dma_transfer(uint32_t lba, void* const* pages, uint32_t count, int write)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        ata_prdt[i].addr = (uint32_t)pages[i];
+        ata_prdt[i].bytes = ATA_PAGE_SECTORS * ATA_SECTOR_SIZE;
+        ata_prdt[i].flags = (i + 1 == count) ? BM_PRD_LAST : 0;
+    }
+    if (ata_wait(0) != 0) {
+        return -1;
+    }
+
+    uint8_t dir = write ? 0 : BM_CMD_TO_MEM;
+    outb(ata_bm + BM_COMMAND, dir);
+    outl(ata_bm + BM_PRDT, (uint32_t)ata_prdt);
+    outb(ata_bm + BM_STATUS, BM_SR_ERR | BM_SR_IRQ);   /* write 1 to clear */
+
+    ata_select(lba, count * ATA_PAGE_SECTORS);
+    outb(ATA_COMMAND, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+    __asm__ __volatile__("" ::: "memory");
+    outb(ata_bm + BM_COMMAND, dir | BM_CMD_START);
+
+    int rc = -1;
+    for (uint32_t waited = 0; waited < ATA_TIMEOUT_US; ++waited) {
+        uint8_t bst = inb(ata_bm + BM_STATUS);
+        if (bst & BM_SR_ERR) {
+            break;
+        }
+        if (!(bst & BM_SR_ACTIVE) && !(inb(ATA_CTRL) & ATA_SR_BSY)) {
+            rc = 0;
+            break;
+        }
+        timer_udelay(1);
+    }
+
+    outb(ata_bm + BM_COMMAND, dir);                     /* stop the engine */
+    outb(ata_bm + BM_STATUS, BM_SR_ERR | BM_SR_IRQ);
+    if (inb(ATA_STATUS) & (ATA_SR_ERR | ATA_SR_DF)) {   /* also acks the drive */
+        rc = -1;
+    }
+    return rc;
+}
+
+static int ata_transfer(uint32_t lba, void* const* pages, uint32_t count, int write)
+{
+    if (!ata_ok || count == 0 || count > ATA_MAX_PAGES ||
+        lba + count * ATA_PAGE_SECTORS > ata_size) {
+        return -1;
+    }
+    if (ata_bm) {
+        return ata_dma_transfer(lba, pages, count, write);
+    }
+    return ata_pio(lba, pages, count, write);
+}
+
+int ata_read_pages(uint32_t lba, void* const* pages, uint32_t count)
+{
+    return ata_transfer(lba, pages, count, 0);
+}
+
+int ata_write_pages(uint32_t lba, void* const* pages, uint32_t count)
+{
+    return ata_transfer(lba, pages, count, 1);
+}
+
+int ata_flush(void)
+{
+    if (!ata_ok || ata_wait(0) != 0) {
+        return -1;
+    }
+    outb(ATA_DRIVE, ATA_DRIVE_LBA);
+    ata_delay();
+    outb(ATA_COMMAND, ATA_CMD_FLUSH);
+    ata_delay();
+    return ata_wait(0);
+}
+
+/* ---------- Probe ---------- */
+
+int ata_init(void)
+{
+    outb(ATA_CTRL, ATA_CTRL_NIEN);
+    outb(ATA_DRIVE, 0xA0);              /* master, CHS form for IDENTIFY */
+    ata_delay();
+    if (inb(ATA_STATUS) == 0xFF) {
+        return -1;                      /* floating bus: no controller */
+    }
+
+    outb(ATA_COUNT, 0);
+    outb(ATA_LBA0, 0);
+    outb(ATA_LBA1, 0);
+    outb(ATA_LBA2, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+    if (inb(ATA_STATUS) == 0) {
+        return -1;                      /* no drive */
+    }
+    if (ata_wait(0) != 0 || inb(ATA_LBA1) != 0 || inb(ATA_LBA2) != 0) {
+        return -1;                      /* error, or an ATAPI device */
+    }
+    if (ata_wait(1) != 0) {
+        return -1;
+    }
+
+    uint16_t id[256];
+    insw(ATA_DATA, id, 256);
+    if (!(id[ATA_ID_CAPS] & ATA_CAP_LBA)) {
+        return -1;
+    }
+    ata_size = id[ATA_ID_LBA28] | ((uint32_t)id[ATA_ID_LBA28 + 1] << 16);
+    if (ata_size == 0) {
+        return -1;
+    }
+
+    if (id[ATA_ID_CAPS] & ATA_CAP_DMA) {
+        ata_bm = ata_find_bus_master();
+    }
+    ata_ok = 1;
+    return 0;
+}
+
+int ata_present(void)
+{
+    return ata_ok;
+}
+
+int ata_dma(void)
+{
+    return ata_bm != 0;
+}
+
+uint32_t ata_sectors(void)
+{
+    return ata_size;
+}
@@ -0,0 +1,384 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "bcache.h"
+#include "ata.h"
+#include "pmm.h"
+#include "string.h"
+
+/*
+ * Block cache for Enixnel.
+ *
+ * Every buffer owns one page and sits on the LRU list; buffers holding a
+ * block are also chained in bcache_hash[] by block number. Sequential
+ * block numbers land in consecutive hash slots, so a run of blocks never
+ * piles onto one chain.
+ *
+ * A cache block is exactly one ATA page, so a run of neighbouring blocks
+ * is one ata_read_pages()/ata_write_pages() call over their buffers.
+ *
+ * The first BCACHE_BUFFERS buffers get their pages at init. The slots
+ * after them hold borrowed buffers, taken only when nothing else can be
+ * claimed; an unused slot has no page.
+ */
+
+#define BCACHE_HASH_SLOTS 128
+#define BCACHE_NONE       0xFFFFFFFFu      /* buffer holds no block */
+
+static bcache_buf_t   bcache_bufs[BCACHE_MAX_BUFFERS];
+static uint32_t       bcache_borrowed = 0;
+static bcache_buf_t*  bcache_hash[BCACHE_HASH_SLOTS];
+static bcache_buf_t*  bcache_lru_head = 0;  /* most recently used */
+static bcache_buf_t*  bcache_lru_tail = 0;
+static uint32_t       bcache_blocks = 0;
+static bcache_stats_t bcache_counters;
+
+/* ---------- Hash chains and LRU list ---------- */
+
+static bcache_buf_t** bcache_slot(uint32_t blkno)
+{
+    return &bcache_hash[blkno & (BCACHE_HASH_SLOTS - 1)];
+}
+
+static bcache_buf_t* bcache_lookup(uint32_t blkno)
+{
+    for (bcache_buf_t* b = *bcache_slot(blkno); b; b = b->hash_next) {
+        if (b->blkno == blkno) {
+            return b;
+        }
+    }
+    return 0;
+}
+
+static void bcache_hash_remove(bcache_buf_t* b)
+{
+    bcache_buf_t** link = bcache_slot(b->blkno);
+    while (*link != b) {
+        link = &(*link)->hash_next;
+    }
+    *link = b->hash_next;
+    b->hash_next = 0;
+    b->blkno = BCACHE_NONE;
+    b->flags = 0;
+}
+
+static void bcache_lru_remove(bcache_buf_t* b)
+{
+    if (b->lru_prev) {
+        b->lru_prev->lru_next = b->lru_next;
+    } else {
+        bcache_lru_head = b->lru_next;
+    }
+    if (b->lru_next) {
+        b->lru_next->lru_prev = b->lru_prev;
+    } else {
+        bcache_lru_tail = b->lru_prev;
+    }
+}
+
+static void bcache_lru_push(bcache_buf_t* b)
+{
+    b->lru_prev = 0;
+    b->lru_next = bcache_lru_head;
+    if (bcache_lru_head) {
+        bcache_lru_head->lru_prev = b;
+    } else {
+        bcache_lru_tail = b;
+    }
+    bcache_lru_head = b;
+}
+
+static void bcache_touch(bcache_buf_t* b)
+{
+    bcache_lru_remove(b);
+    bcache_lru_push(b);
+}
+
+/* ---------- Disk I/O ---------- */
+
+/* Write n buffers holding consecutive blocks as one request. */
+static int bcache_write_run(bcache_buf_t* const* run, uint32_t n)
+{
+    void* pages[ATA_MAX_PAGES];
+    for (uint32_t i = 0; i < n; ++i) {
+        pages[i] = run[i]->data;
+    }
+    ++bcache_counters.write_requests;
+    if (ata_write_pages(run[0]->blkno * ATA_PAGE_SECTORS, pages, n) != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        run[i]->flags &= (uint16_t)~BCACHE_DIRTY;
+    }
+    bcache_counters.blocks_written += n;
+    return 0;
+}
+
+/* A new buffer in a free borrowed slot, or 0 when out of slots or pages. */
+static bcache_buf_t* bcache_borrow(void)
+{
+    for (int i = BCACHE_BUFFERS; i < BCACHE_MAX_BUFFERS; ++i) {
+        bcache_buf_t* b = &bcache_bufs[i];
+        if (b->data) {
+            continue;
+        }
+        b->data = (uint8_t*)pmm_alloc_pages(0);
+        if (!b->data) {
+            return 0;
+        }
+        b->blkno = BCACHE_NONE;
+        b->flags = 0;
+        b->pins = 0;
+        b->hash_next = 0;
+        bcache_lru_push(b);
+        ++bcache_borrowed;
+        return b;
+    }
+    return 0;
+}
+
+/*
+ * Take the least recently used unpinned buffer for blkno (which must not
+ * be cached), writing it back first if dirty. With borrow set, a buffer
+ * is borrowed when all are pinned or pending. Returns 0 if there is none.
+ */
+static bcache_buf_t* bcache_claim(uint32_t blkno, int borrow)
+{
+    bcache_buf_t* b = bcache_lru_tail;
+    for (; b; b = b->lru_prev) {
+        if (b->pins || (b->flags & BCACHE_PENDING)) {
+            continue;
+        }
+        if ((b->flags & BCACHE_DIRTY) && bcache_write_run(&b, 1) != 0) {
+            continue;
+        }
+        break;
+    }
+    if (!b && (!borrow || !(b = bcache_borrow()))) {
+        return 0;
+    }
+
+    if (b->blkno != BCACHE_NONE) {
+        bcache_hash_remove(b);
+    }
+    b->blkno = blkno;
+    b->flags = 0;
+    bcache_buf_t** slot = bcache_slot(blkno);
+    b->hash_next = *slot;
+    *slot = b;
+    bcache_touch(b);
+    return b;
+}
+
+/* ---------- Public API ---------- */
+
+int bcache_init(uint32_t block_count)
+{
+    for (int i = 0; i < BCACHE_BUFFERS; ++i) {
+        bcache_buf_t* b = &bcache_bufs[i];
+        b->data = (uint8_t*)pmm_alloc_pages(0);
+        if (!b->data) {
+            while (i-- > 0) {
+                pmm_free_pages(bcache_bufs[i].data, 0);
+            }
+            bcache_lru_head = bcache_lru_tail = 0;
+            return -1;
+        }
+        b->blkno = BCACHE_NONE;
+        b->flags = 0;
+        b->pins = 0;
+        b->hash_next = 0;
+        bcache_lru_push(b);
+    }
+    bcache_blocks = block_count;
+    return 0;
+}
+
+uint32_t bcache_block_count(void)
+{
+    return bcache_blocks;
+}
+
+bcache_buf_t* bcache_read(uint32_t blkno)
+{
+    if (blkno >= bcache_blocks) {
+        return 0;
+    }
+
+    bcache_buf_t* b = bcache_lookup(blkno);
+    if (b) {
+        ++bcache_counters.hits;
+        ++b->pins;
+        bcache_touch(b);
+        return b;
+    }
+    ++bcache_counters.misses;
+
+    /* The block itself, then as many uncached successors as fit. Each is
+     * pinned while the run is assembled so claiming the next one cannot
+     * take it back. */
+    bcache_buf_t* run[BCACHE_READAHEAD];
+    uint32_t n = 0;
+    while (n < BCACHE_READAHEAD && blkno + n < bcache_blocks) {
+        if (n > 0 && bcache_lookup(blkno + n)) {
+            break;
+        }
+        bcache_buf_t* r = bcache_claim(blkno + n, n == 0);
+        if (!r) {
+            break;
+        }
+        r->pins = 1;
+        run[n++] = r;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    void* pages[BCACHE_READAHEAD];
+    for (uint32_t i = 0; i < n; ++i) {
+        pages[i] = run[i]->data;
+    }
+    ++bcache_counters.read_requests;
+    int rc = ata_read_pages(blkno * ATA_PAGE_SECTORS, pages, n);
+
+    /* The requested block ends up most recently used. */
+    for (uint32_t i = n; i-- > 0;) {
+        run[i]->pins = 0;
+        if (rc == 0) {
+            run[i]->flags = BCACHE_VALID;
+            bcache_touch(run[i]);
+        } else {
+            bcache_hash_remove(run[i]);
+        }
+    }
+    if (rc != 0) {
+        return 0;
+    }
+    bcache_counters.readahead += n - 1;
+    b = run[0];
+    b->pins = 1;
+    return b;
+}
+
+bcache_buf_t* bcache_get_zero(uint32_t blkno)
+{
+    if (blkno >= bcache_blocks) {
+        return 0;
+    }
+    bcache_buf_t* b = bcache_lookup(blkno);
+    if (b) {
+        bcache_touch(b);
+    } else if (!(b = bcache_claim(blkno, 1))) {
+        return 0;
+    }
+    memset(b->data, 0, BCACHE_BLOCK_SIZE);
+    b->flags |= BCACHE_VALID;
+    ++b->pins;
+    return b;
+}
+
+void bcache_release(bcache_buf_t* b)
+{
+    if (b && b->pins) {
+        --b->pins;
+    }
+}
+
+/*
+ * Buffers whose flags under mask equal want, in block order, at most max
+ * (insertion sort: a few hundred at most, and usually nearly sorted).
+ */
+static uint32_t bcache_collect(bcache_buf_t** out, uint32_t max, uint16_t mask, uint16_t want)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < BCACHE_MAX_BUFFERS && n < max; ++i) {
+        bcache_buf_t* b = &bcache_bufs[i];
+        if ((b->flags & mask) != want) {
+            continue;
+        }
+        uint32_t j = n++;
+        while (j > 0 && out[j - 1]->blkno > b->blkno) {
+            out[j] = out[j - 1];
+            --j;
+        }
+        out[j] = b;
+    }
+    return n;
+}
+
+uint32_t bcache_pending(bcache_buf_t** out, uint32_t max)
+{
+    return bcache_collect(out, max, BCACHE_PENDING | BCACHE_LOGGED, BCACHE_PENDING);
+}
+
+uint32_t bcache_pending_count(void)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < BCACHE_MAX_BUFFERS; ++i) {
+        n += (bcache_bufs[i].flags & BCACHE_PENDING) != 0;
+    }
+    return n;
+}
+
+void bcache_log_done(int committed)
+{
+    uint16_t clear = committed ? BCACHE_LOGGED | BCACHE_PENDING : BCACHE_LOGGED;
+    for (int i = 0; i < BCACHE_MAX_BUFFERS; ++i) {
+        bcache_buf_t* b = &bcache_bufs[i];
+        if (b->flags & BCACHE_LOGGED) {
+            b->flags &= (uint16_t)~clear;
+        }
+    }
+}
+
+int bcache_sync(void)
+{
+    /* A batch at a time: with borrowed buffers there can be more than one. */
+    bcache_buf_t* dirty[BCACHE_BUFFERS];
+    int rc = 0;
+    uint32_t n;
+    while (rc == 0 && (n = bcache_collect(dirty, BCACHE_BUFFERS,
+                                          BCACHE_DIRTY | BCACHE_PENDING, BCACHE_DIRTY)) > 0) {
+        for (uint32_t start = 0; start < n;) {
+            uint32_t len = 1;
+            while (start + len < n && len < ATA_MAX_PAGES &&
+                   dirty[start + len]->blkno == dirty[start]->blkno + len) {
+                ++len;
+            }
+            if (bcache_write_run(&dirty[start], len) != 0) {
+                rc = -1;    /* stays dirty; stop rather than retry it */
+            }
+            start += len;
+        }
+        if (ata_flush() != 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+int bcache_trim(void)
+{
+    if (bcache_borrowed == 0) {
+        return 0;
+    }
+    int rc = bcache_sync();
+    for (int i = BCACHE_BUFFERS; i < BCACHE_MAX_BUFFERS; ++i) {
+        bcache_buf_t* b = &bcache_bufs[i];
+        if (!b->data || b->pins || (b->flags & (BCACHE_DIRTY | BCACHE_PENDING))) {
+            continue;
+        }
+        if (b->blkno != BCACHE_NONE) {
+            bcache_hash_remove(b);
+        }
+        bcache_lru_remove(b);
+        pmm_free_pages(b->data, 0);
+        b->data = 0;
+        --bcache_borrowed;
+    }
+    return rc;
+}
+
+void bcache_get_stats(bcache_stats_t* out)
+{
+    *out = bcache_counters;
+}
@@ -0,0 +1,309 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "bench.h"
+#include "console.h"
+#include "fs.h"
+#include "idt.h"
+#include "string.h"
+#include "timer.h"
+
+/*
+ * Microbenchmarks behind the "bench" command.
+ *
+ * Every sample times exactly one operation with interrupts disabled, so
+ * timer and keyboard IRQs do not land in the measurement. Inputs come
+ * from a fixed-seed LCG and the scratch tree is rebuilt from scratch
+ * each run, so repeated runs of the same build do the same work.
+ *
+ * Results are collected first and printed at the end: the sdir and
+ * console benchmarks scribble over the screen, which is cleared before
+ * the report.
+ */
+
+#define BENCH_SAMPLES   256
+#define BENCH_RESULTS   16
+#define BENCH_DIR       "benchtmp"
+#define BENCH_PATH_MAX  48
+
+typedef struct bench_result {
+    const char* name;
+    uint32_t    min;
+    uint32_t    median;
+    uint32_t    p99;
+} bench_result_t;
+
+static uint32_t       bench_samples[BENCH_SAMPLES];
+static bench_result_t bench_results[BENCH_RESULTS];
+static int            bench_result_count;
+static uint32_t       bench_seed;
+
+static uint32_t bench_rand(void)
+{
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return bench_seed >> 8;
+}
+
+/* "benchtmp/<prefix><n>" */
+static void bench_path(char* out, const char* prefix, uint32_t n)
+{
+    char digits[10];
+    size_t nd = 0;
+    do {
+        digits[nd++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+
+    size_t pos = sizeof(BENCH_DIR) - 1;
+    memcpy(out, BENCH_DIR "/", pos + 1);
+    ++pos;
+    size_t plen = strlen(prefix);
+    memcpy(out + pos, prefix, plen);
+    pos += plen;
+    while (nd) {
+        out[pos++] = digits[--nd];
+    }
+    out[pos] = '\0';
+}
+
+/* ---------- Sample collection ---------- */
+
+#define BENCH_TIME(i, ...)                                 \
+    do {                                                    \
+        uint32_t flags_ = irq_save();                       \
+        uint64_t t0_ = rdtsc();                             \
+        __VA_ARGS__;                                        \
+        bench_samples[i] = (uint32_t)(rdtsc() - t0_);       \
+        irq_restore(flags_);                                \
+    } while (0)
+
+static void bench_record(const char* name, int n)
+{
+    /* Insertion sort: n is small and this runs outside the timed part. */
+    for (int i = 1; i < n; ++i) {
+        uint32_t v = bench_samples[i];
+        int j = i;
+        while (j > 0 && bench_samples[j - 1] > v) {
+            bench_samples[j] = bench_samples[j - 1];
+            --j;
+        }
+        bench_samples[j] = v;
+    }
+
+    if (bench_result_count < BENCH_RESULTS && n > 0) {
+        bench_result_t* r = &bench_results[bench_result_count++];
+        r->name = name;
+        r->min = bench_samples[0];
+        r->median = bench_samples[n / 2];
+        r->p99 = bench_samples[(n * 99) / 100];
+    }
+}
+
+static void bench_scratch_reset(void)
+{
+    fs_delete_dir(BENCH_DIR);
+    fs_create_dir(BENCH_DIR);
+}
+
+/* Fill the scratch dir with files f0..f(count-1). */
+static void bench_fill(uint32_t count)
+{
+    char path[BENCH_PATH_MAX];
+    for (uint32_t i = 0; i < count; ++i) {
+        bench_path(path, "f", i);
+        fs_create_file(path);
+    }
+}
+
+/* ---------- fs benchmarks ---------- */
+
+static void bench_fs_create(void)
+{
+    char path[BENCH_PATH_MAX];
+    bench_scratch_reset();
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        bench_path(path, "c", (uint32_t)i);
+        BENCH_TIME(i, fs_create_file(path));
+    }
+    bench_record("fs_create_file", BENCH_SAMPLES);
+}
+
+static void bench_fs_find(const char* name, uint32_t fill)
+{
+    char path[BENCH_PATH_MAX];
+    bench_scratch_reset();
+    bench_fill(fill);
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        bench_path(path, "f", bench_rand() % fill);
+        BENCH_TIME(i, fs_find_index(path));
+    }
+    bench_record(name, BENCH_SAMPLES);
+}
+
+static void bench_fs_write(void)
+{
+    static char data[1024];
+    const char* file = BENCH_DIR "/w";
+
+    memset(data, 'x', sizeof(data));
+    bench_scratch_reset();
+
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        BENCH_TIME(i, fs_write_file(file, data, 64, 1));
+    }
+    bench_record("fs_write_file append 64", BENCH_SAMPLES);
+
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        BENCH_TIME(i, fs_write_file(file, data, sizeof(data), 0));
+    }
+    bench_record("fs_write_file over 1K", BENCH_SAMPLES);
+}
+
+static void bench_fs_delete(void)
+{
+    char path[BENCH_PATH_MAX];
+
+    bench_scratch_reset();
+    bench_fill(BENCH_SAMPLES);
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        bench_path(path, "f", (uint32_t)i);
+        BENCH_TIME(i, fs_delete_file(path));
+    }
+    bench_record("fs_delete_file", BENCH_SAMPLES);
+
+    /* Directories holding 8 files each. */
+    const int dirs = BENCH_SAMPLES / 4;
+    for (int i = 0; i < dirs; ++i) {
+        bench_path(path, "d", (uint32_t)i);
+        fs_create_dir(path);
+        size_t len = strlen(path);
+        for (int k = 0; k < 8; ++k) {
+            path[len] = '/';
+            path[len + 1] = (char)('0' + k);
+            path[len + 2] = '\0';
+            fs_create_file(path);
+            path[len] = '\0';
+        }
+    }
+    for (int i = 0; i < dirs; ++i) {
+        bench_path(path, "d", (uint32_t)i);
+        BENCH_TIME(i, fs_delete_dir(path));
+    }
+    bench_record("fs_delete_dir (8 files)", dirs);
+}
+
+static void bench_group_fs(void)
+{
+    bench_fs_create();
+    bench_fs_find("fs_find_index fill 16", 16);
+    bench_fs_find("fs_find_index fill 256", 256);
+    bench_fs_find("fs_find_index fill 2048", 2048);
+    bench_fs_write();
+    bench_fs_delete();
+}
+
+/* ---------- Output benchmarks ---------- */
+
+static void bench_group_sdir(bench_list_fn list_dir)
+{
+    bench_scratch_reset();
+    bench_fill(16);
+    int dir = fs_find_index(BENCH_DIR);
+    for (int i = 0; i < 64; ++i) {
+        BENCH_TIME(i, list_dir(dir));
+    }
+    bench_record("sdir (16 entries)", 64);
+}
+
+static void bench_group_console(void)
+{
+    char line[80];
+    for (int i = 0; i < 79; ++i) {
+        line[i] = (char)('a' + i % 26);
+    }
+    line[79] = '\0';
+
+    /* Fill the screen first so every timed line scrolls. */
+    for (int i = 0; i < 25; ++i) {
+        console_write_line(line);
+    }
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        BENCH_TIME(i, console_write_line(line));
+    }
+    bench_record("console line+scroll", BENCH_SAMPLES);
+
+    for (int i = 0; i < BENCH_SAMPLES; ++i) {
+        BENCH_TIME(i, console_write("abcdefghijklmnop"));
+        if ((i & 3) == 3) {
+            console_putc('\n');
+        }
+    }
+    bench_record("console_write 16 chars", BENCH_SAMPLES);
+}
+
+/* ---------- Report ---------- */
+
+static void bench_write_padded(uint32_t v, int width)
+{
+    uint32_t n = v;
+    int digits = 1;
+    while (n >= 10) {
+        n /= 10;
+        ++digits;
+    }
+    for (; digits < width; ++digits) {
+        console_putc(' ');
+    }
+    console_write_dec(v);
+}
+
+static void bench_report(void)
+{
+    console_write("TSC ");
+    console_write_dec(timer_tsc_khz() / 1000);
+    console_write_line(" MHz; cycles per op:");
+    console_write_line("  benchmark                       min    median       p99");
+
+    for (int i = 0; i < bench_result_count; ++i) {
+        const bench_result_t* r = &bench_results[i];
+        console_write("  ");
+        console_write(r->name);
+        for (size_t pad = strlen(r->name); pad < 26; ++pad) {
+            console_putc(' ');
+        }
+        bench_write_padded(r->min, 9);
+        bench_write_padded(r->median, 10);
+        bench_write_padded(r->p99, 10);
+        console_putc('\n');
+    }
+}
+
+int bench_run(const char* which, bench_list_fn list_dir)
+{
+    int all = which[0] == '\0';
+    int fs = all || strcmp(which, "fs") == 0;
+    int sdir = all || strcmp(which, "sdir") == 0;
+    int con = all || strcmp(which, "console") == 0;
+    if (!fs && !sdir && !con) {
+        return -1;
+    }
+
+    bench_result_count = 0;
+    bench_seed = 12345;
+
+    if (fs) {
+        bench_group_fs();
+    }
+    if (sdir) {
+        bench_group_sdir(list_dir);
+    }
+    if (con) {
+        bench_group_console();
+    }
+    fs_delete_dir(BENCH_DIR);
+
+    if (sdir || con) {
+        console_clear();
+    }
+    bench_report();
+    return 0;
+}
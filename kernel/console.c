@@ -0,0 +1,433 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "console.h"
+#include "keyboard.h"
+#include "serial.h"
+#include "sched.h"
+#include "idt.h"
+#include "math64.h"
+#include "io.h"
+#include "string.h"
+#include "trace.h"
+
+/*
+ * VGA text console for Enixnel.
+ *
+ * All output lands in a RAM shadow of the screen first. The shadow is a
+ * ring of rows: logical row r lives in shadow row (shadow_top + r) % 25,
+ * so scrolling just advances shadow_top and blanks one row. A bitmask
+ * records which logical rows changed since the last flush.
+ *
+ * The VGA text window at 0xB8000 holds 204 rows but shows only 25, from
+ * the CRTC start address on. console_flush() copies dirty rows out with
+ * dword string moves and moves the start address down one row per scroll,
+ * so the hardware scrolls instead of the CPU. Only when the visible window
+ * reaches the end of video memory is the whole screen copied back to the
+ * top, once every 179 lines.
+ *
+ * Output is flushed at every '\n', at the end of each console_write*()
+ * call and before console_read_line() waits for a key.
+ *
+ * Every character also goes to the serial port (serial.h), and input is
+ * taken from whichever of the keyboard and COM1 delivers it first.
+ *
+ * While console_redirect() has set a pipe, output goes to its buffer
+ * instead and neither the shadow nor the serial port sees it.
+ */
+
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
+
+#define VGA_HW_ROWS      204     /* 32 KiB text window / 160 bytes per row */
+#define VGA_CRTC_INDEX   0x3D4
+#define VGA_CRTC_DATA    0x3D5
+#define CRTC_START_HIGH  0x0C
+#define CRTC_START_LOW   0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW  0x0F
+
+#define ROWS_ALL_DIRTY   ((1u << VGA_HEIGHT) - 1)
+
+static volatile uint16_t* const VGA_MEMORY = (uint16_t*)0xB8000;
+
+static uint16_t shadow[VGA_HEIGHT][VGA_WIDTH] __attribute__((aligned(16)));
+static size_t   shadow_top = 0;          /* shadow row holding logical row 0 */
+static uint32_t shadow_dirty = ROWS_ALL_DIRTY;
+static size_t   hw_top = 0;              /* VGA row shown at the top */
+static size_t   hw_top_shown = (size_t)-1;  /* last value sent to the CRTC */
+
+static size_t cursor_row = 0;
+static size_t cursor_col = 0;
+static uint8_t console_color = 0x07; /* light grey on black */
+
+static console_pipe_t* console_sink = 0;
+
+static uint16_t vga_entry(char c, uint8_t color)
+{
+    return (uint16_t)c | ((uint16_t)color << 8);
+}
+
+static uint16_t* shadow_row(size_t row)
+{
+    size_t r = shadow_top + row;
+    if (r >= VGA_HEIGHT) {
+        r -= VGA_HEIGHT;
+    }
+    return shadow[r];
+}
+
+static void shadow_blank_row(uint16_t* row)
+{
+    uint32_t blank = vga_entry(' ', console_color);
+    size_t words = VGA_WIDTH / 2;
+    blank |= blank << 16;
+    __asm__ __volatile__("rep stosl"
+                         : "+D"(row), "+c"(words)
+                         : "a"(blank)
+                         : "memory");
+}
+
+static void crtc_write16(uint8_t high_reg, uint16_t value)
+{
+    outb(VGA_CRTC_INDEX, high_reg);
+    outb(VGA_CRTC_DATA, (uint8_t)(value >> 8));
+    outb(VGA_CRTC_INDEX, (uint8_t)(high_reg + 1));
+    outb(VGA_CRTC_DATA, (uint8_t)value);
+}
+
+void console_flush(void)
+{
+    uint32_t dirty = shadow_dirty;
+    shadow_dirty = 0;
+
+    while (dirty) {
+        size_t row = (size_t)__builtin_ctz(dirty);
+        dirty &= dirty - 1;
+
+        const uint16_t* src = shadow_row(row);
+        volatile uint16_t* dst = VGA_MEMORY + (hw_top + row) * VGA_WIDTH;
+        size_t words = VGA_WIDTH / 2;
+        __asm__ __volatile__("rep movsl"
+                             : "+S"(src), "+D"(dst), "+c"(words)
+                             :
+                             : "memory");
+    }
+
+    if (hw_top != hw_top_shown) {
+        crtc_write16(CRTC_START_HIGH, (uint16_t)(hw_top * VGA_WIDTH));
+        hw_top_shown = hw_top;
+    }
+    crtc_write16(CRTC_CURSOR_HIGH,
+                 (uint16_t)((hw_top + cursor_row) * VGA_WIDTH + cursor_col));
+}
+
+void console_clear(void)
+{
+    for (size_t y = 0; y < VGA_HEIGHT; y++) {
+        shadow_blank_row(shadow[y]);
+    }
+    shadow_top = 0;
+    shadow_dirty = ROWS_ALL_DIRTY;
+    cursor_row = 0;
+    cursor_col = 0;
+    console_flush();
+}
+
+static void console_scroll(void)
+{
+    if (cursor_row < VGA_HEIGHT) {
+        return;
+    }
+
+    /* Old logical row 0 becomes the new, blank bottom row. */
+    shadow_blank_row(shadow_row(0));
+    shadow_top = (shadow_top + 1 == VGA_HEIGHT) ? 0 : shadow_top + 1;
+
+    /* Rows keep their contents on screen, one line higher. */
+    shadow_dirty = (shadow_dirty >> 1) | (1u << (VGA_HEIGHT - 1));
+    if (++hw_top + VGA_HEIGHT > VGA_HW_ROWS) {
+        hw_top = 0;
+        shadow_dirty = ROWS_ALL_DIRTY;
+    }
+
+    cursor_row = VGA_HEIGHT - 1;
+    if (cursor_col >= VGA_WIDTH) {
+        cursor_col = 0;
+    }
+    TRACE_POINT(CONSOLE_SCROLL, hw_top, 0);    /* hw_top 0: full recopy next flush */
+}
+
+console_pipe_t* console_redirect(console_pipe_t* p)
+{
+    console_pipe_t* prev = console_sink;
+    console_sink = p;
+    return prev;
+}
+
+static void console_sink_put(const char* s, size_t len)
+{
+    console_pipe_t* p = console_sink;
+    size_t n = len < p->size - p->len ? len : p->size - p->len;
+    memcpy(p->buf + p->len, s, n);
+    p->len += n;
+    p->dropped += len - n;
+}
+
+void console_putc(char c)
+{
+    if (console_sink) {
+        console_sink_put(&c, 1);
+        return;
+    }
+    serial_putc(c);
+    if (c == '\n') {
+        cursor_col = 0;
+        cursor_row++;
+    } else {
+        shadow_row(cursor_row)[cursor_col] = vga_entry(c, console_color);
+        shadow_dirty |= 1u << cursor_row;
+        cursor_col++;
+        if (cursor_col >= VGA_WIDTH) {
+            cursor_col = 0;
+            cursor_row++;
+        }
+    }
+    if (cursor_row >= VGA_HEIGHT) {
+        console_scroll();
+    }
+    if (c == '\n') {
+        console_flush();
+    }
+}
+
+void console_put_n(const char* s, size_t len)
+{
+    if (console_sink) {
+        console_sink_put(s, len);
+        return;
+    }
+    serial_write(s, len);
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '\n') {
+            cursor_col = 0;
+            cursor_row++;
+        } else {
+            shadow_row(cursor_row)[cursor_col] = vga_entry(s[i], console_color);
+            shadow_dirty |= 1u << cursor_row;
+            if (++cursor_col >= VGA_WIDTH) {
+                cursor_col = 0;
+                cursor_row++;
+            }
+        }
+        if (cursor_row >= VGA_HEIGHT) {
+            console_scroll();   /* the dirty mask follows, no flush needed */
+        }
+    }
+}
+
+static void console_puts(const char* s)
+{
+    while (*s) {
+        console_putc(*s++);
+    }
+}
+
+void console_write(const char* s)
+{
+    console_puts(s);
+    console_flush();
+}
+
+void console_write_line(const char* s)
+{
+    console_puts(s);
+    console_putc('\n');
+}
+
+void console_write_dec(uint32_t v)
+{
+    char buf[11];
+    size_t n = 0;
+    do {
+        buf[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) {
+        console_putc(buf[--n]);
+    }
+    console_flush();
+}
+
+void console_write_dec64(uint64_t v)
+{
+    char buf[20];
+    size_t n = 0;
+    do {
+        uint32_t digit;
+        v = div64_u32_rem(v, 10, &digit);
+        buf[n++] = (char)('0' + digit);
+    } while (v);
+    while (n) {
+        console_putc(buf[--n]);
+    }
+    console_flush();
+}
+
+void console_write_hex(uint32_t v)
+{
+    console_puts("0x");
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        console_putc("0123456789abcdef"[(v >> shift) & 0xF]);
+    }
+    console_flush();
+}
+
+void console_backspace(void)
+{
+    if (cursor_col == 0 && cursor_row == 0) {
+        return;
+    }
+    if (cursor_col > 0) {
+        cursor_col--;
+    } else {
+        cursor_row--;
+        cursor_col = VGA_WIDTH - 1;
+    }
+    shadow_row(cursor_row)[cursor_col] = vga_entry(' ', console_color);
+    shadow_dirty |= 1u << cursor_row;
+
+    serial_putc('\b');
+    serial_putc(' ');
+    serial_putc('\b');
+}
+
+/* Readers blocked in console_read_char(), woken by console_input_ready(). */
+static wait_queue_t console_input_wait = WAIT_QUEUE_INIT;
+
+void console_input_ready(void)
+{
+    wait_queue_wake_all(&console_input_wait);
+}
+
+/* Next input character from the keyboard or COM1, sleeping while idle. */
+static char console_read_char(void)
+{
+    for (;;) {
+        int c = keyboard_poll_char();
+        if (c < 0) {
+            c = serial_poll_char();
+        }
+        if (c >= 0) {
+            return (char)c;
+        }
+
+        wait_event(&console_input_wait,
+                   keyboard_input_pending() || serial_input_pending());
+    }
+}
+
+/* ---------- Line editor ---------- */
+
+/*
+ * History is a ring of the last CONSOLE_HISTORY non-empty lines, each cut
+ * to CONSOLE_HISTORY_LEN bytes. Only the shell thread reads lines, so the
+ * editor state needs no lock.
+ */
+#define CONSOLE_HISTORY_LEN 128
+
+static char   history[CONSOLE_HISTORY][CONSOLE_HISTORY_LEN];
+static size_t history_count = 0;        /* lines ever added */
+static console_complete_fn completer = 0;
+
+void console_set_completer(console_complete_fn fn)
+{
+    completer = fn;
+}
+
+static void history_add(const char* line, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (len >= CONSOLE_HISTORY_LEN) {
+        len = CONSOLE_HISTORY_LEN - 1;
+    }
+    if (history_count > 0) {
+        const char* last = history[(history_count - 1) % CONSOLE_HISTORY];
+        if (strlen(last) == len && memcmp(last, line, len) == 0) {
+            return;     /* same as the one before */
+        }
+    }
+    char* slot = history[history_count % CONSOLE_HISTORY];
+    memcpy(slot, line, len);
+    slot[len] = '\0';
+    ++history_count;
+}
+
+/* Replace the line being edited (len bytes on screen) with s. */
+static size_t line_replace(char* buffer, size_t buflen, size_t len, const char* s)
+{
+    while (len > 0) {
+        --len;
+        console_backspace();
+    }
+    while (s[len] && len + 1 < buflen) {
+        buffer[len] = s[len];
+        console_putc(s[len]);
+        ++len;
+    }
+    return len;
+}
+
+void console_read_line(char* buffer, size_t buflen)
+{
+    size_t len = 0;
+    if (buflen == 0) {
+        return;
+    }
+
+    /* Lines back from the newest: 0 is the line being typed. */
+    size_t back = 0;
+    size_t stored = history_count < CONSOLE_HISTORY ? history_count : CONSOLE_HISTORY;
+    int tabs = 0;
+
+    for (;;) {
+        console_flush();
+        char c = console_read_char();
+        tabs = (c == CONSOLE_KEY_TAB) ? tabs + 1 : 0;
+
+        if (c == '\n') {
+            console_putc('\n');
+            buffer[len] = '\0';
+            history_add(buffer, len);
+            return;
+        } else if (c == '\b') {
+            if (len > 0) {
+                len--;
+                console_backspace();
+            }
+        } else if (c == CONSOLE_KEY_UP || c == CONSOLE_KEY_DOWN) {
+            if (c == CONSOLE_KEY_UP && back < stored) {
+                ++back;
+            } else if (c == CONSOLE_KEY_DOWN && back > 0) {
+                --back;
+            } else {
+                continue;
+            }
+            const char* s = back ? history[(history_count - back) % CONSOLE_HISTORY] : "";
+            len = line_replace(buffer, buflen, len, s);
+        } else if (c == CONSOLE_KEY_TAB) {
+            if (completer) {
+                buffer[len] = '\0';
+                size_t old = len;
+                len = completer(buffer, len, buflen, tabs > 1);
+                console_put_n(buffer + old, len - old);
+            }
+        } else {
+            if (len + 1 < buflen && c >= 32 && c < 127) {
+                buffer[len++] = c;
+                console_putc(c);
+            }
+        }
+    }
+}
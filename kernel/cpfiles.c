@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kstat.h"
+#include "string.h"
+
+/*
+ * Copy side of the simple in-memory "filesystem" for Enixnel.
+ *
+ * A clone is made entry by entry, and each file takes references to the
+ * original's blocks instead of copying them (fs_file_clone, in
+ * kernel/fsblock.c); whichever side writes a block first gets its own
+ * copy then. Copying a large file or a whole subtree therefore costs
+ * time and memory in proportion to the number of entries, not bytes.
+ *
+ * Exposed API (declared in fs.h):
+ *
+ *   int fs_clone(const char* old_name, const char* new_name);
+ *
+ * Returns 0 on success, <0 on error.
+ */
+
+/* New child of parent named like entry src. */
+static int fs_clone_child(int parent, int src)
+{
+    /* The name goes through a copy: interning may move the arena. */
+    char leaf[ENIXNEL_MAX_NAME_LEN + 1];
+    size_t len = fs_name_len(fs_entries[src].name);
+    memcpy(leaf, fs_name_str(fs_entries[src].name), len);
+    return fs_create_child(parent, leaf, len, fs_entries[src].is_dir);
+}
+
+/*
+ * Fill the fresh entry top with a copy of src and its subtree. Walks src
+ * in preorder, creating each copy after its parent's copy and after its
+ * earlier siblings', so the children keep their order.
+ */
+static int fs_clone_subtree(int src, int top)
+{
+    int s = src;
+    int d = top;
+    for (;;) {
+        /* d is the copy of s. */
+        if (!fs_entries[s].is_dir && fs_file_clone(d, s) != 0) {
+            return -1;
+        }
+
+        int parent;
+        if (fs_entries[s].is_dir && fs_entries[s].first_child != FS_NONE) {
+            parent = d;
+            s = fs_entries[s].first_child;
+        } else {
+            while (s != src && fs_entries[s].next_sibling == FS_NONE) {
+                s = fs_entries[s].parent;
+                d = fs_entries[d].parent;
+            }
+            if (s == src) {
+                return 0;
+            }
+            parent = fs_entries[d].parent;
+            s = fs_entries[s].next_sibling;
+        }
+
+        d = fs_clone_child(parent, s);
+        if (d < 0) {
+            return -1;
+        }
+    }
+}
+
+int fs_clone(const char* old_name, const char* new_name)
+{
+    KSTAT_FS(FS_CLONE);
+    int src = fs_find_index(old_name);
+    if (src < 0) {
+        return -1;
+    }
+
+    const char* leaf;
+    size_t leaf_len;
+    int parent = fs_resolve_parent(new_name, &leaf, &leaf_len);
+    if (parent < 0) {
+        return -1;  /* target directory missing */
+    }
+
+    if (fs_is_within(parent, src)) {
+        return -1;  /* the copy would land inside what is being copied */
+    }
+
+    int top = fs_create_child(parent, leaf, leaf_len, fs_entries[src].is_dir);
+    if (top < 0) {
+        return -1;  /* target already exists, or out of memory */
+    }
+
+    if (fs_clone_subtree(src, top) != 0) {
+        fs_release_tree(top);
+        return -1;
+    }
+    return 0;
+}
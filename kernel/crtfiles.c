@@ -1,6 +1,10 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "fs.h"
+#include "kstat.h"
+#include "kmalloc.h"
+#include "string.h"
+#include "trace.h"
 
 /*
  * Simple in-memory "filesystem" entries for Enixnel v0.1.
@@ -15,100 +19,451 @@
  * can behave in a useful way.
  */
 
-/* Global table defined here, shared via fs.h */
-fs_entry_t fs_entries[ENIXNEL_MAX_FS_ENTRIES];
+/*
+ * Global table defined here, shared via fs.h. It starts as a static array
+ * of ENIXNEL_MAX_FS_ENTRIES slots and doubles on the kernel heap when full
+ * (fs_grow_entries), staying one dense array so scans remain cheap.
+ */
+static fs_entry_t fs_entries_initial[ENIXNEL_MAX_FS_ENTRIES];
+fs_entry_t* fs_entries = fs_entries_initial;
+int         fs_entry_capacity = ENIXNEL_MAX_FS_ENTRIES;
+int         fs_entry_limit = 0;
 
 /*
- * Common helper: simple strlen (since we are freestanding).
+ * Free-slot bitmap: bit i of fs_free_map is set while fs_entries[i] is
+ * free. A second level, fs_free_summary, has one bit per map word that
+ * still has a free bit, so finding a slot is two bit-scans (bsf) rather
+ * than a sweep over the table. Both grow together with the table.
  */
-static size_t fs_strlen(const char* s)
+#define FS_WORDS(bits) (((bits) + 31) / 32)
+
+static uint32_t  fs_free_map_initial[FS_WORDS(ENIXNEL_MAX_FS_ENTRIES)];
+static uint32_t  fs_free_summary_initial[FS_WORDS(FS_WORDS(ENIXNEL_MAX_FS_ENTRIES))];
+static uint32_t* fs_free_map = fs_free_map_initial;
+static uint32_t* fs_free_summary = fs_free_summary_initial;
+
+void fs_entry_mark_free(int idx)
 {
-    size_t n = 0;
-    if (!s) {
-        return 0;
-    }
-    while (*s++) {
-        ++n;
+    uint32_t w = (uint32_t)idx / 32;
+    fs_free_map[w] |= 1u << (idx % 32);
+    fs_free_summary[w / 32] |= 1u << (w % 32);
+}
+
+/* Pop the lowest free slot. Returns index or -1 when the table is full. */
+static int fs_entry_take_free(void)
+{
+    uint32_t summary_words = FS_WORDS(FS_WORDS((uint32_t)fs_entry_capacity));
+    for (uint32_t s = 0; s < summary_words; ++s) {
+        if (fs_free_summary[s] == 0) {
+            continue;
+        }
+        uint32_t w = s * 32 + (uint32_t)__builtin_ctz(fs_free_summary[s]);
+        uint32_t bit = (uint32_t)__builtin_ctz(fs_free_map[w]);
+
+        fs_free_map[w] &= ~(1u << bit);
+        if (fs_free_map[w] == 0) {
+            fs_free_summary[s] &= ~(1u << (w % 32));
+        }
+        return (int)(w * 32 + bit);
     }
-    return n;
+    return -1;
 }
 
 /*
- * Lookup helper shared between create/delete code.
- * Returns index or -1 if not found.
+ * Double the entry table, its free bitmap and the name index.
+ * Returns 0 on success, <0 when out of memory or past fs_entry_limit
+ * (nothing changes then).
  */
-int fs_find_index(const char* name)
+static int fs_grow_entries(void)
 {
-    if (!name) {
+    int old_cap = fs_entry_capacity;
+    int new_cap = old_cap * 2;
+    if (fs_entry_limit && new_cap > fs_entry_limit) {
         return -1;
     }
+    uint32_t old_words = FS_WORDS((uint32_t)old_cap);
+    uint32_t new_words = FS_WORDS((uint32_t)new_cap);
+
+    /* A bigger index is harmless if the rest fails, so it goes first. */
+    if (fs_index_resize(new_cap) != 0) {
+        return -1;
+    }
+
+    fs_entry_t* entries = (fs_entry_t*)kmalloc((size_t)new_cap * sizeof(fs_entry_t));
+    uint32_t* map = (uint32_t*)kzalloc(new_words * sizeof(uint32_t));
+    uint32_t* summary = (uint32_t*)kzalloc(FS_WORDS(new_words) * sizeof(uint32_t));
+    if (!entries || !map || !summary) {
+        kfree(entries);
+        kfree(map);
+        kfree(summary);
+        return -1;
+    }
+
+    memcpy(entries, fs_entries, (size_t)old_cap * sizeof(fs_entry_t));
+    memcpy(map, fs_free_map, old_words * sizeof(uint32_t));
+    memcpy(summary, fs_free_summary, FS_WORDS(old_words) * sizeof(uint32_t));
+
+    if (fs_entries != fs_entries_initial) {
+        kfree(fs_entries);
+        kfree(fs_free_map);
+        kfree(fs_free_summary);
+    }
+    fs_entries = entries;
+    fs_free_map = map;
+    fs_free_summary = summary;
+    fs_entry_capacity = new_cap;
+
+    for (int i = old_cap; i < new_cap; ++i) {
+        fs_entries[i].used = 0;
+        fs_entry_mark_free(i);
+    }
+    return 0;
+}
+
+int fs_entries_reserve(int capacity)
+{
+    while (fs_entry_capacity < capacity) {
+        if (fs_grow_entries() != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void fs_entry_mark_used(int idx)
+{
+    uint32_t w = (uint32_t)idx / 32;
+    fs_free_map[w] &= ~(1u << (idx % 32));
+    if (fs_free_map[w] == 0) {
+        fs_free_summary[w / 32] &= ~(1u << (w % 32));
+    }
+}
+
+/*
+ * Working directory: relative paths start here, absolute ones ("/a/b")
+ * at the root. It is an entry index, so renames anywhere leave it valid;
+ * fs_cwd_forget() moves it to the root when its node is deleted.
+ */
+static int fs_cwd_idx = FS_ROOT_INDEX;
+
+/*
+ * Set up the root directory in slot 0. The root is never hashed; it is
+ * where absolute path resolution starts.
+ */
+void fs_init(void)
+{
+    fs_name_init();
+    fs_index_init();
+    fs_cwd_idx = FS_ROOT_INDEX;
 
     for (int i = 0; i < ENIXNEL_MAX_FS_ENTRIES; ++i) {
-        if (fs_entries[i].used) {
-            const char* a = fs_entries[i].name;
-            const char* b = name;
-            int equal = 1;
-            while (*a || *b) {
-                if (*a != *b) {
-                    equal = 0;
-                    break;
-                }
-                ++a;
-                ++b;
+        if (i != FS_ROOT_INDEX) {
+            fs_entry_mark_free(i);
+        }
+    }
+
+    fs_entry_t* root = &fs_entries[FS_ROOT_INDEX];
+    root->used = 1;
+    root->is_dir = 1;
+    root->hash = 0;
+    root->size = 0;
+    root->parent = FS_NONE;
+    root->first_child = FS_NONE;
+    root->next_sibling = FS_NONE;
+    root->prev_sibling = FS_NONE;
+    root->name = FS_NAME_EMPTY;
+}
+
+/* "." and "..", which name no entry of their own. */
+static int fs_is_dot(const char* name, size_t len)
+{
+    return name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'));
+}
+
+/*
+ * Resolve the first len bytes of path, one component at a time from the
+ * working directory (or the root after a leading '/'), each step being a
+ * single (parent, component) hash lookup. "." stays and ".." goes up,
+ * stopping at the root. Empty components (including a trailing '/') are
+ * rejected.
+ * Returns index or -1 if not found.
+ */
+static int fs_resolve(const char* path, size_t len)
+{
+    int cur = fs_cwd_idx;
+    size_t pos = 0;
+    if (len > 0 && path[0] == '/') {
+        cur = FS_ROOT_INDEX;
+        pos = 1;
+    }
+
+    while (pos < len) {
+        size_t start = pos;
+        while (pos < len && path[pos] != '/') {
+            ++pos;
+        }
+        size_t clen = pos - start;
+        if (clen == 0 || clen > ENIXNEL_MAX_NAME_LEN || !fs_entries[cur].is_dir) {
+            return -1;
+        }
+
+        if (fs_is_dot(path + start, clen)) {
+            if (clen == 2 && cur != FS_ROOT_INDEX) {
+                cur = fs_entries[cur].parent;
             }
-            if (equal) {
-                return i;
+        } else {
+            cur = fs_index_lookup(cur, path + start, clen,
+                                  fs_name_hash(cur, path + start, clen));
+            if (cur < 0) {
+                return -1;
             }
         }
+        if (pos < len && ++pos == len) {
+            return -1;  /* path ends in '/' */
+        }
     }
-    return -1;
+    return cur;
 }
 
 /*
- * Internal helper: allocate a new entry slot.
- * Returns index or -1.
+ * Lookup helper shared between create/delete code.
+ * Returns index or -1 if not found. Costs one hash lookup per component.
  */
-static int fs_alloc_entry(const char* name, uint8_t is_dir)
+int fs_find_index(const char* name)
 {
+    KSTAT_FS(FS_FIND_INDEX);
+    TRACE_SCOPE(FS_FIND_INDEX, 0, 0);
     if (!name) {
         return -1;
     }
 
-    size_t len = fs_strlen(name);
-    if (len == 0 || len > ENIXNEL_MAX_NAME_LEN) {
+    /* Tolerate a single trailing '/' ("a/" is "a") on lookups. */
+    size_t len = strlen(name);
+    if (len > 1 && name[len - 1] == '/') {
+        --len;
+    }
+    return fs_resolve(name, len);
+}
+
+/*
+ * Split path into its parent directory and last component.
+ * On success returns the parent's index and sets *leaf and *leaf_len.
+ * Returns -1 if the parent is missing or not a directory, or if the last
+ * component is empty, too long, "." or "..".
+ */
+int fs_resolve_parent(const char* path, const char** leaf, size_t* leaf_len)
+{
+    if (!path) {
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') {
+        --start;
+    }
+
+    size_t clen = len - start;
+    if (clen == 0 || clen > ENIXNEL_MAX_NAME_LEN || fs_is_dot(path + start, clen)) {
         return -1;
     }
 
-    /* Reject duplicates. */
-    if (fs_find_index(name) >= 0) {
+    int parent = fs_cwd_idx;
+    if (start == 1) {
+        parent = FS_ROOT_INDEX;     /* "/name" */
+    } else if (start > 1) {
+        parent = fs_resolve(path, start - 1);
+        if (parent < 0 || !fs_entries[parent].is_dir) {
+            return -1;
+        }
+    }
+
+    *leaf = path + start;
+    *leaf_len = clen;
+    return parent;
+}
+
+int fs_chdir(const char* path)
+{
+    int idx = fs_find_index(path);
+    if (idx < 0 || !fs_entries[idx].is_dir) {
         return -1;
     }
+    fs_cwd_idx = idx;
+    return 0;
+}
 
-    for (int i = 0; i < ENIXNEL_MAX_FS_ENTRIES; ++i) {
-        if (!fs_entries[i].used) {
-            fs_entries[i].used = 1;
-            fs_entries[i].is_dir = is_dir;
-
-            /* Manual strncpy to stay freestanding. */
-            char* dst = fs_entries[i].name;
-            const char* src = name;
-            while (*src) {
-                *dst++ = *src++;
-            }
-            *dst = '\0';
+int fs_cwd(void)
+{
+    return fs_cwd_idx;
+}
 
-            /* Initialize file contents if this is a file entry. */
-            fs_entries[i].size = 0;
-            if (!is_dir) {
-                fs_entries[i].data[0] = '\0';
-            }
+void fs_cwd_forget(int idx)
+{
+    if (idx == fs_cwd_idx) {
+        fs_cwd_idx = FS_ROOT_INDEX;
+    }
+}
+
+/*
+ * Write the full path of idx into out ("" for the root).
+ * Returns the path length, or -1 if it does not fit in out_size.
+ */
+int fs_build_path(int idx, char* out, size_t out_size)
+{
+    if (!out || out_size == 0) {
+        return -1;
+    }
+
+    /* Measure first, then fill from the back. */
+    size_t total = 0;
+    for (int i = idx; i != FS_ROOT_INDEX; i = fs_entries[i].parent) {
+        total += fs_name_len(fs_entries[i].name) + (total ? 1 : 0);
+    }
+    if (total >= out_size) {
+        return -1;
+    }
 
-            return i;
+    out[total] = '\0';
+    size_t pos = total;
+    for (int i = idx; i != FS_ROOT_INDEX; i = fs_entries[i].parent) {
+        size_t clen = fs_name_len(fs_entries[i].name);
+        if (pos != total) {
+            out[--pos] = '/';
         }
+        pos -= clen;
+        memcpy(out + pos, fs_name_str(fs_entries[i].name), clen);
     }
+    return (int)total;
+}
 
-    /* No free slots. */
-    return -1;
+/*
+ * Tree links: append idx to the end of parent's child list, or take it
+ * out again. Both are O(1) thanks to first_child->prev_sibling.
+ */
+void fs_link_child(int parent, int idx)
+{
+    fs_entry_t* p = &fs_entries[parent];
+    fs_entry_t* e = &fs_entries[idx];
+
+    e->parent = parent;
+    e->next_sibling = FS_NONE;
+
+    if (p->first_child == FS_NONE) {
+        p->first_child = idx;
+        e->prev_sibling = idx;
+        return;
+    }
+
+    fs_entry_t* first = &fs_entries[p->first_child];
+    int last = first->prev_sibling;
+    fs_entries[last].next_sibling = idx;
+    e->prev_sibling = last;
+    first->prev_sibling = idx;
+}
+
+void fs_unlink_child(int idx)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    fs_entry_t* p = &fs_entries[e->parent];
+
+    if (p->first_child == idx) {
+        p->first_child = e->next_sibling;
+        if (e->next_sibling != FS_NONE) {
+            /* New first child inherits the pointer to the last one. */
+            fs_entries[e->next_sibling].prev_sibling = e->prev_sibling;
+        }
+    } else {
+        fs_entries[e->prev_sibling].next_sibling = e->next_sibling;
+        if (e->next_sibling != FS_NONE) {
+            fs_entries[e->next_sibling].prev_sibling = e->prev_sibling;
+        } else {
+            /* Removed the last child: first child must point at the new last. */
+            fs_entries[p->first_child].prev_sibling = e->prev_sibling;
+        }
+    }
+
+    e->parent = FS_NONE;
+    e->next_sibling = FS_NONE;
+    e->prev_sibling = FS_NONE;
+}
+
+/* O(depth of dir), independent of the size of idx's subtree. */
+int fs_is_within(int dir, int idx)
+{
+    for (int i = dir; i != FS_NONE; i = fs_entries[i].parent) {
+        if (i == idx) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Internal helper: claim a free slot for a new child of parent. The caller
+ * has already checked that the name is not present. Returns index or -1.
+ */
+static int fs_claim_entry(int parent, const char* leaf, size_t leaf_len,
+                          uint32_t hash, uint8_t is_dir)
+{
+    uint32_t name = fs_name_intern(leaf, leaf_len);
+    if (name == FS_NAME_NONE) {
+        return -1;
+    }
+
+    int i = fs_entry_take_free();
+    if (i < 0) {
+        /* No free slots: grow the table, or give up if out of memory. */
+        if (fs_grow_entries() != 0) {
+            fs_name_release(name);
+            return -1;
+        }
+        i = fs_entry_take_free();
+    }
+
+    fs_entries[i].used = 1;
+    fs_entries[i].is_dir = is_dir;
+    fs_entries[i].in_image = 0;
+    fs_entries[i].hash = hash;
+
+    fs_entries[i].name = name;
+
+    /* Empty: zero length, no blocks (an all-zero map). */
+    fs_entries[i].size = 0;
+    memset(&fs_entries[i].data, 0, sizeof(fs_entries[i].data));
+    fs_entries[i].first_child = FS_NONE;
+
+    fs_link_child(parent, i);
+    fs_index_insert(i);
+    return i;
+}
+
+int fs_create_child(int parent, const char* leaf, size_t leaf_len, uint8_t is_dir)
+{
+    /* Reject duplicates. */
+    uint32_t hash = fs_name_hash(parent, leaf, leaf_len);
+    if (fs_index_lookup(parent, leaf, leaf_len, hash) >= 0) {
+        return -1;
+    }
+
+    return fs_claim_entry(parent, leaf, leaf_len, hash, is_dir);
+}
+
+/*
+ * Internal helper: allocate a new entry slot.
+ * Returns index or -1.
+ */
+static int fs_alloc_entry(const char* name, uint8_t is_dir)
+{
+    TRACE_SCOPE(FS_ALLOC_ENTRY, is_dir, 0);
+    const char* leaf;
+    size_t leaf_len;
+    int parent = fs_resolve_parent(name, &leaf, &leaf_len);
+    if (parent < 0) {
+        return -1;
+    }
+
+    return fs_create_child(parent, leaf, leaf_len, is_dir);
 }
 
 /*
@@ -116,33 +471,63 @@ static int fs_alloc_entry(const char* name, uint8_t is_dir)
  *
  *  fs_create_dir(name)  - returns 0 on success, <0 on error
  *  fs_create_file(name) - returns 0 on success, <0 on error
+ *  fs_create_image_file(name, data, size) - same, over the boot image
  *
  * The CLI code can call these and then decide what to print
  * based on the return value.
  */
 int fs_create_dir(const char* name)
 {
+    KSTAT_FS(FS_CREATE_DIR);
     int idx = fs_alloc_entry(name, 1 /* is_dir */);
     return (idx >= 0) ? 0 : -1;
 }
 
 int fs_create_file(const char* name)
 {
+    KSTAT_FS(FS_CREATE_FILE);
     int idx = fs_alloc_entry(name, 0 /* is_dir */);
     return (idx >= 0) ? 0 : -1;
 }
 
+int fs_create_image_file(const char* name, const void* data, uint32_t size)
+{
+    KSTAT_FS(FS_CREATE_FILE);
+    if (!data || size > ENIXNEL_MAX_FILE_SIZE) {
+        return -1;
+    }
+    int idx = fs_alloc_entry(name, 0 /* is_dir */);
+    if (idx < 0) {
+        return -1;
+    }
+    fs_entries[idx].in_image = 1;
+    fs_entries[idx].size = size;
+    fs_entries[idx].data.image = (const uint8_t*)data;
+    return 0;
+}
+
 /*
  * File content APIs
  */
 
 int fs_write_file(const char* name, const char* data, size_t len, int append)
 {
+    KSTAT_FS(FS_WRITE_FILE);
+    TRACE_SCOPE(FS_WRITE_FILE, append, len);
     if (!name || (!data && len > 0)) {
         return -1;
     }
 
-    int idx = fs_find_index(name);
+    /* Resolve and hash once: the same values serve the lookup and the
+     * auto-create. */
+    const char* leaf;
+    size_t leaf_len;
+    int parent = fs_resolve_parent(name, &leaf, &leaf_len);
+    if (parent < 0) {
+        return -1;
+    }
+    uint32_t hash = fs_name_hash(parent, leaf, leaf_len);
+    int idx = fs_index_lookup(parent, leaf, leaf_len, hash);
 
     if (idx >= 0) {
         if (fs_entries[idx].is_dir) {
@@ -151,64 +536,55 @@ int fs_write_file(const char* name, const char* data, size_t len, int append)
         }
     } else {
         /* Auto-create the file if it does not exist */
-        idx = fs_alloc_entry(name, 0 /* is_dir */);
+        idx = fs_claim_entry(parent, leaf, leaf_len, hash, 0 /* is_dir */);
         if (idx < 0) {
             return -1;
         }
-        fs_entries[idx].size = 0;
-        fs_entries[idx].data[0] = '\0';
     }
 
-    fs_entry_t* e = &fs_entries[idx];
-
-    size_t offset = append ? e->size : 0;
-    if (offset >= ENIXNEL_MAX_FILE_SIZE) {
+    /* Size first, so a write that does not fit leaves the file untouched. */
+    size_t offset = append ? fs_entries[idx].size : 0;
+    if (len > ENIXNEL_MAX_FILE_SIZE - offset) {
         return -1;
     }
-
-    size_t space = ENIXNEL_MAX_FILE_SIZE - offset;
-    if (len > space) {
-        len = space;
-    }
-
-    for (size_t i = 0; i < len; ++i) {
-        e->data[offset + i] = data[i];
-    }
-
-    offset += len;
-    e->size = offset;
-
-    if (offset < ENIXNEL_MAX_FILE_SIZE) {
-        e->data[offset] = '\0';
-    } else {
-        e->data[ENIXNEL_MAX_FILE_SIZE - 1] = '\0';
+    if (fs_file_resize(idx, offset + len) != 0) {
+        return -1;
     }
 
-    return 0;
+    return fs_file_write(idx, offset, data, len);
 }
 
-int fs_read_file(const char* name, const char** out_data, size_t* out_len)
+int fs_read_file(const char* name, size_t offset, char* buf, size_t len, size_t* out_len)
 {
-    if (!name) {
+    KSTAT_FS(FS_READ_FILE);
+    if (!name || (!buf && len > 0)) {
         return -1;
     }
 
     int idx = fs_find_index(name);
-    if (idx < 0) {
+    if (idx < 0 || fs_entries[idx].is_dir) {
         return -1;
     }
 
-    fs_entry_t* e = &fs_entries[idx];
-    if (e->is_dir) {
-        return -1;
+    size_t n = fs_file_read(idx, offset, buf, len);
+    if (out_len) {
+        *out_len = n;
     }
 
-    if (out_data) {
-        *out_data = e->data;
+    return 0;
+}
+
+int fs_file_size(const char* name, size_t* out_size)
+{
+    KSTAT_FS(FS_FILE_SIZE);
+    int idx = fs_find_index(name);
+    if (idx < 0 || fs_entries[idx].is_dir) {
+        return -1;
     }
-    if (out_len) {
-        *out_len = e->size;
+
+    if (out_size) {
+        *out_size = fs_entries[idx].size;
     }
 
     return 0;
-}
\ No newline at end of file
+}
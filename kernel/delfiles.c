@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "fs.h"
+#include "kstat.h"
 
 /*
  * Deletion side of the simple in-memory "filesystem" for Enixnel v0.1.
@@ -9,18 +10,62 @@
  *
  * Exposed API (declared in fs.h):
  *
- *   int fs_delete_dir(const char* name);
- *   int fs_delete_file(const char* name);
+ *   int  fs_delete_dir(const char* name);
+ *   int  fs_delete_file(const char* name);
+ *   void fs_release_tree(int idx);
  *
- * Both return 0 on success, <0 on error.
+ * The deletes return 0 on success, <0 on error.
  */
 
 /*
- * Delete a directory entry with the given name.
- * Returns 0 on success, <0 on error (not found, or is a file).
+ * Drop an entry from the name index and its parent's child list, return
+ * its blocks to the pool and mark its slot free.
+ */
+static void fs_release_entry(int idx)
+{
+    fs_unlink_child(idx);
+    fs_index_remove(idx);
+    if (fs_entries[idx].is_dir) {
+        fs_cwd_forget(idx);
+    } else {
+        fs_fd_forget(idx);
+        fs_file_resize(idx, 0);
+    }
+    fs_entries[idx].used = 0;
+    fs_entries[idx].is_dir = 0;
+    fs_name_release(fs_entries[idx].name);
+    fs_entries[idx].name = FS_NAME_EMPTY;
+    fs_entry_mark_free(idx);
+}
+
+/*
+ * Release an entry and everything below it. Walks down to a leaf,
+ * releases it, and resumes from its parent, so every node in the subtree
+ * is visited a constant number of times and nothing outside is touched.
+ */
+void fs_release_tree(int top)
+{
+    int cur = top;
+    for (;;) {
+        while (fs_entries[cur].first_child != FS_NONE) {
+            cur = fs_entries[cur].first_child;
+        }
+        int parent = fs_entries[cur].parent;
+        fs_release_entry(cur);
+        if (cur == top) {
+            return;
+        }
+        cur = parent;
+    }
+}
+
+/*
+ * Delete a directory entry with the given name, including its contents.
+ * Returns 0 on success, <0 on error (not found, is a file, or is the root).
  */
 int fs_delete_dir(const char* name)
 {
+    KSTAT_FS(FS_DELETE_DIR);
     int idx = fs_find_index(name);
     if (idx < 0) {
         return -1;  /* not found */
@@ -30,9 +75,11 @@ int fs_delete_dir(const char* name)
         return -1;  /* exists but is a file, not a directory */
     }
 
-    fs_entries[idx].used = 0;
-    fs_entries[idx].is_dir = 0;
-    fs_entries[idx].name[0] = '\0';
+    if (idx == FS_ROOT_INDEX) {
+        return -1;  /* the root cannot be deleted */
+    }
+
+    fs_release_tree(idx);
 
     return 0;
 }
@@ -43,6 +90,7 @@ int fs_delete_dir(const char* name)
  */
 int fs_delete_file(const char* name)
 {
+    KSTAT_FS(FS_DELETE_FILE);
     int idx = fs_find_index(name);
     if (idx < 0) {
         return -1;  /* not found */
@@ -52,9 +100,7 @@ int fs_delete_file(const char* name)
         return -1;  /* exists but is a directory, not a file */
     }
 
-    fs_entries[idx].used = 0;
-    fs_entries[idx].is_dir = 0;
-    fs_entries[idx].name[0] = '\0';
+    fs_release_entry(idx);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,744 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kstat.h"
+#include "kmalloc.h"
+#include "string.h"
+
+/*
+ * Block storage for file contents in Enixnel.
+ *
+ * File data is carved out of FS_BLOCK_SIZE-byte blocks, so a file only
+ * holds as many blocks as its length needs and directories hold none.
+ * Files of up to FS_INLINE_SIZE bytes skip blocks entirely and keep their
+ * bytes in the entry (fs_entry_t.data.inline_data). Boot image files
+ * (in_image) use neither until fs_file_resize() copies them out.
+ *
+ * Block memory comes from the "fs_block" slab cache; block maps refer to
+ * blocks by a 16-bit number that indexes fs_block_table[]. The table
+ * doubles through kmalloc() when every number is taken, so the pool grows
+ * with the data actually stored, and freed blocks go straight back to
+ * the slab cache. Block 0 is never handed out, so 0 can mean "no block".
+ *
+ * fs_block_dirty[] has a bit per block number, set whenever the block's
+ * bytes change, so fs_sync() (kernel/fsdisk.c) writes back only those.
+ *
+ * Clones (fs_file_clone) share blocks. fs_block_refs[] counts the maps and
+ * indirect blocks that point at each block, and a shared indirect block
+ * counts once however many files reach it through there, so cloning a
+ * file takes at most FS_DIRECT_BLOCKS + 2 references whatever its size.
+ * A write goes through fs_map_slot(FS_MAP_COW), which gives the file its
+ * own copy of every shared block on the path first; a copied indirect
+ * block takes a reference to each block it lists.
+ */
+
+#define FS_BLOCK_MAX_IDS   65536u   /* fs_blkno_t range */
+#define FS_BLOCK_MIN_TABLE 256u
+
+static kmem_cache_t* fs_block_cache = 0;
+static uint8_t**     fs_block_table = 0;     /* block number -> memory */
+static fs_blkno_t*   fs_block_free_ids = 0;  /* stack of unused numbers */
+static uint32_t      fs_block_free_top = 0;
+static uint32_t      fs_block_capacity = 0;  /* numbers 1 .. capacity-1 */
+static size_t        fs_block_in_use = 0;
+static uint32_t*     fs_block_dirty = 0;     /* one bit per block number */
+static uint32_t      fs_block_dirty_count = 0;
+static uint32_t*     fs_block_refs = 0;      /* 0 = free */
+
+/* Double the number space. Returns 0 on success, <0 when out of memory. */
+static int fs_block_grow(void)
+{
+    if (fs_block_capacity >= FS_BLOCK_MAX_IDS) {
+        return -1;
+    }
+    /* Powers of two from FS_BLOCK_MIN_TABLE land exactly on the maximum. */
+    uint32_t cap = fs_block_capacity ? fs_block_capacity * 2 : FS_BLOCK_MIN_TABLE;
+
+    uint8_t** table = (uint8_t**)kzalloc(cap * sizeof(*table));
+    fs_blkno_t* ids = (fs_blkno_t*)kmalloc(cap * sizeof(*ids));
+    uint32_t* dirty = (uint32_t*)kzalloc(cap / 32 * sizeof(*dirty));
+    uint32_t* refs = (uint32_t*)kzalloc(cap * sizeof(*refs));
+    if (!table || !ids || !dirty || !refs) {
+        kfree(table);
+        kfree(ids);
+        kfree(dirty);
+        kfree(refs);
+        return -1;
+    }
+
+    if (fs_block_capacity) {    /* the first grow has no old tables to copy */
+        memcpy(table, fs_block_table, fs_block_capacity * sizeof(*table));
+        memcpy(ids, fs_block_free_ids, fs_block_free_top * sizeof(*ids));
+        memcpy(dirty, fs_block_dirty, fs_block_capacity / 32 * sizeof(*dirty));
+        memcpy(refs, fs_block_refs, fs_block_capacity * sizeof(*refs));
+    }
+
+    /* Push the new numbers so the lowest comes out first. */
+    uint32_t first = fs_block_capacity ? fs_block_capacity : 1;
+    for (uint32_t n = cap; n-- > first;) {
+        ids[fs_block_free_top++] = (fs_blkno_t)n;
+    }
+
+    kfree(fs_block_table);
+    kfree(fs_block_free_ids);
+    kfree(fs_block_dirty);
+    kfree(fs_block_refs);
+    fs_block_table = table;
+    fs_block_free_ids = ids;
+    fs_block_dirty = dirty;
+    fs_block_refs = refs;
+    fs_block_capacity = cap;
+    return 0;
+}
+
+static int fs_block_cache_ready(void)
+{
+    if (!fs_block_cache) {
+        fs_block_cache = kmem_cache_create("fs_block", FS_BLOCK_SIZE);
+    }
+    return fs_block_cache != 0;
+}
+
+void fs_block_mark_dirty(fs_blkno_t blk)
+{
+    uint32_t bit = 1u << (blk % 32);
+    if (blk != 0 && !(fs_block_dirty[blk / 32] & bit)) {
+        fs_block_dirty[blk / 32] |= bit;
+        ++fs_block_dirty_count;
+    }
+}
+
+fs_blkno_t fs_block_alloc(void)
+{
+    if (!fs_block_cache_ready()) {
+        return 0;
+    }
+    if (fs_block_free_top == 0 && fs_block_grow() != 0) {
+        return 0;
+    }
+
+    uint8_t* mem = (uint8_t*)kmem_cache_alloc(fs_block_cache);
+    if (!mem) {
+        return 0;
+    }
+
+    fs_blkno_t blk = fs_block_free_ids[--fs_block_free_top];
+    fs_block_table[blk] = mem;
+    fs_block_refs[blk] = 1;
+    ++fs_block_in_use;
+    memset(mem, 0, FS_BLOCK_SIZE);
+    fs_block_mark_dirty(blk);
+    return blk;
+}
+
+int fs_block_share(fs_blkno_t blk)
+{
+    if (blk == 0 || blk >= fs_block_capacity || !fs_block_table[blk]) {
+        return -1;
+    }
+    ++fs_block_refs[blk];
+    return 0;
+}
+
+void fs_block_free(fs_blkno_t blk)
+{
+    if (blk == 0 || blk >= fs_block_capacity || !fs_block_table[blk]) {
+        return;
+    }
+    if (--fs_block_refs[blk] > 0) {
+        return;     /* still in another file */
+    }
+    kmem_cache_free(fs_block_cache, fs_block_table[blk]);
+    fs_block_table[blk] = 0;
+    fs_block_free_ids[fs_block_free_top++] = blk;
+    --fs_block_in_use;
+}
+
+uint8_t* fs_block_data(fs_blkno_t blk)
+{
+    return fs_block_table[blk];
+}
+
+uint32_t fs_block_refcount(fs_blkno_t blk)
+{
+    if (blk == 0 || blk >= fs_block_capacity || !fs_block_table[blk]) {
+        return 0;
+    }
+    return fs_block_refs[blk];
+}
+
+size_t fs_blocks_used(void)
+{
+    return fs_block_in_use;
+}
+
+size_t fs_blocks_dirty(void)
+{
+    return fs_block_dirty_count;
+}
+
+int fs_block_load(fs_blkno_t blk, const void* data)
+{
+    if (blk == 0 || !fs_block_cache_ready()) {
+        return -1;
+    }
+    while (blk >= fs_block_capacity) {
+        if (fs_block_grow() != 0) {
+            return -1;
+        }
+    }
+    if (fs_block_table[blk]) {
+        return -1;  /* referenced twice */
+    }
+
+    uint8_t* mem = (uint8_t*)kmem_cache_alloc(fs_block_cache);
+    if (!mem) {
+        return -1;
+    }
+    memcpy(mem, data, FS_BLOCK_SIZE);
+    fs_block_table[blk] = mem;
+    fs_block_refs[blk] = 1;
+    ++fs_block_in_use;
+    return 0;
+}
+
+void fs_block_load_done(void)
+{
+    /* Same order as fs_block_grow(): the lowest free number comes out first. */
+    fs_block_free_top = 0;
+    for (uint32_t n = fs_block_capacity; n-- > 1;) {
+        if (!fs_block_table[n]) {
+            fs_block_free_ids[fs_block_free_top++] = (fs_blkno_t)n;
+        }
+    }
+}
+
+int fs_block_drain_dirty(fs_block_store_fn store)
+{
+    int rc = 0;
+    for (uint32_t w = 0; fs_block_dirty_count && w < fs_block_capacity / 32; ++w) {
+        while (fs_block_dirty[w]) {
+            uint32_t bit = (uint32_t)__builtin_ctz(fs_block_dirty[w]);
+            fs_blkno_t blk = (fs_blkno_t)(w * 32 + bit);
+            /* Freed blocks are simply forgotten; nothing refers to them. */
+            if (fs_block_table[blk] && store(blk, fs_block_table[blk]) != 0) {
+                rc = -1;
+                break;      /* stays dirty for the next sync */
+            }
+            fs_block_dirty[w] &= ~(1u << bit);
+            --fs_block_dirty_count;
+        }
+        if (rc != 0) {
+            break;
+        }
+    }
+    return rc;
+}
+
+/* ---------- Per-file block maps ---------- */
+
+static uint32_t fs_blocks_for(size_t size)
+{
+    if (size <= FS_INLINE_SIZE) {
+        return 0;
+    }
+    return (uint32_t)((size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE);
+}
+
+static fs_blkno_t* fs_block_ptrs(fs_blkno_t blk)
+{
+    return (fs_blkno_t*)fs_block_table[blk];
+}
+
+/*
+ * Drop a reference to a block that lists `depth` levels of blocks below
+ * it (0 for data). The last reference releases the listed blocks too.
+ */
+static void fs_block_put(fs_blkno_t blk, int depth)
+{
+    if (blk == 0) {
+        return;
+    }
+    if (depth > 0 && fs_block_refs[blk] == 1) {
+        fs_blkno_t* ptrs = fs_block_ptrs(blk);
+        for (uint32_t i = 0; i < FS_PTRS_PER_BLOCK; ++i) {
+            fs_block_put(ptrs[i], depth - 1);
+        }
+    }
+    fs_block_free(blk);
+}
+
+/*
+ * Make *slot private to the file that reaches it: if the block is shared,
+ * point the slot at a fresh copy (and, for an indirect block, share the
+ * blocks the copy lists). Returns 1 if the slot changed, 0 if it was
+ * private already, <0 when out of memory.
+ */
+static int fs_block_unshare(fs_blkno_t* slot, int depth)
+{
+    fs_blkno_t old = *slot;
+    if (old == 0 || fs_block_refs[old] == 1) {
+        return 0;
+    }
+
+    fs_blkno_t blk = fs_block_alloc();
+    if (blk == 0) {
+        return -1;
+    }
+    memcpy(fs_block_table[blk], fs_block_table[old], FS_BLOCK_SIZE);
+    if (depth > 0) {
+        fs_blkno_t* ptrs = fs_block_ptrs(blk);
+        for (uint32_t i = 0; i < FS_PTRS_PER_BLOCK; ++i) {
+            if (ptrs[i]) {
+                ++fs_block_refs[ptrs[i]];
+            }
+        }
+    }
+    --fs_block_refs[old];
+    *slot = blk;
+    return 1;
+}
+
+/*
+ * Modes for fs_map_slot():
+ *   FS_MAP_READ   look the slot up only.
+ *   FS_MAP_COW    also give the file its own copy of every shared block on
+ *                 the way, the data block included, so it can be written.
+ *   FS_MAP_ALLOC  the caller will store a new block number in the slot:
+ *                 missing indirect blocks are allocated and shared ones
+ *                 copied.
+ */
+#define FS_MAP_READ  0
+#define FS_MAP_COW   1
+#define FS_MAP_ALLOC 2
+
+/*
+ * Make an indirect block slot usable for the given mode: allocate it if
+ * missing (FS_MAP_ALLOC only) or unshare it. Returns 1 if the slot
+ * changed, 0 if not, <0 if it cannot be used.
+ */
+static int fs_map_level(fs_blkno_t* slot, int depth, int mode)
+{
+    if (*slot == 0) {
+        if (mode != FS_MAP_ALLOC || (*slot = fs_block_alloc()) == 0) {
+            return -1;
+        }
+        return 1;
+    }
+    return mode == FS_MAP_READ ? 0 : fs_block_unshare(slot, depth);
+}
+
+/*
+ * Return the map slot holding logical block n of the file, prepared as
+ * mode says (indirect blocks that are allocated are zero-filled, so their
+ * slots read as empty). Returns 0 if n is out of range, or if an indirect
+ * block is missing or shared and cannot be fixed for the mode (including
+ * when out of memory).
+ */
+static fs_blkno_t* fs_map_slot(fs_entry_t* e, uint32_t n, int mode)
+{
+    fs_blkno_t* slot;
+    fs_blkno_t holder = 0;      /* block holding slot; 0 = the entry */
+
+    if (n < FS_DIRECT_BLOCKS) {
+        slot = &e->data.map.direct[n];
+    } else {
+        n -= FS_DIRECT_BLOCKS;
+
+        fs_blkno_t* ind;
+        fs_blkno_t ind_holder = 0;
+        if (n < FS_PTRS_PER_BLOCK) {
+            ind = &e->data.map.indirect;
+        } else {
+            n -= FS_PTRS_PER_BLOCK;
+            if (n >= FS_PTRS_PER_BLOCK * FS_PTRS_PER_BLOCK) {
+                return 0;
+            }
+            if (fs_map_level(&e->data.map.dindirect, 2, mode) < 0) {
+                return 0;
+            }
+            ind_holder = e->data.map.dindirect;
+            ind = &fs_block_ptrs(ind_holder)[n / FS_PTRS_PER_BLOCK];
+            n %= FS_PTRS_PER_BLOCK;
+        }
+
+        int changed = fs_map_level(ind, 1, mode);
+        if (changed < 0) {
+            return 0;
+        }
+        if (changed && ind_holder) {
+            fs_block_mark_dirty(ind_holder);
+        }
+        holder = *ind;
+        slot = &fs_block_ptrs(holder)[n];
+    }
+
+    if (mode == FS_MAP_ALLOC) {
+        fs_block_mark_dirty(holder);  /* the caller fills the slot */
+    } else if (mode == FS_MAP_COW) {
+        int changed = fs_block_unshare(slot, 0);
+        if (changed < 0) {
+            return 0;
+        }
+        if (changed) {
+            fs_block_mark_dirty(holder);
+        }
+    }
+    return slot;
+}
+
+/* Drop the data blocks listed in slots [first, FS_PTRS_PER_BLOCK) of ind. */
+static void fs_map_free_slots(fs_blkno_t ind, uint32_t first)
+{
+    fs_blkno_t* ptrs = fs_block_ptrs(ind);
+    for (uint32_t i = first; i < FS_PTRS_PER_BLOCK; ++i) {
+        if (ptrs[i]) {
+            fs_block_free(ptrs[i]);
+            ptrs[i] = 0;
+            fs_block_mark_dirty(ind);
+        }
+    }
+}
+
+/*
+ * Drop the file's references to logical blocks from on, and to every
+ * indirect block whose whole range lies at or past from. An indirect block
+ * that only partly does must already be private to the file, as the path
+ * to block from - 1 is after fs_map_slot(FS_MAP_ALLOC or FS_MAP_COW).
+ */
+static void fs_map_free_from(fs_entry_t* e, uint32_t from)
+{
+    for (uint32_t n = from; n < FS_DIRECT_BLOCKS; ++n) {
+        fs_block_free(e->data.map.direct[n]);
+        e->data.map.direct[n] = 0;
+    }
+
+    const uint32_t ind_start = FS_DIRECT_BLOCKS;
+    const uint32_t dind_start = FS_DIRECT_BLOCKS + FS_PTRS_PER_BLOCK;
+
+    if (e->data.map.indirect) {
+        if (from <= ind_start) {
+            fs_block_put(e->data.map.indirect, 1);
+            e->data.map.indirect = 0;
+        } else if (from < dind_start) {
+            fs_map_free_slots(e->data.map.indirect, from - ind_start);
+        }
+    }
+
+    fs_blkno_t dind = e->data.map.dindirect;
+    if (dind && from <= dind_start) {
+        fs_block_put(dind, 2);
+        e->data.map.dindirect = 0;
+    } else if (dind) {
+        fs_blkno_t* ptrs = fs_block_ptrs(dind);
+        for (uint32_t i = 0; i < FS_PTRS_PER_BLOCK; ++i) {
+            uint32_t start = dind_start + i * FS_PTRS_PER_BLOCK;
+            if (!ptrs[i] || from >= start + FS_PTRS_PER_BLOCK) {
+                continue;
+            }
+            if (from <= start) {
+                fs_block_put(ptrs[i], 1);
+                ptrs[i] = 0;
+                fs_block_mark_dirty(dind);
+            } else {
+                fs_map_free_slots(ptrs[i], from - start);
+            }
+        }
+    }
+}
+
+static void fs_map_clear(fs_entry_t* e)
+{
+    memset(&e->data, 0, sizeof(e->data));
+}
+
+/*
+ * Copy on modify: move the part of a boot image file that survives a
+ * resize to new_size into writable storage, then resize as usual.
+ */
+static int fs_file_resize_image(int idx, size_t new_size)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    const uint8_t* src = e->data.image;
+    uint32_t old_size = e->size;
+    size_t keep = new_size < old_size ? new_size : old_size;
+
+    e->in_image = 0;
+    e->size = 0;
+    fs_map_clear(e);
+    if (fs_file_resize(idx, keep) != 0) {
+        e->in_image = 1;
+        e->size = old_size;
+        e->data.image = src;
+        return -1;
+    }
+    fs_file_write(idx, 0, src, keep);
+    return fs_file_resize(idx, new_size);  /* only grows; left as copied on failure */
+}
+
+int fs_file_resize(int idx, size_t new_size)
+{
+    KSTAT_FS(FS_FILE_RESIZE);
+    fs_entry_t* e = &fs_entries[idx];
+    if (e->is_dir || new_size > ENIXNEL_MAX_FILE_SIZE) {
+        return -1;
+    }
+    if (e->in_image) {
+        return fs_file_resize_image(idx, new_size);
+    }
+
+    size_t old_size = e->size;
+    uint32_t old_blocks = fs_blocks_for(old_size);
+    uint32_t new_blocks = fs_blocks_for(new_size);
+
+    /* Inline to inline: just zero any newly exposed bytes. */
+    if (old_blocks == 0 && new_blocks == 0) {
+        if (new_size > old_size) {
+            memset(e->data.inline_data + old_size, 0, new_size - old_size);
+        }
+        e->size = (uint32_t)new_size;
+        return 0;
+    }
+
+    /* Shrinking into the inline area: keep the head, release every block. */
+    if (new_blocks == 0) {
+        char head[FS_INLINE_SIZE];
+        memcpy(head, fs_block_data(e->data.map.direct[0]), new_size);
+        fs_map_free_from(e, 0);
+        fs_map_clear(e);
+        memcpy(e->data.inline_data, head, new_size);
+        e->size = (uint32_t)new_size;
+        return 0;
+    }
+
+    /* Shrinking within blocks: the new last block and the indirect blocks
+     * above it must be the file's own (its tail is zeroed below if partial),
+     * even when the block count stays the same. Done first, as it is the
+     * one step here that can fail. */
+    if ((new_blocks < old_blocks || (new_size < old_size && new_size % FS_BLOCK_SIZE)) &&
+        !fs_map_slot(e, new_blocks - 1, new_size % FS_BLOCK_SIZE ? FS_MAP_COW : FS_MAP_ALLOC)) {
+        return -1;
+    }
+
+    /* Moving out of the inline area: the map replaces the inline bytes. */
+    char head[FS_INLINE_SIZE];
+    if (old_blocks == 0) {
+        memcpy(head, e->data.inline_data, old_size);
+        fs_map_clear(e);
+    }
+
+    if (new_blocks < old_blocks) {
+        fs_map_free_from(e, new_blocks);
+    } else {
+        for (uint32_t n = old_blocks; n < new_blocks; ++n) {
+            fs_blkno_t* slot = fs_map_slot(e, n, FS_MAP_ALLOC);
+            fs_blkno_t blk = slot ? fs_block_alloc() : 0;
+            if (blk == 0) {
+                /* Roll back everything allocated above. */
+                fs_map_free_from(e, old_blocks);
+                if (old_blocks == 0) {
+                    memcpy(e->data.inline_data, head, old_size);
+                }
+                return -1;
+            }
+            *slot = blk;
+        }
+
+        if (old_blocks == 0) {
+            memcpy(fs_block_data(e->data.map.direct[0]), head, old_size);
+        }
+    }
+
+    /* Zero the tail of the last kept block when shrinking within blocks, so
+     * a later grow exposes zeros rather than stale bytes. */
+    if (new_size < old_size && new_size % FS_BLOCK_SIZE) {
+        fs_blkno_t blk = *fs_map_slot(e, new_blocks - 1, FS_MAP_READ);
+        size_t keep = new_size % FS_BLOCK_SIZE;
+        memset(fs_block_data(blk) + keep, 0, FS_BLOCK_SIZE - keep);
+        fs_block_mark_dirty(blk);
+    }
+
+    e->size = (uint32_t)new_size;
+    return 0;
+}
+
+size_t fs_file_read(int idx, size_t offset, void* buf, size_t len)
+{
+    KSTAT_FS(FS_FILE_READ);
+    fs_entry_t* e = &fs_entries[idx];
+    uint8_t* out = (uint8_t*)buf;
+
+    if (e->is_dir || offset >= e->size) {
+        return 0;
+    }
+    if (len > e->size - offset) {
+        len = e->size - offset;
+    }
+
+    if (e->in_image) {
+        memcpy(out, e->data.image + offset, len);
+        return len;
+    }
+    if (e->size <= FS_INLINE_SIZE) {
+        memcpy(out, e->data.inline_data + offset, len);
+        return len;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        size_t pos = offset + done;
+        size_t in_block = pos % FS_BLOCK_SIZE;
+        size_t chunk = FS_BLOCK_SIZE - in_block;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+
+        const uint8_t* src = fs_block_data(*fs_map_slot(e, (uint32_t)(pos / FS_BLOCK_SIZE), FS_MAP_READ));
+        memcpy(out + done, src + in_block, chunk);
+        done += chunk;
+    }
+    return len;
+}
+
+size_t fs_file_span(int idx, size_t offset, const uint8_t** data)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    if (e->is_dir || offset >= e->size) {
+        return 0;
+    }
+
+    size_t len = e->size - offset;
+    if (e->in_image) {
+        *data = e->data.image + offset;
+    } else if (e->size <= FS_INLINE_SIZE) {
+        *data = (const uint8_t*)e->data.inline_data + offset;
+    } else {
+        size_t in_block = offset % FS_BLOCK_SIZE;
+        if (len > FS_BLOCK_SIZE - in_block) {
+            len = FS_BLOCK_SIZE - in_block;
+        }
+        *data = fs_block_data(*fs_map_slot(e, (uint32_t)(offset / FS_BLOCK_SIZE), FS_MAP_READ)) + in_block;
+    }
+    return len;
+}
+
+int fs_file_write(int idx, size_t offset, const void* buf, size_t len)
+{
+    KSTAT_FS(FS_FILE_WRITE);
+    fs_entry_t* e = &fs_entries[idx];
+    const uint8_t* in = (const uint8_t*)buf;
+
+    if (e->is_dir || offset >= e->size) {
+        return 0;
+    }
+    if (len > e->size - offset) {
+        len = e->size - offset;
+    }
+    if (e->in_image && fs_file_resize(idx, e->size) != 0) {
+        return -1;  /* out of memory for the private copy */
+    }
+
+    if (e->size <= FS_INLINE_SIZE) {
+        memcpy(e->data.inline_data + offset, in, len);
+        return 0;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        size_t pos = offset + done;
+        size_t in_block = pos % FS_BLOCK_SIZE;
+        size_t chunk = FS_BLOCK_SIZE - in_block;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+
+        fs_blkno_t* slot = fs_map_slot(e, (uint32_t)(pos / FS_BLOCK_SIZE), FS_MAP_COW);
+        if (!slot) {
+            return -1;  /* out of memory for a copy of a shared block */
+        }
+        memcpy(fs_block_data(*slot) + in_block, in + done, chunk);
+        fs_block_mark_dirty(*slot);
+        done += chunk;
+    }
+    return 0;
+}
+
+int fs_file_clone(int dst, int src)
+{
+    fs_entry_t* s = &fs_entries[src];
+    fs_entry_t* d = &fs_entries[dst];
+    if (d->is_dir || s->is_dir || d->size != 0) {
+        return -1;
+    }
+
+    /* Image files are matched to the boot image by path at mount, so a
+     * clone elsewhere gets its own copy. */
+    if (s->in_image) {
+        if (fs_file_resize(dst, s->size) != 0) {
+            return -1;
+        }
+        return fs_file_write(dst, 0, s->data.image, s->size);
+    }
+
+    d->size = s->size;
+    d->data = s->data;
+    if (s->size > FS_INLINE_SIZE) {
+        for (uint32_t i = 0; i < FS_DIRECT_BLOCKS; ++i) {
+            fs_block_share(d->data.map.direct[i]);
+        }
+        fs_block_share(d->data.map.indirect);
+        fs_block_share(d->data.map.dindirect);
+    }
+    return 0;
+}
+
+int fs_file_for_each_block(int idx, fs_block_fn fn)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    if (e->is_dir || e->in_image || e->size <= FS_INLINE_SIZE) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < FS_DIRECT_BLOCKS; ++i) {
+        if (e->data.map.direct[i] && fn(e->data.map.direct[i]) < 0) {
+            return -1;
+        }
+    }
+
+    /* fn sees each indirect block before its slots are read. */
+    fs_blkno_t ind = e->data.map.indirect;
+    int rc;
+    if (ind) {
+        if ((rc = fn(ind)) < 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; rc == 0 && i < FS_PTRS_PER_BLOCK; ++i) {
+            if (fs_block_ptrs(ind)[i] && fn(fs_block_ptrs(ind)[i]) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    fs_blkno_t dind = e->data.map.dindirect;
+    if (dind) {
+        if ((rc = fn(dind)) < 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; rc == 0 && i < FS_PTRS_PER_BLOCK; ++i) {
+            fs_blkno_t sub = fs_block_ptrs(dind)[i];
+            if (!sub) {
+                continue;
+            }
+            int sub_rc = fn(sub);
+            if (sub_rc < 0) {
+                return -1;
+            }
+            for (uint32_t j = 0; sub_rc == 0 && j < FS_PTRS_PER_BLOCK; ++j) {
+                if (fs_block_ptrs(sub)[j] && fn(fs_block_ptrs(sub)[j]) < 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,396 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "bcache.h"
+#include "initrd.h"
+#include "journal.h"
+#include "sched.h"
+#include "string.h"
+
+/*
+ * On-disk format of the Enixnel fs.
+ *
+ * The disk mirrors the in-memory tables one to one, in BCACHE_BLOCK_SIZE
+ * disk blocks:
+ *
+ *   0                      superblock
+ *   1 .. FS_DISK_ENTRY_BLOCKS   entry table, slot i = fs_entries[i]
+ *   FS_DISK_DATA_START ..       fs blocks, FS_BLOCK_SIZE each, by number
+ *   FS_DISK_JOURNAL_START ..    write-ahead journal (journal.c)
+ *
+ * Slot and block numbers are the same on disk as in memory, so entries
+ * and block maps are stored as they are and mounting needs no
+ * translation. Only slots below super.entry_slots have ever been written;
+ * the rest of the table is treated as empty. Mounting caps the in-memory
+ * table at FS_DISK_MAX_ENTRIES (fs_entry_limit), so creating an entry the
+ * disk could not hold fails up front.
+ *
+ * Files still backed by the boot image are stored as a flag and a size
+ * only, and found again in the image by path at mount. If the image no
+ * longer has them, they come back empty.
+ *
+ * fs_sync() rebuilds each entry block in the cache and dirties it only if
+ * it changed, and copies the blocks fsblock.c marked dirty. Nothing is
+ * committed until all of it is staged (the cache borrows buffers for a
+ * large sync); then everything goes to the journal as one group, which
+ * replay applies whole or not at all. So a crash leaves the disk as of one
+ * sync or the next and never in between; the home blocks are written
+ * later by the cache or at a journal checkpoint. The journal and the
+ * cache can hold a sync that rewrites every block. Mounting replays the
+ * journal before it looks at the superblock.
+ */
+
+#define FS_DISK_MAGIC        0x53464E45u    /* "ENFS" */
+#define FS_DISK_VERSION      2
+#define FS_DISK_ENTRY_SIZE   128
+#define FS_DISK_MAX_ENTRIES  8192
+#define FS_DISK_PER_BLOCK    (BCACHE_BLOCK_SIZE / FS_DISK_ENTRY_SIZE)
+#define FS_DISK_ENTRY_START  1
+#define FS_DISK_ENTRY_BLOCKS (FS_DISK_MAX_ENTRIES / FS_DISK_PER_BLOCK)
+#define FS_DISK_DATA_START   (FS_DISK_ENTRY_START + FS_DISK_ENTRY_BLOCKS)
+#define FS_DISK_FS_PER_BLOCK (BCACHE_BLOCK_SIZE / FS_BLOCK_SIZE)
+#define FS_DISK_DATA_BLOCKS  (65536u / FS_DISK_FS_PER_BLOCK)   /* every fs_blkno_t */
+#define FS_DISK_JOURNAL_START (FS_DISK_DATA_START + FS_DISK_DATA_BLOCKS)
+#define FS_DISK_JOURNAL_BLOCKS 2560u
+#define FS_DISK_BLOCKS       (FS_DISK_JOURNAL_START + FS_DISK_JOURNAL_BLOCKS)
+
+/* The largest sync: the superblock, the whole entry table, every block. */
+#define FS_DISK_SYNC_MAX     (1 + FS_DISK_ENTRY_BLOCKS + FS_DISK_DATA_BLOCKS)
+_Static_assert(JOURNAL_GROUP_SIZE(FS_DISK_SYNC_MAX) < FS_DISK_JOURNAL_BLOCKS,
+               "a full sync fits the journal as one group");
+_Static_assert(FS_DISK_SYNC_MAX + BCACHE_READAHEAD <= BCACHE_MAX_BUFFERS,
+               "a full sync can be staged in the cache");
+
+typedef struct fs_disk_super {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_start;
+    uint32_t entry_blocks;
+    uint32_t entry_slots;       /* slots written so far */
+    uint32_t data_start;
+    uint32_t data_blocks;
+    uint32_t journal_start;
+    uint32_t journal_blocks;
+} fs_disk_super_t;
+
+typedef struct fs_disk_entry {
+    uint8_t  used;
+    uint8_t  is_dir;
+    uint8_t  in_image;
+    uint8_t  reserved;
+    uint32_t size;
+    int32_t  parent;
+    int32_t  first_child;
+    int32_t  next_sibling;
+    int32_t  prev_sibling;
+    char     name[ENIXNEL_MAX_NAME_LEN + 1];
+    uint8_t  data[FS_INLINE_SIZE];      /* inline bytes or the block map */
+    uint8_t  pad[FS_DISK_ENTRY_SIZE - 24 - (ENIXNEL_MAX_NAME_LEN + 1) - FS_INLINE_SIZE];
+} fs_disk_entry_t;
+
+_Static_assert(sizeof(fs_disk_entry_t) == FS_DISK_ENTRY_SIZE, "disk entry size");
+
+static int      fs_disk_on = 0;
+static uint32_t fs_disk_slots = 0;      /* super.entry_slots as on disk */
+
+static void fs_disk_pack(int idx, fs_disk_entry_t* d)
+{
+    const fs_entry_t* e = &fs_entries[idx];
+    memset(d, 0, sizeof(*d));
+    if (!e->used) {
+        return;
+    }
+    d->used = 1;
+    d->is_dir = e->is_dir;
+    d->size = e->size;
+    d->parent = e->parent;
+    d->first_child = e->first_child;
+    d->next_sibling = e->next_sibling;
+    d->prev_sibling = e->prev_sibling;
+    memcpy(d->name, fs_name_str(e->name), fs_name_len(e->name));
+    if (e->in_image) {
+        d->in_image = 1;    /* the pointer means nothing after a reboot */
+    } else {
+        memcpy(d->data, &e->data, sizeof(d->data));
+    }
+}
+
+static int fs_disk_unpack(int idx, const fs_disk_entry_t* d)
+{
+    size_t len = 0;
+    while (len < ENIXNEL_MAX_NAME_LEN && d->name[len]) {
+        ++len;
+    }
+    uint32_t name = idx == FS_ROOT_INDEX ? FS_NAME_EMPTY : fs_name_intern(d->name, len);
+    if (name == FS_NAME_NONE) {
+        return -1;
+    }
+
+    fs_entry_t* e = &fs_entries[idx];
+    e->used = 1;
+    e->is_dir = d->is_dir;
+    e->in_image = d->in_image;
+    e->size = d->size;
+    e->parent = d->parent;
+    e->first_child = d->first_child;
+    e->next_sibling = d->next_sibling;
+    e->prev_sibling = d->prev_sibling;
+    e->name = name;
+    memcpy(&e->data, d->data, sizeof(e->data));
+    return 0;
+}
+
+/* A link is valid if it is FS_NONE or inside the table written so far. */
+static int fs_disk_link_ok(int32_t link, uint32_t slots)
+{
+    return link == FS_NONE || (link >= 0 && (uint32_t)link < slots);
+}
+
+/* ---------- Superblock ---------- */
+
+static int fs_disk_write_super(uint32_t slots)
+{
+    bcache_buf_t* b = bcache_get_zero(0);
+    if (!b) {
+        return -1;
+    }
+    fs_disk_super_t* sb = (fs_disk_super_t*)b->data;
+    sb->magic = FS_DISK_MAGIC;
+    sb->version = FS_DISK_VERSION;
+    sb->entry_start = FS_DISK_ENTRY_START;
+    sb->entry_blocks = FS_DISK_ENTRY_BLOCKS;
+    sb->entry_slots = slots;
+    sb->data_start = FS_DISK_DATA_START;
+    sb->data_blocks = FS_DISK_DATA_BLOCKS;
+    sb->journal_start = FS_DISK_JOURNAL_START;
+    sb->journal_blocks = FS_DISK_JOURNAL_BLOCKS;
+    bcache_mark_dirty(b);
+    bcache_release(b);
+    fs_disk_slots = slots;
+    return 0;
+}
+
+static int fs_disk_super_ok(const fs_disk_super_t* sb)
+{
+    return sb->magic == FS_DISK_MAGIC && sb->version == FS_DISK_VERSION &&
+           sb->entry_start == FS_DISK_ENTRY_START &&
+           sb->entry_blocks == FS_DISK_ENTRY_BLOCKS &&
+           sb->entry_slots <= FS_DISK_MAX_ENTRIES &&
+           sb->entry_slots % FS_DISK_PER_BLOCK == 0 &&
+           sb->data_start == FS_DISK_DATA_START &&
+           sb->data_blocks == FS_DISK_DATA_BLOCKS &&
+           sb->journal_start == FS_DISK_JOURNAL_START &&
+           sb->journal_blocks == FS_DISK_JOURNAL_BLOCKS;
+}
+
+/* ---------- Mount ---------- */
+
+/* Point a loaded boot image file back at its bytes, or empty it. */
+static void fs_disk_rebind_image(int idx)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    char path[INITRD_PATH_MAX];
+    int len = fs_build_path(idx, path, sizeof(path));
+    const initrd_entry_t* ie = len > 0 ? initrd_find(path, (size_t)len) : 0;
+
+    if (ie && !(ie->flags & INITRD_DIR) && ie->size == e->size) {
+        e->data.image = (const uint8_t*)initrd_data(ie);
+        return;
+    }
+    e->in_image = 0;
+    e->size = 0;
+    memset(&e->data, 0, sizeof(e->data));
+}
+
+static int fs_disk_load_block(fs_blkno_t blk)
+{
+    /* Shared with a file loaded before: what it lists is counted already. */
+    if (fs_block_share(blk) == 0) {
+        return 1;
+    }
+    bcache_buf_t* b = bcache_read(FS_DISK_DATA_START + blk / FS_DISK_FS_PER_BLOCK);
+    if (!b) {
+        return -1;
+    }
+    int rc = fs_block_load(blk, b->data + (blk % FS_DISK_FS_PER_BLOCK) * FS_BLOCK_SIZE);
+    bcache_release(b);
+    return rc;
+}
+
+/* Read the entry table into fs_entries[], checking every link. */
+static int fs_disk_load_entries(uint32_t slots)
+{
+    for (uint32_t blk = 0; blk < slots / FS_DISK_PER_BLOCK; ++blk) {
+        bcache_buf_t* b = bcache_read(FS_DISK_ENTRY_START + blk);
+        if (!b) {
+            return -1;
+        }
+        const fs_disk_entry_t* d = (const fs_disk_entry_t*)b->data;
+        for (uint32_t k = 0; k < FS_DISK_PER_BLOCK; ++k, ++d) {
+            int idx = (int)(blk * FS_DISK_PER_BLOCK + k);
+            if (!d->used) {
+                continue;
+            }
+            if (!fs_disk_link_ok(d->parent, slots) || !fs_disk_link_ok(d->first_child, slots) ||
+                !fs_disk_link_ok(d->next_sibling, slots) || !fs_disk_link_ok(d->prev_sibling, slots) ||
+                (idx == FS_ROOT_INDEX) != (d->parent == FS_NONE) ||
+                fs_entries_reserve(idx + 1) != 0 || fs_disk_unpack(idx, d) != 0) {
+                bcache_release(b);
+                return -1;
+            }
+            if (idx != FS_ROOT_INDEX) {
+                fs_entry_mark_used(idx);
+            }
+        }
+        bcache_release(b);
+    }
+    return fs_entries[FS_ROOT_INDEX].used && fs_entries[FS_ROOT_INDEX].is_dir ? 0 : -1;
+}
+
+int fs_mount(int* formatted)
+{
+    *formatted = 0;
+    if (bcache_block_count() < FS_DISK_BLOCKS) {
+        return -1;      /* no disk, or too small for the layout */
+    }
+
+    /* Finish the last interrupted sync; even the superblock may be in there. */
+    if (journal_init(FS_DISK_JOURNAL_START, FS_DISK_JOURNAL_BLOCKS) != 0 ||
+        journal_replay() != 0) {
+        return -1;
+    }
+
+    bcache_buf_t* b = bcache_read(0);
+    if (!b) {
+        return -1;
+    }
+    fs_disk_super_t sb = *(const fs_disk_super_t*)b->data;
+    bcache_release(b);
+
+    if (!fs_disk_super_ok(&sb)) {
+        /* Nothing of ours on it: start empty, written at the next sync. */
+        if (fs_disk_write_super(0) != 0) {
+            return -1;
+        }
+        *formatted = 1;
+        fs_entry_limit = FS_DISK_MAX_ENTRIES;
+        fs_disk_on = 1;
+        return 0;
+    }
+
+    if (fs_disk_load_entries(sb.entry_slots) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < fs_entry_capacity; ++i) {
+        fs_entry_t* e = &fs_entries[i];
+        if (!e->used) {
+            continue;
+        }
+        if (i != FS_ROOT_INDEX) {
+            e->hash = fs_name_hash(e->parent, fs_name_str(e->name), fs_name_len(e->name));
+            fs_index_insert(i);
+        }
+        if (e->in_image) {
+            fs_disk_rebind_image(i);
+        }
+        if (fs_file_for_each_block(i, fs_disk_load_block) != 0) {
+            return -1;
+        }
+    }
+    fs_block_load_done();
+
+    /* Loading marked nothing dirty; the disk already matches memory. */
+    fs_disk_slots = sb.entry_slots;
+    fs_entry_limit = FS_DISK_MAX_ENTRIES;
+    fs_disk_on = 1;
+    return 0;
+}
+
+int fs_disk_mounted(void)
+{
+    return fs_disk_on;
+}
+
+/* ---------- Write-back ---------- */
+
+static int fs_disk_store_block(fs_blkno_t blk, const uint8_t* data)
+{
+    bcache_buf_t* b = bcache_read(FS_DISK_DATA_START + blk / FS_DISK_FS_PER_BLOCK);
+    if (!b) {
+        return -1;
+    }
+    memcpy(b->data + (blk % FS_DISK_FS_PER_BLOCK) * FS_BLOCK_SIZE, data, FS_BLOCK_SIZE);
+    bcache_mark_dirty(b);
+    bcache_release(b);
+    return 0;
+}
+
+/* Refresh the cached entry table from fs_entries[]. */
+static int fs_disk_store_entries(void)
+{
+    uint32_t slots = (uint32_t)fs_entry_capacity;
+    int rc = 0;
+    if (slots > FS_DISK_MAX_ENTRIES) {
+        slots = FS_DISK_MAX_ENTRIES;    /* fs_entry_limit should prevent this */
+        rc = -1;
+    }
+
+    for (uint32_t blk = 0; blk < slots / FS_DISK_PER_BLOCK; ++blk) {
+        /* Blocks past what the disk has seen get written in full. */
+        int fresh = blk * FS_DISK_PER_BLOCK >= fs_disk_slots;
+        bcache_buf_t* b = fresh ? bcache_get_zero(FS_DISK_ENTRY_START + blk)
+                                : bcache_read(FS_DISK_ENTRY_START + blk);
+        if (!b) {
+            return -1;
+        }
+        fs_disk_entry_t d;
+        for (uint32_t k = 0; k < FS_DISK_PER_BLOCK; ++k) {
+            uint8_t* slot = b->data + k * FS_DISK_ENTRY_SIZE;
+            fs_disk_pack((int)(blk * FS_DISK_PER_BLOCK + k), &d);
+            if (memcmp(slot, &d, sizeof(d)) != 0) {
+                memcpy(slot, &d, sizeof(d));
+                bcache_mark_dirty(b);
+            }
+        }
+        if (fresh) {
+            bcache_mark_dirty(b);
+        }
+        bcache_release(b);
+    }
+
+    if (slots > fs_disk_slots && fs_disk_write_super(slots) != 0) {
+        return -1;
+    }
+    return rc;
+}
+
+int fs_sync(void)
+{
+    if (!fs_disk_on) {
+        return 0;
+    }
+    /* A sync only half staged is not committed: what was staged stays
+     * pending in the cache and goes out with the rest next time. */
+    if (fs_block_drain_dirty(fs_disk_store_block) != 0 ||
+        fs_disk_store_entries() != 0) {
+        return -1;      /* out of memory for the cache, or a read failed */
+    }
+    return journal_commit() < 0 ? -1 : 0;
+}
+
+void fs_sync_thread(void* arg)
+{
+    (void)arg;
+    uint32_t idle_ms = 0;
+    for (;;) {
+        thread_sleep_ms(FS_SYNC_POLL_MS);
+        idle_ms += FS_SYNC_POLL_MS;
+        if (idle_ms < FS_SYNC_INTERVAL_MS && fs_blocks_dirty() < FS_SYNC_DIRTY_BLOCKS) {
+            continue;
+        }
+        mutex_lock(&fs_mutex);
+        fs_sync();
+        mutex_unlock(&fs_mutex);
+        idle_ms = 0;
+    }
+}
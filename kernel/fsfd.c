@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kstat.h"
+#include "string.h"
+
+/*
+ * Open-file descriptors for Enixnel.
+ *
+ * A descriptor is a slot in fs_fds[] holding the entry index resolved
+ * when the file was opened, so positional reads and writes skip path
+ * lookup altogether. Entry indices survive renames and table growth; when
+ * a file is deleted, fs_fd_forget() closes every descriptor still on it
+ * before the slot can be reused.
+ *
+ * Exposed API (declared in fs.h):
+ *
+ *   int fs_open(const char* name, int flags);
+ *   int fs_close(int fd);
+ *   int fs_pread(int fd, void* buf, size_t len, size_t offset);
+ *   int fs_pwrite(int fd, const void* buf, size_t len, size_t offset);
+ *   int fs_fd_size(int fd, size_t* out_size);
+ *   void fs_stream_open(fs_stream_t* s, int fd, size_t offset);
+ *   size_t fs_stream_next(fs_stream_t* s, const char** data);
+ */
+
+static int fs_fds[FS_MAX_OPEN];
+static uint32_t fs_fd_used = 0;         /* bit per slot in fs_fds[] */
+
+_Static_assert(FS_MAX_OPEN <= 32, "fs_fd_used is one word");
+
+/* Entry index behind fd, or -1 if fd is not open. */
+static int fs_fd_entry(int fd)
+{
+    if (fd < 0 || fd >= FS_MAX_OPEN || !(fs_fd_used & (1u << fd))) {
+        return -1;
+    }
+    return fs_fds[fd];
+}
+
+int fs_open(const char* name, int flags)
+{
+    KSTAT_FS(FS_OPEN);
+    if (fs_fd_used == 0xFFFFFFFFu >> (32 - FS_MAX_OPEN)) {
+        return -1;  /* table full */
+    }
+
+    int idx = fs_find_index(name);
+    if (idx < 0) {
+        if (!(flags & FS_O_CREATE) || fs_create_file(name) != 0) {
+            return -1;
+        }
+        idx = fs_find_index(name);
+    }
+    if (fs_entries[idx].is_dir) {
+        return -1;
+    }
+    if ((flags & FS_O_TRUNC) && fs_file_resize(idx, 0) != 0) {
+        return -1;
+    }
+
+    int fd = __builtin_ctz(~fs_fd_used);
+    fs_fd_used |= 1u << fd;
+    fs_fds[fd] = idx;
+    return fd;
+}
+
+int fs_close(int fd)
+{
+    if (fs_fd_entry(fd) < 0) {
+        return -1;
+    }
+    fs_fd_used &= ~(1u << fd);
+    return 0;
+}
+
+void fs_fd_forget(int idx)
+{
+    for (uint32_t open = fs_fd_used; open; open &= open - 1) {
+        int fd = __builtin_ctz(open);
+        if (fs_fds[fd] == idx) {
+            fs_fd_used &= ~(1u << fd);
+        }
+    }
+}
+
+int fs_pread(int fd, void* buf, size_t len, size_t offset)
+{
+    KSTAT_FS(FS_PREAD);
+    int idx = fs_fd_entry(fd);
+    if (idx < 0 || (!buf && len > 0)) {
+        return -1;
+    }
+    if (len > 0x7FFFFFFFu) {
+        len = 0x7FFFFFFFu;      /* the count must fit the return value */
+    }
+    return (int)fs_file_read(idx, offset, buf, len);
+}
+
+int fs_pwrite(int fd, const void* buf, size_t len, size_t offset)
+{
+    KSTAT_FS(FS_PWRITE);
+    int idx = fs_fd_entry(fd);
+    if (idx < 0 || (!buf && len > 0) || offset > ENIXNEL_MAX_FILE_SIZE ||
+        len > ENIXNEL_MAX_FILE_SIZE - offset) {
+        return -1;
+    }
+
+    /* Writing past the end grows the file first; any gap reads as zeros. */
+    if (offset + len > fs_entries[idx].size && fs_file_resize(idx, offset + len) != 0) {
+        return -1;
+    }
+    if (fs_file_write(idx, offset, buf, len) != 0) {
+        return -1;
+    }
+    return (int)len;
+}
+
+int fs_fd_size(int fd, size_t* out_size)
+{
+    int idx = fs_fd_entry(fd);
+    if (idx < 0) {
+        return -1;
+    }
+    if (out_size) {
+        *out_size = fs_entries[idx].size;
+    }
+    return 0;
+}
+
+/* ---------- Streaming reads ---------- */
+
+void fs_stream_open(fs_stream_t* s, int fd, size_t offset)
+{
+    s->fd = fd;
+    s->offset = offset;
+}
+
+size_t fs_stream_next(fs_stream_t* s, const char** data)
+{
+    int idx = fs_fd_entry(s->fd);
+    if (idx < 0) {
+        return 0;
+    }
+    const uint8_t* p;
+    size_t n = fs_file_span(idx, s->offset, &p);
+    s->offset += n;
+    *data = (const char*)p;
+    return n;
+}
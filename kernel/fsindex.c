@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kmalloc.h"
+#include "string.h"
+
+/*
+ * Hash index over fs_entries[] for Enixnel.
+ *
+ * Open addressing with linear probing, keyed on (parent index, component
+ * name). Keying on the parent rather than the full path means moving a
+ * directory only rehashes the directory itself, never its descendants.
+ * Each slot carries the entry's hash next to its table index, so a probe
+ * only touches the entry itself when the hashes already match.
+ *
+ * Deletions use backward-shift instead of tombstones, so probe chains
+ * never degrade no matter how many create/delete cycles we go through.
+ *
+ * Inserting and removing also maintain the by-name entry lists
+ * (fs_name_link), so every path that indexes an entry keeps those too.
+ *
+ * The slot count is always the next power of two of twice the entry
+ * table's capacity, so the load factor stays <= 0.5. It starts at
+ * ENIXNEL_FS_INDEX_SLOTS in .bss and is rebuilt on the kernel heap by
+ * fs_index_resize() whenever the entry table grows.
+ */
+
+#define FS_INDEX_EMPTY (-1)
+#define FS_INDEX_MASK  fs_index_mask
+
+typedef struct fs_index_slot {
+    uint32_t hash;
+    int32_t  idx;   /* index into fs_entries[], or FS_INDEX_EMPTY */
+} fs_index_slot_t;
+
+static fs_index_slot_t  fs_index_initial[ENIXNEL_FS_INDEX_SLOTS];
+static fs_index_slot_t* fs_index_slots = fs_index_initial;
+static uint32_t         fs_index_mask = ENIXNEL_FS_INDEX_SLOTS - 1;
+
+static void fs_index_clear(fs_index_slot_t* slots, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        slots[i].hash = 0;
+        slots[i].idx = FS_INDEX_EMPTY;
+    }
+}
+
+/* Mark every slot empty (.bss is zero, and 0 is a valid index). */
+void fs_index_init(void)
+{
+    fs_index_clear(fs_index_slots, fs_index_mask + 1);
+}
+
+/* Reinsert every slot into a table sized for entry_capacity entries.
+ * Slots carry their hash, so the entries themselves are not touched.
+ */
+int fs_index_resize(int entry_capacity)
+{
+    uint32_t count = 1;
+    while (count < 2u * (uint32_t)entry_capacity) {
+        count <<= 1;
+    }
+    if (count <= fs_index_mask + 1) {
+        return 0;
+    }
+
+    fs_index_slot_t* slots = (fs_index_slot_t*)kmalloc(count * sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    fs_index_clear(slots, count);
+
+    uint32_t mask = count - 1;
+    for (uint32_t i = 0; i <= fs_index_mask; ++i) {
+        if (fs_index_slots[i].idx == FS_INDEX_EMPTY) {
+            continue;
+        }
+        uint32_t pos = fs_index_slots[i].hash & mask;
+        while (slots[pos].idx != FS_INDEX_EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = fs_index_slots[i];
+    }
+
+    if (fs_index_slots != fs_index_initial) {
+        kfree(fs_index_slots);
+    }
+    fs_index_slots = slots;
+    fs_index_mask = mask;
+    return 0;
+}
+
+/* 32-bit FNV-1a over the parent index bytes, then the component. */
+uint32_t fs_name_hash(int parent, const char* name, size_t len)
+{
+    uint32_t h = 2166136261u;
+    uint32_t p = (uint32_t)parent;
+    for (int i = 0; i < 4; ++i) {
+        h ^= (p >> (i * 8)) & 0xFF;
+        h *= 16777619u;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Compare an interned entry name with a length-delimited component. */
+static int fs_name_equal(uint32_t entry_name, const char* name, size_t len)
+{
+    return fs_name_len(entry_name) == len && memcmp(fs_name_str(entry_name), name, len) == 0;
+}
+
+int fs_index_lookup(int parent, const char* name, size_t len, uint32_t hash)
+{
+    if (!name) {
+        return -1;
+    }
+
+    uint32_t pos = hash & FS_INDEX_MASK;
+    for (;;) {
+        const fs_index_slot_t* s = &fs_index_slots[pos];
+        if (s->idx == FS_INDEX_EMPTY) {
+            return -1;
+        }
+        if (s->hash == hash) {
+            const fs_entry_t* e = &fs_entries[s->idx];
+            if (e->parent == parent && fs_name_equal(e->name, name, len)) {
+                return s->idx;
+            }
+        }
+        pos = (pos + 1) & FS_INDEX_MASK;
+    }
+}
+
+void fs_index_insert(int idx)
+{
+    uint32_t hash = fs_entries[idx].hash;
+    uint32_t pos = hash & FS_INDEX_MASK;
+
+    /* Load factor <= 0.5, so there is always an empty slot. */
+    while (fs_index_slots[pos].idx != FS_INDEX_EMPTY) {
+        pos = (pos + 1) & FS_INDEX_MASK;
+    }
+
+    fs_index_slots[pos].hash = hash;
+    fs_index_slots[pos].idx = idx;
+    fs_name_link(idx);
+}
+
+void fs_index_remove(int idx)
+{
+    uint32_t pos = fs_entries[idx].hash & FS_INDEX_MASK;
+    while (fs_index_slots[pos].idx != idx) {
+        if (fs_index_slots[pos].idx == FS_INDEX_EMPTY) {
+            return; /* not indexed */
+        }
+        pos = (pos + 1) & FS_INDEX_MASK;
+    }
+    fs_name_unlink(idx);
+
+    /*
+     * Backward-shift: pull later members of the probe chain into the
+     * hole whenever their home slot does not lie in (hole, current].
+     */
+    uint32_t hole = pos;
+    uint32_t next = (hole + 1) & FS_INDEX_MASK;
+    while (fs_index_slots[next].idx != FS_INDEX_EMPTY) {
+        uint32_t home = fs_index_slots[next].hash & FS_INDEX_MASK;
+        if (((next - home) & FS_INDEX_MASK) >= ((next - hole) & FS_INDEX_MASK)) {
+            fs_index_slots[hole] = fs_index_slots[next];
+            hole = next;
+        }
+        next = (next + 1) & FS_INDEX_MASK;
+    }
+
+    fs_index_slots[hole].hash = 0;
+    fs_index_slots[hole].idx = FS_INDEX_EMPTY;
+}
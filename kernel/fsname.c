@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kmalloc.h"
+#include "string.h"
+
+/*
+ * Interned path components for Enixnel.
+ *
+ * Every distinct component name is stored once, in the byte arena
+ * fs_name_bytes[] as a length byte, the characters and a NUL, and is
+ * known by a small integer ID. fs_names[id] records where its bytes are,
+ * its hash and how many entries use it; IDs with the same hash are
+ * chained from fs_name_heads[]. Entries hold only the ID, so a thousand
+ * files called "README" share eleven bytes.
+ *
+ * When the last reference goes, the ID returns to a free list and its
+ * bytes become garbage. Once garbage is more than half the arena, the
+ * live names are copied down; IDs do not change, only their offsets.
+ * The three tables start in .bss and double through kmalloc(), like the
+ * entry table.
+ *
+ * Every name is also in the prefix trie (kernel/fstrie.c) while it is
+ * in use, and heads the list of the entries that carry it.
+ *
+ * ID 0 is "", the root's name, and is never freed.
+ *
+ * Exposed API (declared in fs.h):
+ *
+ *   void        fs_name_init(void);
+ *   uint32_t    fs_name_intern(const char* s, size_t len);
+ *   void        fs_name_release(uint32_t id);
+ *   const char* fs_name_str(uint32_t id);
+ *   size_t      fs_name_len(uint32_t id);
+ *   void        fs_name_link(int idx);
+ *   void        fs_name_unlink(int idx);
+ *   int         fs_name_first(uint32_t id);
+ */
+
+#define FS_NAME_MIN_IDS   256u
+#define FS_NAME_MIN_BYTES 4096u
+#define FS_NAME_END       0xFFFFFFFFu   /* end of a hash chain or free list */
+
+typedef struct fs_name {
+    uint32_t off;       /* record in fs_name_bytes[]; next free ID when unused */
+    uint32_t hash;
+    uint32_t next;      /* next ID in the same bucket */
+    uint32_t refs;      /* 0 = free */
+    int32_t  first;     /* first entry with this name, FS_NONE if none */
+    uint32_t node;      /* where it ends in the trie */
+} fs_name_t;
+
+static fs_name_t  fs_names_initial[FS_NAME_MIN_IDS];
+static uint32_t   fs_name_heads_initial[FS_NAME_MIN_IDS];
+static char       fs_name_bytes_initial[FS_NAME_MIN_BYTES];
+
+static fs_name_t* fs_names = fs_names_initial;
+static uint32_t*  fs_name_heads = fs_name_heads_initial;  /* one per ID slot */
+static char*      fs_name_bytes = fs_name_bytes_initial;
+static uint32_t   fs_name_cap = FS_NAME_MIN_IDS;
+static uint32_t   fs_name_bytes_cap = FS_NAME_MIN_BYTES;
+static uint32_t   fs_name_bytes_used = 0;
+static uint32_t   fs_name_garbage = 0;
+static uint32_t   fs_name_next_id = 0;      /* IDs below this have been handed out */
+static uint32_t   fs_name_free = FS_NAME_END;
+
+/* FNV-1a over the component. */
+static uint32_t fs_name_hash_bytes(const char* s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t fs_name_record_size(uint32_t len)
+{
+    return len + 2;     /* length byte, characters, NUL */
+}
+
+/* Rebuild the chains for `cap` buckets. */
+static void fs_name_rehash(uint32_t* heads, uint32_t cap)
+{
+    for (uint32_t i = 0; i < cap; ++i) {
+        heads[i] = FS_NAME_END;
+    }
+    for (uint32_t id = 0; id < fs_name_next_id; ++id) {
+        if (fs_names[id].refs) {
+            uint32_t b = fs_names[id].hash & (cap - 1);
+            fs_names[id].next = heads[b];
+            heads[b] = id;
+        }
+    }
+}
+
+void fs_name_init(void)
+{
+    fs_name_bytes_used = 0;
+    fs_name_garbage = 0;
+    fs_name_next_id = 1;
+    fs_name_free = FS_NAME_END;
+
+    /* ID 0: "" for the root, pinned with a reference that is never dropped. */
+    fs_names[0].off = 0;
+    fs_names[0].hash = fs_name_hash_bytes("", 0);
+    fs_names[0].refs = 1;
+    fs_names[0].first = FS_NONE;
+    fs_name_bytes[0] = 0;
+    fs_name_bytes[1] = '\0';
+    fs_name_bytes_used = fs_name_record_size(0);
+    fs_name_rehash(fs_name_heads, fs_name_cap);
+    fs_trie_init();
+}
+
+static int fs_name_grow_ids(void)
+{
+    uint32_t cap = fs_name_cap * 2;
+    fs_name_t* names = (fs_name_t*)kmalloc(cap * sizeof(fs_name_t));
+    uint32_t* heads = (uint32_t*)kmalloc(cap * sizeof(uint32_t));
+    if (!names || !heads) {
+        kfree(names);
+        kfree(heads);
+        return -1;
+    }
+    memcpy(names, fs_names, fs_name_cap * sizeof(fs_name_t));
+    if (fs_names != fs_names_initial) {
+        kfree(fs_names);
+    }
+    if (fs_name_heads != fs_name_heads_initial) {
+        kfree(fs_name_heads);
+    }
+    fs_names = names;
+    fs_name_heads = heads;
+    fs_name_cap = cap;
+    fs_name_rehash(fs_name_heads, fs_name_cap);
+    return 0;
+}
+
+/*
+ * Make room for `need` more arena bytes: copy the live names into a
+ * buffer big enough for them plus need, leaving the garbage behind.
+ */
+static int fs_name_repack(uint32_t need)
+{
+    uint32_t live = fs_name_bytes_used - fs_name_garbage;
+    uint32_t cap = fs_name_bytes_cap;
+    while (cap < 2 * (live + need)) {
+        cap *= 2;
+    }
+
+    char* bytes = (char*)kmalloc(cap);
+    if (!bytes) {
+        return -1;
+    }
+    uint32_t used = 0;
+    for (uint32_t id = 0; id < fs_name_next_id; ++id) {
+        if (fs_names[id].refs) {
+            const char* rec = fs_name_bytes + fs_names[id].off;
+            uint32_t size = fs_name_record_size((uint8_t)rec[0]);
+            memcpy(bytes + used, rec, size);
+            fs_names[id].off = used;
+            used += size;
+        }
+    }
+    if (fs_name_bytes != fs_name_bytes_initial) {
+        kfree(fs_name_bytes);
+    }
+    fs_name_bytes = bytes;
+    fs_name_bytes_cap = cap;
+    fs_name_bytes_used = used;
+    fs_name_garbage = 0;
+    return 0;
+}
+
+uint32_t fs_name_intern(const char* s, size_t len)
+{
+    if (len > ENIXNEL_MAX_NAME_LEN) {
+        return FS_NAME_NONE;
+    }
+
+    uint32_t hash = fs_name_hash_bytes(s, len);
+    for (uint32_t id = fs_name_heads[hash & (fs_name_cap - 1)]; id != FS_NAME_END;
+         id = fs_names[id].next) {
+        const char* rec = fs_name_bytes + fs_names[id].off;
+        if (fs_names[id].hash == hash && (uint8_t)rec[0] == len && memcmp(rec + 1, s, len) == 0) {
+            ++fs_names[id].refs;
+            return id;
+        }
+    }
+
+    /* New name: an ID, then its bytes. */
+    if (fs_name_free == FS_NAME_END && fs_name_next_id == fs_name_cap &&
+        fs_name_grow_ids() != 0) {
+        return FS_NAME_NONE;
+    }
+    uint32_t size = fs_name_record_size((uint32_t)len);
+    if (fs_name_bytes_used + size > fs_name_bytes_cap && fs_name_repack(size) != 0) {
+        return FS_NAME_NONE;
+    }
+
+    uint32_t id = (fs_name_free != FS_NAME_END) ? fs_name_free : fs_name_next_id;
+    uint32_t node;
+    if (fs_trie_insert(id, s, len, &node) != 0) {
+        return FS_NAME_NONE;
+    }
+    if (id == fs_name_free) {
+        fs_name_free = fs_names[id].off;
+    } else {
+        ++fs_name_next_id;
+    }
+
+    char* rec = fs_name_bytes + fs_name_bytes_used;
+    rec[0] = (char)len;
+    memcpy(rec + 1, s, len);
+    rec[len + 1] = '\0';
+
+    fs_name_t* n = &fs_names[id];
+    n->off = fs_name_bytes_used;
+    n->hash = hash;
+    n->refs = 1;
+    n->first = FS_NONE;
+    n->node = node;
+    n->next = fs_name_heads[hash & (fs_name_cap - 1)];
+    fs_name_heads[hash & (fs_name_cap - 1)] = id;
+    fs_name_bytes_used += size;
+    return id;
+}
+
+void fs_name_release(uint32_t id)
+{
+    fs_name_t* n = &fs_names[id];
+    if (id == FS_NAME_EMPTY || n->refs == 0 || --n->refs > 0) {
+        return;
+    }
+
+    /* Unchain it, recycle the ID and count its bytes as garbage. */
+    fs_trie_remove(n->node);
+    uint32_t* link = &fs_name_heads[n->hash & (fs_name_cap - 1)];
+    while (*link != id) {
+        link = &fs_names[*link].next;
+    }
+    *link = n->next;
+
+    fs_name_garbage += fs_name_record_size((uint8_t)fs_name_bytes[n->off]);
+    n->off = fs_name_free;
+    fs_name_free = id;
+
+    /* Shrinking in place needs no memory; a failed repack just waits. */
+    if (fs_name_garbage > FS_NAME_MIN_BYTES && fs_name_garbage * 2 > fs_name_bytes_used) {
+        fs_name_repack(0);
+    }
+}
+
+const char* fs_name_str(uint32_t id)
+{
+    return fs_name_bytes + fs_names[id].off + 1;
+}
+
+size_t fs_name_len(uint32_t id)
+{
+    return (uint8_t)fs_name_bytes[fs_names[id].off];
+}
+
+/* ---------- Entries by name ---------- */
+
+void fs_name_link(int idx)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    fs_name_t* n = &fs_names[e->name];
+    e->name_prev = FS_NONE;
+    e->name_next = n->first;
+    if (n->first != FS_NONE) {
+        fs_entries[n->first].name_prev = idx;
+    }
+    n->first = idx;
+}
+
+void fs_name_unlink(int idx)
+{
+    fs_entry_t* e = &fs_entries[idx];
+    if (e->name_prev != FS_NONE) {
+        fs_entries[e->name_prev].name_next = e->name_next;
+    } else {
+        fs_names[e->name].first = e->name_next;
+    }
+    if (e->name_next != FS_NONE) {
+        fs_entries[e->name_next].name_prev = e->name_prev;
+    }
+    e->name_next = FS_NONE;
+    e->name_prev = FS_NONE;
+}
+
+int fs_name_first(uint32_t id)
+{
+    return fs_names[id].first;
+}
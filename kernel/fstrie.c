@@ -0,0 +1,261 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kmalloc.h"
+#include "string.h"
+
+/*
+ * Prefix trie over the interned component names for Enixnel.
+ *
+ * One node per byte of a name, shared between names with a common
+ * prefix. Each node lists its children through first_child/next_sibling
+ * in byte order, so walking a subtree visits names sorted bytewise, and a
+ * node where a name ends carries that name's ID. The names themselves
+ * come and go with kernel/fsname.c: fs_trie_insert() when a name is first
+ * interned, fs_trie_remove() when its last reference goes, which also
+ * prunes the nodes no other name needs. The name keeps the node it ends
+ * at, and nodes point at their parent, so removing walks up from there
+ * instead of down again from the root.
+ *
+ * Every entry is reachable from its name (fs_name_first(), then
+ * fs_entry_t.name_next), so answering "which entries are called p..."
+ * costs the nodes under p plus the matches, independent of how many
+ * entries there are in all.
+ *
+ * Nodes live in one array that starts in .bss and doubles through
+ * kmalloc(), like the entry table; free nodes are chained through
+ * first_child. Node 0 is the root (the empty prefix).
+ *
+ * Exposed API (declared in fs.h):
+ *
+ *   void fs_trie_init(void);
+ *   int  fs_trie_insert(uint32_t name, const char* s, size_t len, uint32_t* node);
+ *   void fs_trie_remove(uint32_t node);
+ *   int  fs_trie_walk(const char* prefix, size_t len, fs_name_fn fn, void* ctx);
+ *   int  fs_find_names(const char* pattern, fs_name_fn fn, void* ctx);
+ */
+
+#define FS_TRIE_MIN_NODES 512u
+#define FS_TRIE_END       0xFFFFFFFFu
+
+typedef struct fs_trie_node {
+    uint32_t first_child;   /* FS_TRIE_END if none; next free node when unused */
+    uint32_t next_sibling;  /* next child of the same parent, larger byte */
+    uint32_t parent;
+    uint32_t name;          /* name ending here, or FS_NAME_NONE */
+    uint8_t  ch;            /* byte leading here from the parent */
+} fs_trie_node_t;
+
+static fs_trie_node_t  fs_trie_initial[FS_TRIE_MIN_NODES];
+static fs_trie_node_t* fs_trie = fs_trie_initial;
+static uint32_t        fs_trie_cap = FS_TRIE_MIN_NODES;
+static uint32_t        fs_trie_next = 0;    /* nodes below this have been used */
+static uint32_t        fs_trie_free = FS_TRIE_END;
+static uint32_t        fs_trie_free_count = 0;
+
+void fs_trie_init(void)
+{
+    fs_trie_next = 1;
+    fs_trie_free = FS_TRIE_END;
+    fs_trie_free_count = 0;
+    fs_trie[0].first_child = FS_TRIE_END;
+    fs_trie[0].next_sibling = FS_TRIE_END;
+    fs_trie[0].parent = FS_TRIE_END;
+    fs_trie[0].name = FS_NAME_NONE;
+    fs_trie[0].ch = 0;
+}
+
+/* Make sure `need` nodes can be taken without failing. */
+static int fs_trie_reserve(uint32_t need)
+{
+    uint32_t cap = fs_trie_cap;
+    while (fs_trie_free_count + (cap - fs_trie_next) < need) {
+        cap *= 2;
+    }
+    if (cap == fs_trie_cap) {
+        return 0;
+    }
+
+    fs_trie_node_t* nodes = (fs_trie_node_t*)kmalloc(cap * sizeof(fs_trie_node_t));
+    if (!nodes) {
+        return -1;
+    }
+    memcpy(nodes, fs_trie, fs_trie_next * sizeof(fs_trie_node_t));
+    if (fs_trie != fs_trie_initial) {
+        kfree(fs_trie);
+    }
+    fs_trie = nodes;
+    fs_trie_cap = cap;
+    return 0;
+}
+
+static uint32_t fs_trie_take(uint32_t parent, uint8_t ch, uint32_t next_sibling)
+{
+    uint32_t n;
+    if (fs_trie_free != FS_TRIE_END) {
+        n = fs_trie_free;
+        fs_trie_free = fs_trie[n].first_child;
+        --fs_trie_free_count;
+    } else {
+        n = fs_trie_next++;
+    }
+    fs_trie[n].first_child = FS_TRIE_END;
+    fs_trie[n].next_sibling = next_sibling;
+    fs_trie[n].parent = parent;
+    fs_trie[n].name = FS_NAME_NONE;
+    fs_trie[n].ch = ch;
+    return n;
+}
+
+/*
+ * The child of node reached by ch, or FS_TRIE_END. *link is left at the
+ * slot that points (or would point) at it, for inserting and unlinking.
+ */
+static uint32_t fs_trie_child(uint32_t node, uint8_t ch, uint32_t** link)
+{
+    uint32_t* l = &fs_trie[node].first_child;
+    while (*l != FS_TRIE_END && fs_trie[*l].ch < ch) {
+        l = &fs_trie[*l].next_sibling;
+    }
+    if (link) {
+        *link = l;
+    }
+    return (*l != FS_TRIE_END && fs_trie[*l].ch == ch) ? *l : FS_TRIE_END;
+}
+
+int fs_trie_insert(uint32_t name, const char* s, size_t len, uint32_t* node_out)
+{
+    if (fs_trie_reserve((uint32_t)len) != 0) {
+        return -1;
+    }
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t* link;
+        uint32_t child = fs_trie_child(node, (uint8_t)s[i], &link);
+        if (child == FS_TRIE_END) {
+            child = fs_trie_take(node, (uint8_t)s[i], *link);
+            *link = child;
+        }
+        node = child;
+    }
+    fs_trie[node].name = name;
+    *node_out = node;
+    return 0;
+}
+
+void fs_trie_remove(uint32_t node)
+{
+    fs_trie[node].name = FS_NAME_NONE;
+
+    /* Prune upwards while a node leads nowhere. */
+    uint32_t n = node;
+    while (n != 0 && fs_trie[n].name == FS_NAME_NONE && fs_trie[n].first_child == FS_TRIE_END) {
+        uint32_t parent = fs_trie[n].parent;
+        uint32_t* link;
+        fs_trie_child(parent, fs_trie[n].ch, &link);
+        *link = fs_trie[n].next_sibling;
+        fs_trie[n].first_child = fs_trie_free;
+        fs_trie_free = n;
+        ++fs_trie_free_count;
+        n = parent;
+    }
+}
+
+/* Call fn for the names in the subtree of start, in byte order. */
+static int fs_trie_walk_from(uint32_t start, fs_name_fn fn, void* ctx)
+{
+    if (fs_trie[start].name != FS_NAME_NONE && fn(fs_trie[start].name, ctx) != 0) {
+        return 1;
+    }
+
+    /* Depth below start is at most a whole name, so the stack is bounded. */
+    uint32_t stack[ENIXNEL_MAX_NAME_LEN + 1];
+    size_t depth = 0;
+    uint32_t n = fs_trie[start].first_child;
+    while (n != FS_TRIE_END) {
+        if (fs_trie[n].name != FS_NAME_NONE && fn(fs_trie[n].name, ctx) != 0) {
+            return 1;
+        }
+        if (fs_trie[n].first_child != FS_TRIE_END) {
+            stack[depth++] = n;
+            n = fs_trie[n].first_child;
+            continue;
+        }
+        while (fs_trie[n].next_sibling == FS_TRIE_END && depth > 0) {
+            n = stack[--depth];
+        }
+        n = fs_trie[n].next_sibling;
+    }
+    return 0;
+}
+
+int fs_trie_walk(const char* prefix, size_t len, fs_name_fn fn, void* ctx)
+{
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; ++i) {
+        node = fs_trie_child(node, (uint8_t)prefix[i], 0);
+        if (node == FS_TRIE_END) {
+            return 0;
+        }
+    }
+    return fs_trie_walk_from(node, fn, ctx);
+}
+
+/* ---------- Glob patterns ---------- */
+
+/* Match a whole name against '*' (any run) and '?' (any one byte). */
+static int fs_glob_match(const char* pat, const char* s, size_t len)
+{
+    const char* star = 0;
+    size_t star_pos = 0;
+    size_t i = 0;
+    while (i < len) {
+        if (*pat == '?' || (*pat && *pat != '*' && *pat == s[i])) {
+            ++pat;
+            ++i;
+        } else if (*pat == '*') {
+            star = pat++;
+            star_pos = i;
+        } else if (star) {
+            pat = star + 1;
+            i = ++star_pos;
+        } else {
+            return 0;
+        }
+    }
+    while (*pat == '*') {
+        ++pat;
+    }
+    return *pat == '\0';
+}
+
+typedef struct fs_glob_ctx {
+    const char* pattern;
+    fs_name_fn  fn;
+    void*       ctx;
+} fs_glob_ctx_t;
+
+static int fs_glob_filter(uint32_t name, void* arg)
+{
+    fs_glob_ctx_t* g = (fs_glob_ctx_t*)arg;
+    if (!fs_glob_match(g->pattern, fs_name_str(name), fs_name_len(name))) {
+        return 0;
+    }
+    return g->fn(name, g->ctx);
+}
+
+int fs_find_names(const char* pattern, fs_name_fn fn, void* ctx)
+{
+    /* The bytes before the first wildcard pick the subtree to search. */
+    size_t lit = 0;
+    while (pattern[lit] && pattern[lit] != '*' && pattern[lit] != '?') {
+        ++lit;
+    }
+    if (pattern[lit] == '\0') {
+        return fs_trie_walk(pattern, lit, fn, ctx);
+    }
+
+    fs_glob_ctx_t g = { pattern, fn, ctx };
+    return fs_trie_walk(pattern, lit, fs_glob_filter, &g);
+}
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "initrd.h"
+#include "fs.h"
+#include "string.h"
+
+/*
+ * Boot image lookup for Enixnel.
+ *
+ * The module stays where GRUB put it (pmm_init() reserves module memory),
+ * and everything here points into it. initrd_init() checks every entry
+ * once, including the sort order, so lookups and initrd_populate() can
+ * trust the table afterwards.
+ */
+
+static const uint8_t*        initrd_base = 0;
+static const initrd_header_t* initrd_hdr = 0;
+static const initrd_entry_t* initrd_table = 0;
+
+static const char* initrd_name(const initrd_entry_t* e)
+{
+    return (const char*)initrd_base + initrd_hdr->names_start + e->name_off;
+}
+
+/* Bytewise order of two paths, like memcmp() over the shorter length and
+ * then the shorter first. */
+static int initrd_compare(const char* a, size_t alen, const char* b, size_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0) {
+        return c;
+    }
+    return (alen > blen) - (alen < blen);
+}
+
+static int initrd_check(const uint8_t* base, uint32_t len)
+{
+    const initrd_header_t* h = (const initrd_header_t*)base;
+    if (len < sizeof(*h) || h->magic != INITRD_MAGIC || h->version != INITRD_VERSION ||
+        h->image_size > len || h->count > (len - sizeof(*h)) / sizeof(initrd_entry_t)) {
+        return -1;
+    }
+    uint32_t table_end = (uint32_t)sizeof(*h) + h->count * (uint32_t)sizeof(initrd_entry_t);
+    if (h->names_start < table_end || h->names_size > h->image_size ||
+        h->names_start > h->image_size - h->names_size ||
+        h->payload_start < h->names_start + h->names_size || h->payload_start > h->image_size) {
+        return -1;
+    }
+
+    const initrd_entry_t* t = (const initrd_entry_t*)(base + sizeof(*h));
+    const char* names = (const char*)base + h->names_start;
+    uint32_t payload_size = h->image_size - h->payload_start;
+    for (uint32_t i = 0; i < h->count; ++i) {
+        const initrd_entry_t* e = &t[i];
+        if (e->name_len == 0 || e->name_len >= INITRD_PATH_MAX ||
+            e->name_off > h->names_size || e->name_len > h->names_size - e->name_off ||
+            e->size > ENIXNEL_MAX_FILE_SIZE ||
+            e->data_off > payload_size || e->size > payload_size - e->data_off) {
+            return -1;
+        }
+        if (i > 0 && initrd_compare(names + t[i - 1].name_off, t[i - 1].name_len,
+                                    names + e->name_off, e->name_len) >= 0) {
+            return -1;      /* not sorted, or a duplicate */
+        }
+    }
+    return 0;
+}
+
+int initrd_init(const multiboot_info_t* mbi)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS)) {
+        return -1;
+    }
+    const multiboot_module_t* mods = (const multiboot_module_t*)mbi->mods_addr;
+    for (uint32_t i = 0; i < mbi->mods_count; ++i) {
+        const uint8_t* base = (const uint8_t*)mods[i].mod_start;
+        if (mods[i].mod_end > mods[i].mod_start &&
+            initrd_check(base, mods[i].mod_end - mods[i].mod_start) == 0) {
+            initrd_base = base;
+            initrd_hdr = (const initrd_header_t*)base;
+            initrd_table = (const initrd_entry_t*)(base + sizeof(initrd_header_t));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint32_t initrd_count(void)
+{
+    return initrd_hdr ? initrd_hdr->count : 0;
+}
+
+uint32_t initrd_size(void)
+{
+    return initrd_hdr ? initrd_hdr->image_size : 0;
+}
+
+const initrd_entry_t* initrd_find(const char* path, size_t len)
+{
+    uint32_t lo = 0;
+    uint32_t hi = initrd_count();
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const initrd_entry_t* e = &initrd_table[mid];
+        int c = initrd_compare(initrd_name(e), e->name_len, path, len);
+        if (c == 0) {
+            return e;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+const void* initrd_data(const initrd_entry_t* e)
+{
+    return initrd_base + initrd_hdr->payload_start + e->data_off;
+}
+
+int initrd_populate(void)
+{
+    int added = 0;
+    char path[INITRD_PATH_MAX];
+    for (uint32_t i = 0; i < initrd_count(); ++i) {
+        const initrd_entry_t* e = &initrd_table[i];
+        memcpy(path, initrd_name(e), e->name_len);
+        path[e->name_len] = '\0';
+
+        int rc = (e->flags & INITRD_DIR) ? fs_create_dir(path)
+                                         : fs_create_image_file(path, initrd_data(e), e->size);
+        if (rc == 0) {
+            ++added;
+        }
+    }
+    return added;
+}
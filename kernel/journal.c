@@ -0,0 +1,323 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "journal.h"
+#include "ata.h"
+#include "bcache.h"
+#include "pmm.h"
+#include "string.h"
+
+/*
+ * Journal layout, in block cache sized blocks from jr_start:
+ *
+ *   0        header: where replay starts (always block 1) with which
+ *            sequence number
+ *   1 ..     transactions back to back: descriptor, count blocks, commit
+ *
+ * Every transaction carries the next sequence number, so after a
+ * checkpoint rewrites the header, leftovers of older transactions further
+ * on no longer match and replay stops in front of them. A group is the
+ * transactions up to the first commit block without JOURNAL_COMMIT_MORE.
+ *
+ * A group goes out with one flush at its end, so the drive may have kept
+ * any part of it. Each transaction is checked on its own, and replay
+ * applies a group only once all of them are, up to the last.
+ *
+ * Journal blocks bypass the cache: they are written once per commit and
+ * only ever read back by replay.
+ */
+
+#define JOURNAL_HEADER_MAGIC 0x4C4E524Au    /* "JRNL" */
+#define JOURNAL_DESC_MAGIC   0x4353444Au    /* "JDSC" */
+#define JOURNAL_COMMIT_MAGIC 0x4D4D434Au    /* "JCMM" */
+#define JOURNAL_COMMIT_MORE  0x1u           /* the group goes on */
+
+typedef struct journal_header {
+    uint32_t magic;
+    uint32_t seq;
+} journal_header_t;
+
+typedef struct journal_desc {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t home[JOURNAL_MAX_BLOCKS];
+} journal_desc_t;
+
+typedef struct journal_commit_block {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t checksum;
+    uint32_t flags;                     /* JOURNAL_COMMIT_* */
+} journal_commit_t;
+
+static uint32_t jr_start = 0;
+static uint32_t jr_blocks = 0;
+static uint32_t jr_head = 1;            /* next free block in the region */
+static uint32_t jr_seq = 1;             /* sequence of the next transaction */
+static uint8_t* jr_desc = 0;            /* one page each */
+static uint8_t* jr_commit = 0;
+static uint8_t* jr_scratch = 0;
+static journal_stats_t jr_counters;
+
+/* FNV-1a over 32-bit words. */
+static uint32_t journal_checksum(uint32_t h, const uint8_t* data)
+{
+    const uint32_t* w = (const uint32_t*)data;
+    for (uint32_t i = 0; i < BCACHE_BLOCK_SIZE / 4; ++i) {
+        h = (h ^ w[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* n pages to or from consecutive journal blocks, in ATA-sized requests. */
+static int journal_io(uint32_t blk, void* const* pages, uint32_t n, int write)
+{
+    for (uint32_t done = 0; done < n;) {
+        uint32_t len = n - done;
+        if (len > ATA_MAX_PAGES) {
+            len = ATA_MAX_PAGES;
+        }
+        uint32_t lba = (jr_start + blk + done) * ATA_PAGE_SECTORS;
+        int rc = write ? ata_write_pages(lba, pages + done, len)
+                       : ata_read_pages(lba, pages + done, len);
+        if (rc != 0) {
+            return -1;
+        }
+        done += len;
+    }
+    return 0;
+}
+
+static int journal_read_one(uint32_t blk, uint8_t* page)
+{
+    void* pages[1] = { page };
+    return journal_io(blk, pages, 1, 0);
+}
+
+/* Empty the journal: the next transaction goes to block 1 as jr_seq. */
+static int journal_reset(void)
+{
+    memset(jr_commit, 0, BCACHE_BLOCK_SIZE);
+    journal_header_t* h = (journal_header_t*)jr_commit;
+    h->magic = JOURNAL_HEADER_MAGIC;
+    h->seq = jr_seq;
+
+    void* pages[1] = { jr_commit };
+    if (journal_io(0, pages, 1, 1) != 0 || ata_flush() != 0) {
+        return -1;
+    }
+    jr_head = 1;
+    return 0;
+}
+
+int journal_init(uint32_t start, uint32_t blocks)
+{
+    jr_desc = (uint8_t*)pmm_alloc_pages(0);
+    jr_commit = (uint8_t*)pmm_alloc_pages(0);
+    jr_scratch = (uint8_t*)pmm_alloc_pages(0);
+    if (!jr_desc || !jr_commit || !jr_scratch) {
+        return -1;
+    }
+    jr_start = start;
+    jr_blocks = blocks;
+    return 0;
+}
+
+/*
+ * Check the transaction at pos: descriptor, checksum over its blocks and
+ * commit block. Returns its block count, or 0 if it is not complete.
+ */
+static uint32_t journal_scan_one(uint32_t pos, uint32_t seq)
+{
+    const journal_desc_t* d = (const journal_desc_t*)jr_desc;
+    if (pos + 2 > jr_blocks || journal_read_one(pos, jr_desc) != 0 ||
+        d->magic != JOURNAL_DESC_MAGIC || d->seq != seq ||
+        d->count == 0 || d->count > JOURNAL_MAX_BLOCKS || pos + d->count + 2 > jr_blocks) {
+        return 0;
+    }
+
+    uint32_t sum = 2166136261u;
+    for (uint32_t i = 0; i < d->count; ++i) {
+        if (journal_read_one(pos + 1 + i, jr_scratch) != 0) {
+            return 0;
+        }
+        sum = journal_checksum(sum, jr_scratch);
+    }
+
+    const journal_commit_t* c = (const journal_commit_t*)jr_commit;
+    if (journal_read_one(pos + 1 + d->count, jr_commit) != 0 ||
+        c->magic != JOURNAL_COMMIT_MAGIC || c->seq != seq ||
+        c->count != d->count || c->checksum != sum) {
+        return 0;
+    }
+    return d->count;
+}
+
+/*
+ * Find the end of the group at pos, whose first transaction is seq.
+ * Returns the block after it, or 0 if the group is not complete.
+ */
+static uint32_t journal_scan_group(uint32_t pos, uint32_t seq)
+{
+    const journal_commit_t* c = (const journal_commit_t*)jr_commit;
+    for (uint32_t count; (count = journal_scan_one(pos, seq)) != 0; ++seq) {
+        pos += count + 2;
+        if (!(c->flags & JOURNAL_COMMIT_MORE)) {
+            return pos;
+        }
+    }
+    return 0;
+}
+
+/* Copy the images of the checked transaction at pos home through the
+ * cache. Returns its block count, or 0 on an I/O error.
+ */
+static uint32_t journal_apply_one(uint32_t pos)
+{
+    const journal_desc_t* d = (const journal_desc_t*)jr_desc;
+    if (journal_read_one(pos, jr_desc) != 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < d->count; ++i) {
+        if (journal_read_one(pos + 1 + i, jr_scratch) != 0) {
+            return 0;
+        }
+        bcache_buf_t* b = bcache_get_zero(d->home[i]);
+        if (!b) {
+            return 0;
+        }
+        memcpy(b->data, jr_scratch, BCACHE_BLOCK_SIZE);
+        bcache_mark_dirty(b);
+        bcache_commit(b);
+        bcache_release(b);
+    }
+    return d->count;
+}
+
+int journal_replay(void)
+{
+    const journal_header_t* h = (const journal_header_t*)jr_scratch;
+    if (journal_read_one(0, jr_scratch) != 0) {
+        return -1;
+    }
+    if (h->magic != JOURNAL_HEADER_MAGIC) {
+        jr_seq = 1;
+        return journal_reset();
+    }
+    jr_seq = h->seq;
+
+    uint32_t pos = 1;
+    uint32_t applied = 0;
+    for (uint32_t end; (end = journal_scan_group(pos, jr_seq)) != 0;) {
+        while (pos < end) {
+            uint32_t count = journal_apply_one(pos);
+            if (count == 0) {
+                return -1;
+            }
+            pos += count + 2;
+            ++jr_seq;
+        }
+        ++applied;
+    }
+
+    /* What is left of a group cut short may still be further on, numbered
+     * from jr_seq: start past any number a transaction there can have. */
+    jr_seq += jr_blocks;
+    jr_counters.replayed = applied;
+    if (applied > 0 && bcache_sync() != 0) {
+        return -1;
+    }
+    return journal_reset();
+}
+
+int journal_checkpoint(void)
+{
+    if (bcache_sync() != 0) {
+        return -1;
+    }
+    ++jr_counters.checkpoints;
+    return journal_reset();
+}
+
+/* Write one transaction of the group at block pos. */
+static int journal_write_one(uint32_t pos, uint32_t seq, bcache_buf_t* const* bufs,
+                             uint32_t n, uint32_t flags)
+{
+    journal_desc_t* d = (journal_desc_t*)jr_desc;
+    journal_commit_t* c = (journal_commit_t*)jr_commit;
+    memset(jr_desc, 0, BCACHE_BLOCK_SIZE);
+    memset(jr_commit, 0, BCACHE_BLOCK_SIZE);
+    d->magic = JOURNAL_DESC_MAGIC;
+    d->seq = seq;
+    d->count = n;
+
+    /* Descriptor, images and commit go out as one run of pages. */
+    void* pages[JOURNAL_MAX_BLOCKS + 2];
+    uint32_t sum = 2166136261u;
+    pages[0] = jr_desc;
+    for (uint32_t i = 0; i < n; ++i) {
+        d->home[i] = bufs[i]->blkno;
+        sum = journal_checksum(sum, bufs[i]->data);
+        pages[1 + i] = bufs[i]->data;
+    }
+    c->magic = JOURNAL_COMMIT_MAGIC;
+    c->seq = seq;
+    c->count = n;
+    c->checksum = sum;
+    c->flags = flags;
+    pages[n + 1] = jr_commit;
+
+    return journal_io(pos, pages, n + 2, 1);
+}
+
+int journal_commit(void)
+{
+    uint32_t total = bcache_pending_count();
+    if (total == 0) {
+        return 0;
+    }
+    /* Make room before the group, so no checkpoint lands inside it. */
+    uint32_t size = JOURNAL_GROUP_SIZE(total);
+    if (size > jr_blocks - 1) {
+        return -1;
+    }
+    if (jr_head + size > jr_blocks && journal_checkpoint() != 0) {
+        return -1;
+    }
+
+    uint32_t pos = jr_head;
+    uint32_t seq = jr_seq;
+    int rc = 0;
+    for (uint32_t left = total; left > 0 && rc == 0; ++seq) {
+        bcache_buf_t* bufs[JOURNAL_MAX_BLOCKS];
+        uint32_t n = bcache_pending(bufs, JOURNAL_MAX_BLOCKS);
+        left -= n;
+        rc = journal_write_one(pos, seq, bufs, n, left ? JOURNAL_COMMIT_MORE : 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            bcache_log(bufs[i]);
+        }
+        pos += n + 2;
+    }
+    if (rc != 0 || ata_flush() != 0) {
+        /* Part of the group may be on disk: never reuse its numbers. */
+        bcache_log_done(0);
+        jr_seq = seq;
+        return -1;
+    }
+    bcache_log_done(1);
+
+    jr_head = pos;
+    jr_seq = seq;
+    ++jr_counters.commits;
+    jr_counters.blocks_logged += total;
+
+    /* The group is safe; buffers borrowed to stage it go back now. */
+    bcache_trim();
+    return (int)total;
+}
+
+void journal_get_stats(journal_stats_t* out)
+{
+    *out = jr_counters;
+}
@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "keyboard.h"
+#include "console.h"
+#include "idt.h"
+#include "io.h"
+#include "trace.h"
+
+/*
+ * Interrupt-driven PS/2 keyboard for Enixnel.
+ *
+ * The IRQ 1 handler only moves the raw scancode from port 0x60 into a
+ * single-producer/single-consumer ring: the handler owns kbd_head, the
+ * reader owns kbd_tail, so neither side needs a lock. Translation (shift
+ * state, keymap lookup) happens on the reader side, outside the handler.
+ *
+ * The reader never touches the controller; console_read_char() halts the
+ * CPU while both this ring and the serial one are empty.
+ */
+
+#define KBD_DATA_PORT    0x60
+#define KBD_STATUS_PORT  0x64
+#define KBD_STATUS_FULL  0x01
+
+#define KBD_RING_SIZE    64     /* power of two */
+#define KBD_RING_MASK    (KBD_RING_SIZE - 1)
+
+#define SC_RELEASE       0x80
+#define SC_EXTENDED      0xE0
+#define SC_LSHIFT        0x2A
+#define SC_RSHIFT        0x36
+#define SC_ENTER         0x1C
+#define SC_SLASH         0x35
+#define SC_UP            0x48   /* extended */
+#define SC_DOWN          0x50   /* extended */
+
+static volatile uint8_t  kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head = 0;     /* next slot the IRQ writes */
+static volatile uint32_t kbd_tail = 0;     /* next slot the reader takes */
+
+/* Reader-side state. */
+static int shift_down = 0;
+static int extended = 0;
+
+/* Scancode set 1, US layout. 0 = no character. */
+static const char keymap_normal[128] = {
+    [0x02] = '1', [0x03] = '2', [0x04] = '3', [0x05] = '4', [0x06] = '5',
+    [0x07] = '6', [0x08] = '7', [0x09] = '8', [0x0A] = '9', [0x0B] = '0',
+    [0x0C] = '-', [0x0D] = '=', [0x0E] = '\b', [0x0F] = '\t',
+    [0x10] = 'q', [0x11] = 'w', [0x12] = 'e', [0x13] = 'r', [0x14] = 't',
+    [0x15] = 'y', [0x16] = 'u', [0x17] = 'i', [0x18] = 'o', [0x19] = 'p',
+    [0x1A] = '[', [0x1B] = ']', [0x1C] = '\n',
+    [0x1E] = 'a', [0x1F] = 's', [0x20] = 'd', [0x21] = 'f', [0x22] = 'g',
+    [0x23] = 'h', [0x24] = 'j', [0x25] = 'k', [0x26] = 'l', [0x27] = ';',
+    [0x28] = '\'', [0x29] = '`', [0x2B] = '\\',
+    [0x2C] = 'z', [0x2D] = 'x', [0x2E] = 'c', [0x2F] = 'v', [0x30] = 'b',
+    [0x31] = 'n', [0x32] = 'm', [0x33] = ',', [0x34] = '.', [0x35] = '/',
+    [0x37] = '*', [0x39] = ' ', [0x4A] = '-', [0x4E] = '+',
+};
+
+static const char keymap_shift[128] = {
+    [0x02] = '!', [0x03] = '@', [0x04] = '#', [0x05] = '$', [0x06] = '%',
+    [0x07] = '^', [0x08] = '&', [0x09] = '*', [0x0A] = '(', [0x0B] = ')',
+    [0x0C] = '_', [0x0D] = '+', [0x0E] = '\b', [0x0F] = '\t',
+    [0x10] = 'Q', [0x11] = 'W', [0x12] = 'E', [0x13] = 'R', [0x14] = 'T',
+    [0x15] = 'Y', [0x16] = 'U', [0x17] = 'I', [0x18] = 'O', [0x19] = 'P',
+    [0x1A] = '{', [0x1B] = '}', [0x1C] = '\n',
+    [0x1E] = 'A', [0x1F] = 'S', [0x20] = 'D', [0x21] = 'F', [0x22] = 'G',
+    [0x23] = 'H', [0x24] = 'J', [0x25] = 'K', [0x26] = 'L', [0x27] = ':',
+    [0x28] = '"', [0x29] = '~', [0x2B] = '|',
+    [0x2C] = 'Z', [0x2D] = 'X', [0x2E] = 'C', [0x2F] = 'V', [0x30] = 'B',
+    [0x31] = 'N', [0x32] = 'M', [0x33] = '<', [0x34] = '>', [0x35] = '?',
+    [0x37] = '*', [0x39] = ' ', [0x4A] = '-', [0x4E] = '+',
+};
+
+/* ---------- Producer: IRQ 1 ---------- */
+
+static void keyboard_irq(interrupt_frame_t* frame)
+{
+    (void)frame;
+    TRACE_BEGIN(KBD_IRQ, 0, 0);
+    uint8_t sc = inb(KBD_DATA_PORT);
+
+    uint32_t head = kbd_head;
+    if (head - kbd_tail < KBD_RING_SIZE) {
+        kbd_ring[head & KBD_RING_MASK] = sc;
+        __asm__ __volatile__("" ::: "memory");   /* slot before index */
+        kbd_head = head + 1;
+        console_input_ready();
+    }
+    /* Ring full: drop the scancode rather than block the IRQ. */
+    TRACE_END(KBD_IRQ, sc, 0);
+}
+
+void keyboard_init(void)
+{
+    /* Discard anything the BIOS or bootloader left in the controller. */
+    while (inb(KBD_STATUS_PORT) & KBD_STATUS_FULL) {
+        (void)inb(KBD_DATA_PORT);
+    }
+    irq_install_handler(IRQ_KEYBOARD, keyboard_irq);
+}
+
+/* ---------- Consumer ---------- */
+
+int keyboard_input_pending(void)
+{
+    return kbd_tail != kbd_head;
+}
+
+static uint8_t keyboard_next_scancode(void)
+{
+    uint32_t tail = kbd_tail;
+    uint8_t sc = kbd_ring[tail & KBD_RING_MASK];
+    __asm__ __volatile__("" ::: "memory");   /* read slot before freeing it */
+    kbd_tail = tail + 1;
+    return sc;
+}
+
+int keyboard_poll_char(void)
+{
+    while (keyboard_input_pending()) {
+        uint8_t sc = keyboard_next_scancode();
+
+        if (sc == SC_EXTENDED) {
+            extended = 1;
+            continue;
+        }
+
+        uint8_t key = sc & (uint8_t)~SC_RELEASE;
+        int released = (sc & SC_RELEASE) != 0;
+
+        if (extended) {
+            /* Keypad Enter and '/' type, Up and Down recall history;
+             * other arrows etc. are ignored. */
+            extended = 0;
+            if (released) {
+                continue;
+            }
+            if (key == SC_UP || key == SC_DOWN) {
+                return key == SC_UP ? CONSOLE_KEY_UP : CONSOLE_KEY_DOWN;
+            }
+            if (key != SC_ENTER && key != SC_SLASH) {
+                continue;
+            }
+            return keymap_normal[key];
+        }
+
+        if (key == SC_LSHIFT || key == SC_RSHIFT) {
+            shift_down = !released;
+            continue;
+        }
+        if (released) {
+            continue;
+        }
+
+        char ch = shift_down ? keymap_shift[key] : keymap_normal[key];
+        if (ch) {
+            return ch;
+        }
+    }
+    return -1;
+}
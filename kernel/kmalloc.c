@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "kmalloc.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "string.h"
+
+/*
+ * Slab allocator and kmalloc() for Enixnel.
+ *
+ * A slab is one page from the buddy allocator. Its first bytes hold a
+ * slab_t header; the rest is divided into equal objects, and free objects
+ * are chained through their first word. Because slabs are page aligned,
+ * kmem_cache_free()/kfree() find the header by masking the object address.
+ *
+ * Each cache keeps a list of partial slabs (at least one free object) and
+ * at most one completely empty slab, so allocation and free never scan.
+ * Full slabs are on no list at all until an object comes back.
+ *
+ * kmalloc() requests above KMALLOC_MAX_SLAB take 2^order pages straight
+ * from the buddy allocator, behind a small header at the page base that
+ * records the order. The magic word at the page base tells the two kinds
+ * apart in kfree().
+ *
+ * One spinlock, kmem_lock, serialises every cache between CPUs and
+ * threads; the page allocator below has its own.
+ */
+
+#define KMEM_MAX_CACHES   32
+#define SLAB_MAGIC        0x51AB51ABu
+#define LARGE_MAGIC       0x1A56E000u
+#define KMEM_HEADER_SIZE  32    /* slab_t / large header, rounded for alignment */
+
+typedef struct slab {
+    uint32_t      magic;
+    kmem_cache_t* cache;
+    struct slab*  next;     /* partial list */
+    struct slab*  prev;
+    void*         free;     /* first free object */
+    uint32_t      inuse;
+} slab_t;
+
+typedef struct large_header {
+    uint32_t magic;
+    uint32_t order;
+} large_header_t;
+
+struct kmem_cache {
+    const char* name;
+    size_t      obj_size;
+    uint32_t    per_slab;
+    slab_t*     partial;
+    slab_t*     empty;      /* at most one fully free slab kept warm */
+};
+
+static kmem_cache_t  kmem_caches[KMEM_MAX_CACHES];
+static int           kmem_cache_count = 0;
+static spinlock_t    kmem_lock = SPINLOCK_INIT;
+
+/* kmalloc size classes: 16, 32, ..., KMALLOC_MAX_SLAB */
+#define KMALLOC_CLASSES 7
+static kmem_cache_t* kmalloc_caches[KMALLOC_CLASSES];
+static const char* const kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+static kmem_cache_t* kmem_cache_create_locked(const char* name, size_t obj_size)
+{
+    /* Room for the free-list link, 8-byte aligned objects. */
+    if (obj_size < sizeof(void*)) {
+        obj_size = sizeof(void*);
+    }
+    obj_size = (obj_size + 7) & ~(size_t)7;
+
+    if (obj_size > PAGE_SIZE - KMEM_HEADER_SIZE || kmem_cache_count >= KMEM_MAX_CACHES) {
+        return 0;
+    }
+
+    kmem_cache_t* c = &kmem_caches[kmem_cache_count++];
+    c->name = name;
+    c->obj_size = obj_size;
+    c->per_slab = (uint32_t)((PAGE_SIZE - KMEM_HEADER_SIZE) / obj_size);
+    c->partial = 0;
+    c->empty = 0;
+    return c;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t obj_size)
+{
+    uint32_t flags = spin_lock_irqsave(&kmem_lock);
+    kmem_cache_t* c = kmem_cache_create_locked(name, obj_size);
+    spin_unlock_irqrestore(&kmem_lock, flags);
+    return c;
+}
+
+static void slab_list_push(slab_t** head, slab_t* s)
+{
+    s->prev = 0;
+    s->next = *head;
+    if (s->next) {
+        s->next->prev = s;
+    }
+    *head = s;
+}
+
+static void slab_list_remove(slab_t** head, slab_t* s)
+{
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        *head = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+    s->next = 0;
+    s->prev = 0;
+}
+
+static slab_t* slab_create(kmem_cache_t* c)
+{
+    slab_t* s = (slab_t*)pmm_alloc_pages(0);
+    if (!s) {
+        return 0;
+    }
+
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->next = 0;
+    s->prev = 0;
+    s->inuse = 0;
+
+    /* Chain the objects in address order. */
+    uint8_t* first = (uint8_t*)s + KMEM_HEADER_SIZE;
+    s->free = first;
+    for (uint32_t i = 0; i < c->per_slab; ++i) {
+        uint8_t* obj = first + i * c->obj_size;
+        *(void**)obj = (i + 1 < c->per_slab) ? obj + c->obj_size : 0;
+    }
+    return s;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* c)
+{
+    if (!c) {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&kmem_lock);
+    slab_t* s = c->partial;
+    if (!s) {
+        if (c->empty) {
+            s = c->empty;
+            c->empty = 0;
+        } else {
+            s = slab_create(c);
+            if (!s) {
+                spin_unlock_irqrestore(&kmem_lock, flags);
+                return 0;
+            }
+        }
+        slab_list_push(&c->partial, s);
+    }
+
+    void* obj = s->free;
+    s->free = *(void**)obj;
+    ++s->inuse;
+
+    if (!s->free) {
+        slab_list_remove(&c->partial, s);   /* now full */
+    }
+    spin_unlock_irqrestore(&kmem_lock, flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* c, void* obj)
+{
+    if (!c || !obj) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&kmem_lock);
+    slab_t* s = (slab_t*)((uintptr_t)obj & ~(uintptr_t)(PAGE_SIZE - 1));
+    int was_full = (s->free == 0);
+
+    *(void**)obj = s->free;
+    s->free = obj;
+    --s->inuse;
+
+    if (s->inuse == 0) {
+        if (!was_full) {
+            slab_list_remove(&c->partial, s);
+        }
+        if (!c->empty) {
+            c->empty = s;
+        } else {
+            pmm_free_pages(s, 0);
+        }
+    } else if (was_full) {
+        slab_list_push(&c->partial, s);
+    }
+    spin_unlock_irqrestore(&kmem_lock, flags);
+}
+
+/* ---------- kmalloc ---------- */
+
+static int kmalloc_class(size_t size)
+{
+    size_t cls = KMALLOC_MIN_SLAB;
+    int i = 0;
+    while (cls < size) {
+        cls <<= 1;
+        ++i;
+    }
+    return i;
+}
+
+void* kmalloc(size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    if (size <= KMALLOC_MAX_SLAB) {
+        int i = kmalloc_class(size);
+        if (!kmalloc_caches[i]) {
+            uint32_t flags = spin_lock_irqsave(&kmem_lock);
+            if (!kmalloc_caches[i]) {
+                kmalloc_caches[i] = kmem_cache_create_locked(kmalloc_names[i],
+                                                             (size_t)KMALLOC_MIN_SLAB << i);
+            }
+            spin_unlock_irqrestore(&kmem_lock, flags);
+        }
+        return kmem_cache_alloc(kmalloc_caches[i]);
+    }
+
+    unsigned order = 0;
+    while (((size_t)PAGE_SIZE << order) < size + KMEM_HEADER_SIZE) {
+        ++order;
+    }
+    large_header_t* h = (large_header_t*)pmm_alloc_pages(order);
+    if (!h) {
+        return 0;
+    }
+    h->magic = LARGE_MAGIC;
+    h->order = order;
+    return (uint8_t*)h + KMEM_HEADER_SIZE;
+}
+
+void* kzalloc(size_t size)
+{
+    uint8_t* p = (uint8_t*)kmalloc(size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void kfree(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    uint32_t* base = (uint32_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+    if (*base == SLAB_MAGIC) {
+        kmem_cache_free(((slab_t*)base)->cache, ptr);
+    } else if (*base == LARGE_MAGIC) {
+        large_header_t* h = (large_header_t*)base;
+        h->magic = 0;
+        pmm_free_pages(h, h->order);
+    }
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "kstat.h"
+#include "console.h"
+#include "math64.h"
+#include "string.h"
+
+/*
+ * Cycle accounting slots and their report for the "stats" command.
+ * The counting itself is inline in kstat.h.
+ */
+
+#ifdef ENIXNEL_STATS
+
+kstat_t kstat_fs[KSTAT_FS_COUNT] = {
+#define KSTAT_INIT(id, name) { name, 0, 0, 0 },
+    KSTAT_FS_LIST(KSTAT_INIT)
+#undef KSTAT_INIT
+};
+
+static void kstat_write_padded(uint64_t v, int width)
+{
+    uint64_t n = v;
+    int digits = 1;
+    while (n >= 10) {
+        n = div64_u32(n, 10);
+        ++digits;
+    }
+    for (; digits < width; ++digits) {
+        console_putc(' ');
+    }
+    console_write_dec64(v);
+}
+
+void kstat_print(const kstat_t* slots, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const kstat_t* k = &slots[i];
+        if (k->calls == 0) {
+            continue;
+        }
+        console_write("  ");
+        console_write(k->name);
+        for (size_t pad = strlen(k->name); pad < 16; ++pad) {
+            console_putc(' ');
+        }
+        kstat_write_padded(k->calls, 8);
+        kstat_write_padded(k->cycles, 14);
+        kstat_write_padded(div64_u32(k->cycles, k->calls), 10);
+        kstat_write_padded(k->max, 12);
+        console_putc('\n');
+    }
+}
+
+void kstat_reset(kstat_t* slots, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        slots[i].calls = 0;
+        slots[i].cycles = 0;
+        slots[i].max = 0;
+    }
+}
+
+#endif /* ENIXNEL_STATS */
@@ -1,389 +1,67 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "fs.h"
-
-#define VGA_WIDTH 80
-#define VGA_HEIGHT 25
-
-static volatile uint16_t* const VGA_MEMORY = (uint16_t*)0xB8000;
-
-static size_t cursor_row = 0;
-static size_t cursor_col = 0;
-static uint8_t console_color = 0x07; /* light grey on black */
-
-/* Track Shift key state for punctuation like '>' (Shift + '.') */
-static int shift_down = 0;
-
-/* Current working "directory" as a simple path prefix ("" = root). */
-static char current_dir[ENIXNEL_MAX_NAME_LEN + 1] = "";
-
-static uint16_t vga_entry(char c, uint8_t color)
-{
-    return (uint16_t)c | ((uint16_t)color << 8);
-}
-
-static void console_clear(void)
-{
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t idx = y * VGA_WIDTH + x;
-            VGA_MEMORY[idx] = vga_entry(' ', console_color);
-        }
-    }
-    cursor_row = 0;
-    cursor_col = 0;
-}
-
-static void console_scroll(void)
-{
-    if (cursor_row < VGA_HEIGHT) {
-        return;
-    }
-
-    /* Move each row up by one */
-    for (size_t y = 1; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t from = y * VGA_WIDTH + x;
-            const size_t to   = (y - 1) * VGA_WIDTH + x;
-            VGA_MEMORY[to] = VGA_MEMORY[from];
-        }
-    }
-
-    /* Clear last row */
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        const size_t idx = (VGA_HEIGHT - 1) * VGA_WIDTH + x;
-        VGA_MEMORY[idx] = vga_entry(' ', console_color);
-    }
-
-    cursor_row = VGA_HEIGHT - 1;
-    if (cursor_col >= VGA_WIDTH) {
-        cursor_col = 0;
-    }
-}
-
-static void console_putc(char c)
-{
-    if (c == '\n') {
-        cursor_col = 0;
-        cursor_row++;
-    } else {
-        const size_t idx = cursor_row * VGA_WIDTH + cursor_col;
-        VGA_MEMORY[idx] = vga_entry(c, console_color);
-        cursor_col++;
-        if (cursor_col >= VGA_WIDTH) {
-            cursor_col = 0;
-            cursor_row++;
-        }
-    }
-    if (cursor_row >= VGA_HEIGHT) {
-        console_scroll();
-    }
-}
-
-static void console_write(const char* s)
-{
-    while (*s) {
-        console_putc(*s++);
-    }
-}
-
-static void console_write_line(const char* s)
-{
-    console_write(s);
-    console_putc('\n');
-}
-
-/* ---------- Low-level keyboard input (PS/2) ---------- */
-
-static inline uint8_t inb(uint16_t port)
-{
-    uint8_t value;
-    __asm__ __volatile__("inb %1, %0" : "=a"(value) : "Nd"(port));
-    return value;
-}
-
-static char scancode_to_char(uint8_t sc)
-{
-    switch (sc) {
-        /* Number row */
-        case 0x02: return '1';
-        case 0x03: return '2';
-        case 0x04: return '3';
-        case 0x05: return '4';
-        case 0x06: return '5';
-        case 0x07: return '6';
-        case 0x08: return '7';
-        case 0x09: return '8';
-        case 0x0A: return '9';
-        case 0x0B: return '0';
-
-        /* Top letter row */
-        case 0x10: return 'q';
-        case 0x11: return 'w';
-        case 0x12: return 'e';
-        case 0x13: return 'r';
-        case 0x14: return 't';
-        case 0x15: return 'y';
-        case 0x16: return 'u';
-        case 0x17: return 'i';
-        case 0x18: return 'o';
-        case 0x19: return 'p';
-
-        /* Home row */
-        case 0x1E: return 'a';
-        case 0x1F: return 's';
-        case 0x20: return 'd';
-        case 0x21: return 'f';
-        case 0x22: return 'g';
-        case 0x23: return 'h';
-        case 0x24: return 'j';
-        case 0x25: return 'k';
-        case 0x26: return 'l';
-
-        /* Bottom row */
-        case 0x2C: return 'z';
-        case 0x2D: return 'x';
-        case 0x2E: return 'c';
-        case 0x2F: return 'v';
-        case 0x30: return 'b';
-        case 0x31: return 'n';
-        case 0x32: return 'm';
-
-        /* Punctuation we care about */
-        case 0x2B: return '\\';               /* backslash '\' */
-        case 0x35: return '/';                /* forward slash '/' */
-        case 0x34: return shift_down ? '>' : '.'; /* '.' or '>' */
-
-        case 0x39: return ' ';   /* space */
-        case 0x1C: return '\n';  /* enter */
-        case 0x0E: return '\b';  /* backspace */
-
-        default:
-            return 0;
-    }
-}
-
-static char keyboard_read_char(void)
-{
-    for (;;) {
-        uint8_t status = inb(0x64);
-        if (status & 0x01) {
-            uint8_t sc = inb(0x60);
-
-            /* Handle Shift press/release explicitly */
-            if (sc == 0x2A || sc == 0x36) {
-                /* Left or Right Shift pressed */
-                shift_down = 1;
-                continue;
-            }
-            if (sc == 0xAA || sc == 0xB6) {
-                /* Left or Right Shift released */
-                shift_down = 0;
-                continue;
-            }
-
-            /* Ignore other key releases */
-            if (sc & 0x80) {
-                continue;
-            }
-
-            char ch = scancode_to_char(sc);
-            if (ch) {
-                return ch;
-            }
-        }
-    }
-}
-
-static void console_backspace(void)
-{
-    if (cursor_col == 0 && cursor_row == 0) {
-        return;
-    }
-    if (cursor_col > 0) {
-        cursor_col--;
-    } else {
-        cursor_row--;
-        cursor_col = VGA_WIDTH - 1;
-    }
-    const size_t idx = cursor_row * VGA_WIDTH + cursor_col;
-    VGA_MEMORY[idx] = vga_entry(' ', console_color);
-}
-
-static void console_read_line(char* buffer, size_t buflen)
-{
-    size_t len = 0;
-    if (buflen == 0) {
-        return;
-    }
-
-    for (;;) {
-        char c = keyboard_read_char();
-
-        if (c == '\n') {
-            console_putc('\n');
-            buffer[len] = '\0';
-            return;
-        } else if (c == '\b') {
-            if (len > 0) {
-                len--;
-                console_backspace();
-            }
-        } else {
-            if (len + 1 < buflen && c >= 32 && c < 127) {
-                buffer[len++] = c;
-                console_putc(c);
-            }
-        }
-    }
-}
-
-/* ---------- Small string helpers for CLI parsing ---------- */
-
-static size_t k_strlen(const char* s)
-{
-    size_t n = 0;
-    if (!s) {
-        return 0;
-    }
-    while (*s++) {
-        ++n;
-    }
-    return n;
-}
-
-static int k_streq(const char* a, const char* b)
-{
-    if (!a || !b) {
-        return 0;
-    }
-    while (*a || *b) {
-        if (*a != *b) {
-            return 0;
-        }
-        ++a;
-        ++b;
-    }
-    return 1;
-}
+#include "multiboot.h"
+#include "pmm.h"
+#include "console.h"
+#include "keyboard.h"
+#include "serial.h"
+#include "idt.h"
+#include "string.h"
+#include "cli_hash.h"
+#include "timer.h"
+#include "bench.h"
+#include "kstat.h"
+#include "trace.h"
+#include "power.h"
+#include "sched.h"
+#include "smp.h"
+#include "apic.h"
+#include "paging.h"
+#include "ata.h"
+#include "bcache.h"
+#include "journal.h"
+#include "initrd.h"
+
+/* Longest command line the shell accepts (including the '\0'). */
+#define CLI_LINE_MAX 128
+
+/* Path arguments are cut from the line, so they always fit in this. Only
+ * each component is limited (ENIXNEL_MAX_NAME_LEN), not their number. */
+#define CLI_PATH_MAX CLI_LINE_MAX
+
+/* Buffer between two stages of "a | b" (see cli_run_line()), and how deep
+ * run scripts may call each other. */
+#define CLI_PIPE_SIZE PAGE_SIZE
+#define CLI_RUN_DEPTH 4
+
+/* Serialises fs.h calls between threads (see fs.h). */
+mutex_t fs_mutex = MUTEX_INIT;
 
 /* ---------- Path helpers for simple hierarchical names ---------- */
 
-/* Join dir and name into out. dir="" means root, so result is just name. */
-static void path_join(const char* dir, const char* name, char* out, size_t out_size)
+/* Join dir and name into out. dir="" means root, so result is just name.
+ * Returns 0, or -1 (out untouched) if the result does not fit.
+ */
+static int path_join(const char* dir, const char* name, char* out, size_t out_size)
 {
-    if (!out || out_size == 0) {
-        return;
-    }
-
-    size_t dlen = k_strlen(dir);
-    size_t nlen = k_strlen(name);
-
-    if (dlen == 0) {
-        /* Just copy name */
-        if (nlen >= out_size) {
-            nlen = out_size - 1;
-        }
-        for (size_t i = 0; i < nlen; ++i) {
-            out[i] = name[i];
-        }
-        out[nlen] = '\0';
-        return;
-    }
-
-    /* dir + '/' + name */
-    size_t total = dlen + 1 + nlen;
-    if (total >= out_size) {
-        /* Truncate safely */
-        total = out_size - 1;
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    size_t need = dlen + (dlen > 0 ? 1 : 0) + nlen;
+    if (!out || need >= out_size) {
+        return -1;
     }
 
+    /* dir + '/' + name; just name at the root. */
     size_t pos = 0;
-    for (size_t i = 0; i < dlen && pos < out_size - 1; ++i) {
-        out[pos++] = dir[i];
-    }
-    if (pos < out_size - 1) {
+    if (dlen > 0) {
+        memcpy(out, dir, dlen);
+        pos = dlen;
         out[pos++] = '/';
     }
-    for (size_t i = 0; i < nlen && pos < out_size - 1; ++i) {
-        out[pos++] = name[i];
-    }
-    out[pos] = '\0';
-}
-
-/* Get parent directory of path into out. For "a/b/c" -> "a/b". For "a" -> "". */
-static void path_parent(const char* path, char* out, size_t out_size)
-{
-    if (!out || out_size == 0) {
-        return;
-    }
-    out[0] = '\0';
-
-    if (!path) {
-        return;
-    }
-
-    size_t len = k_strlen(path);
-    if (len == 0) {
-        return;
-    }
-
-    /* Find last '/' */
-    size_t last_slash = len;
-    while (last_slash > 0 && path[last_slash - 1] != '/') {
-        --last_slash;
-    }
-
-    if (last_slash == 0) {
-        /* No '/' -> parent is root ("") */
-        return;
-    }
-
-    /* Copy everything before the last '/' */
-    size_t plen = last_slash - 1; /* exclude the '/' itself */
-    if (plen >= out_size) {
-        plen = out_size - 1;
-    }
-
-    for (size_t i = 0; i < plen; ++i) {
-        out[i] = path[i];
-    }
-    out[plen] = '\0';
-}
-
-/* Get basename of path into out. For "a/b/c" -> "c", for "a" -> "a". */
-static void path_basename(const char* path, char* out, size_t out_size)
-{
-    if (!out || out_size == 0) {
-        return;
-    }
-    out[0] = '\0';
-
-    if (!path) {
-        return;
-    }
-
-    size_t len = k_strlen(path);
-    if (len == 0) {
-        return;
-    }
-
-    /* Find last '/' */
-    size_t start = len;
-    while (start > 0 && path[start - 1] != '/') {
-        --start;
-    }
-
-    /* Copy from start to end */
-    size_t blen = len - start;
-    if (blen >= out_size) {
-        blen = out_size - 1;
-    }
-
-    for (size_t i = 0; i < blen; ++i) {
-        out[i] = path[start + i];
-    }
-    out[blen] = '\0';
+    memcpy(out + pos, name, nlen);
+    out[pos + nlen] = '\0';
+    return 0;
 }
 
 /* Split line into command and the rest of the line as args_ptr. */
@@ -428,45 +106,129 @@ static void cli_first_arg(const char* args, char* arg_out, size_t arg_out_size)
     arg_out[len] = '\0';
 }
 
+/* Get the token after the first one (e.g. "dst" in "src dst"). */
+static void cli_second_arg(const char* args, char* arg_out, size_t arg_out_size)
+{
+    const char* p = args;
+
+    while (*p == ' ') {
+        ++p;
+    }
+    while (*p && *p != ' ') {
+        ++p;
+    }
+
+    cli_first_arg(p, arg_out, arg_out_size);
+}
+
+/* ---------- Command table ---------- */
+
+typedef struct cli_command {
+    const char* name;
+    void (*handler)(const char* args);
+    const char* synopsis;
+    const char* help;
+} cli_command_t;
+
+#define CLI_COMMAND(name, synopsis, help) static void cli_cmd_##name(const char* args);
+#include "cli_commands.def"
+#undef CLI_COMMAND
+
+/* One entry per command; drives dispatch, help and the /bin files. */
+static const cli_command_t cli_commands[] = {
+#define CLI_COMMAND(name, synopsis, help) { #name, cli_cmd_##name, synopsis, help },
+#include "cli_commands.def"
+#undef CLI_COMMAND
+};
+
+#define CLI_COMMAND_COUNT (sizeof(cli_commands) / sizeof(cli_commands[0]))
+
+#ifdef ENIXNEL_STATS
+/* Cycle accounting per command, parallel to cli_commands[]. */
+static kstat_t cli_command_stats[] = {
+#define CLI_COMMAND(name, synopsis, help) { #name, 0, 0, 0 },
+#include "cli_commands.def"
+#undef CLI_COMMAND
+};
+#endif
+
+/* CLI_HASH_SEED, CLI_HASH_MASK and cli_hash_slots[], made by the build. */
+#include "cli_hash_table.h"
+
+/* Perfect hash: at most one candidate, confirmed by one compare. */
+static const cli_command_t* cli_find_command(const char* name)
+{
+    uint8_t slot = cli_hash_slots[cli_command_hash(name, CLI_HASH_SEED) & CLI_HASH_MASK];
+    if (slot == CLI_HASH_EMPTY || strcmp(cli_commands[slot].name, name) != 0) {
+        return 0;
+    }
+    return &cli_commands[slot];
+}
+
 /* ---------- CLI command handlers ---------- */
 
+/* Output of the previous stage when the command runs in a pipe, else 0. */
+static const char* cli_input = 0;
+static size_t      cli_input_len = 0;
+
 /* Initialize a simple default filesystem layout:
  *   /bin   - holds entries representing built-in commands
  *   /user  - default "home" directory for the user
  */
 static void fs_init_layout(void)
 {
-    /* Root-level directories */
+    fs_init();
+
+    int formatted = 0;
+    if (fs_mount(&formatted) == 0) {
+        console_write_line(formatted ? "Filesystem: new on disk" : "Filesystem: loaded from disk");
+        journal_stats_t js;
+        journal_get_stats(&js);
+        if (js.replayed > 0) {
+            console_write("Filesystem: replayed ");
+            console_write_dec(js.replayed);
+            console_write_line(" journal transactions");
+        }
+    } else if (ata_present()) {
+        console_write_line("Filesystem: disk unusable, keeping files in memory only");
+    }
+
+    /* Boot image contents the fs does not have yet, read in place. */
+    int added = initrd_populate();
+    if (added > 0) {
+        console_write("Filesystem: ");
+        console_write_dec((uint32_t)added);
+        console_write_line(" entries from the boot image");
+    }
+
+    /* Root-level directories (a loaded disk has them already) */
     fs_create_dir("bin");
     fs_create_dir("user");
 
     /* Represent built-in commands as files under /bin (purely cosmetic) */
-    fs_create_file("bin/echo");
-    fs_create_file("bin/crtdir");
-    fs_create_file("bin/cfile");
-    fs_create_file("bin/deldir");
-    fs_create_file("bin/dfile");
-    fs_create_file("bin/sdir");
-    fs_create_file("bin/sfile");
-    fs_create_file("bin/efile");
-    fs_create_file("bin/clr");
-    fs_create_file("bin/cd");
+    for (size_t i = 0; i < CLI_COMMAND_COUNT; ++i) {
+        char path[CLI_PATH_MAX];
+        if (path_join("bin", cli_commands[i].name, path, sizeof(path)) == 0) {
+            fs_create_file(path);
+        }
+    }
+    fs_sync();
 }
 
-static void cli_cmd_help(void)
+static void cli_cmd_help(const char* args)
 {
+    (void)args;
     console_write_line("Available commands:");
-    console_write_line("  help              - show this help");
-    console_write_line("  echo <text>       - print text");
-    console_write_line("  crtdir <name>     - create directory");
-    console_write_line("  cfile <name>      - create file");
-    console_write_line("  deldir <name>     - delete directory");
-    console_write_line("  dfile <name>      - delete file");
-    console_write_line("  sdir              - list entries in current directory");
-    console_write_line("  sfile <name>      - show file contents");
-    console_write_line("  efile <expr>      - edit file (efile text > file, efile text >> file)");
-    console_write_line("  clr               - clear the screen");
-    console_write_line("  cd <name>         - change directory (.. for parent)");
+    for (size_t i = 0; i < CLI_COMMAND_COUNT; ++i) {
+        const char* synopsis = cli_commands[i].synopsis;
+        console_write("  ");
+        console_write(synopsis);
+        for (size_t pad = strlen(synopsis); pad < 18; ++pad) {
+            console_putc(' ');
+        }
+        console_write("- ");
+        console_write_line(cli_commands[i].help);
+    }
 }
 
 static void cli_cmd_echo(const char* args)
@@ -481,8 +243,7 @@ static void cli_cmd_echo(const char* args)
 
 static void cli_cmd_crtdir(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -490,9 +251,7 @@ static void cli_cmd_crtdir(const char* args)
         return;
     }
 
-    path_join(current_dir, name, full, sizeof(full));
-
-    int rc = fs_create_dir(full);
+    int rc = fs_create_dir(name);
     if (rc == 0) {
         console_write("Directory created: ");
         console_write_line(name);
@@ -504,8 +263,7 @@ static void cli_cmd_crtdir(const char* args)
 
 static void cli_cmd_cfile(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -513,9 +271,7 @@ static void cli_cmd_cfile(const char* args)
         return;
     }
 
-    path_join(current_dir, name, full, sizeof(full));
-
-    int rc = fs_create_file(full);
+    int rc = fs_create_file(name);
     if (rc == 0) {
         console_write("File created: ");
         console_write_line(name);
@@ -527,8 +283,7 @@ static void cli_cmd_cfile(const char* args)
 
 static void cli_cmd_deldir(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -536,9 +291,7 @@ static void cli_cmd_deldir(const char* args)
         return;
     }
 
-    path_join(current_dir, name, full, sizeof(full));
-
-    int rc = fs_delete_dir(full);
+    int rc = fs_delete_dir(name);
     if (rc == 0) {
         console_write("Directory deleted: ");
         console_write_line(name);
@@ -550,8 +303,7 @@ static void cli_cmd_deldir(const char* args)
 
 static void cli_cmd_dfile(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -559,9 +311,7 @@ static void cli_cmd_dfile(const char* args)
         return;
     }
 
-    path_join(current_dir, name, full, sizeof(full));
-
-    int rc = fs_delete_file(full);
+    int rc = fs_delete_file(name);
     if (rc == 0) {
         console_write("File deleted: ");
         console_write_line(name);
@@ -571,49 +321,40 @@ static void cli_cmd_dfile(const char* args)
     }
 }
 
-static void cli_cmd_sdir(void)
+/* Print the entries of directory dir (sdir, bench). */
+static void cli_list_dir(int dir)
 {
-    int any = 0;
-    char parent[ENIXNEL_MAX_NAME_LEN + 1];
-    char base[ENIXNEL_MAX_NAME_LEN + 1];
-
-    for (int i = 0; i < ENIXNEL_MAX_FS_ENTRIES; ++i) {
-        if (!fs_entries[i].used) {
-            continue;
-        }
-
-        path_parent(fs_entries[i].name, parent, sizeof(parent));
-        path_basename(fs_entries[i].name, base, sizeof(base));
-
-        if (!k_streq(parent, current_dir)) {
-            continue;
-        }
+    if (fs_entries[dir].first_child == FS_NONE) {
+        console_write_line("sdir: no entries");
+        return;
+    }
 
-        any = 1;
+    /* Walk only this directory's children. */
+    for (int i = fs_entries[dir].first_child; i != FS_NONE; i = fs_entries[i].next_sibling) {
         if (fs_entries[i].is_dir) {
             console_write("[DIR]  ");
         } else {
             console_write("[FILE] ");
         }
-        console_write_line(base);
+        console_write_line(fs_entry_basename(i));
     }
+}
 
-    if (!any) {
-        console_write_line("sdir: no entries");
-    }
+static void cli_cmd_sdir(const char* args)
+{
+    (void)args;
+    cli_list_dir(fs_cwd());
 }
 
-static void cli_cmd_clr(void)
+static void cli_cmd_clr(const char* args)
 {
+    (void)args;
     console_clear();
 }
 
 static void cli_cmd_sfile(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
-    const char* data = 0;
-    size_t len = 0;
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -621,22 +362,29 @@ static void cli_cmd_sfile(const char* args)
         return;
     }
 
-    path_join(current_dir, name, full, sizeof(full));
-
-    if (fs_read_file(full, &data, &len) != 0) {
+    int fd = fs_open(name, 0);
+    if (fd < 0) {
         console_write("sfile: no such file: ");
         console_write_line(name);
         return;
     }
 
-    for (size_t i = 0; i < len; ++i) {
-        console_putc(data[i]);
+    /* Print the file run by run straight from its storage; the screen is
+     * redrawn once at the end rather than per line. */
+    fs_stream_t s;
+    const char* data;
+    size_t len;
+    fs_stream_open(&s, fd, 0);
+    while ((len = fs_stream_next(&s, &data)) > 0) {
+        console_put_n(data, len);
     }
+    fs_close(fd);
     console_putc('\n');
 }
 
 /* efile syntax: efile text > file.txt  (overwrite)
  *                efile text >> file.txt (append)
+ * With no text, a piped-in input is written instead (sdir | efile > f).
  */
 static void cli_cmd_efile(const char* args)
 {
@@ -673,14 +421,7 @@ static void cli_cmd_efile(const char* args)
         --text_end;
     }
 
-    char text[ENIXNEL_MAX_FILE_SIZE];
     size_t text_len = (size_t)(text_end - text_start);
-    if (text_len >= sizeof(text)) {
-        text_len = sizeof(text) - 1;
-    }
-    for (size_t i = 0; i < text_len; ++i) {
-        text[i] = text_start[i];
-    }
 
     int append = 0;
     const char* after = redir + 1;
@@ -704,30 +445,189 @@ static void cli_cmd_efile(const char* args)
         ++fname_end;
     }
 
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
     size_t name_len = (size_t)(fname_end - fname_start);
     if (name_len >= sizeof(name)) {
         name_len = sizeof(name) - 1;
     }
-    for (size_t i = 0; i < name_len; ++i) {
-        name[i] = fname_start[i];
-    }
+    memcpy(name, fname_start, name_len);
     name[name_len] = '\0';
 
-    char full[ENIXNEL_MAX_NAME_LEN + 1];
-    path_join(current_dir, name, full, sizeof(full));
-
-    if (fs_write_file(full, text, text_len, append) != 0) {
+    /* The text is stored straight from the command line or the pipe. */
+    if (text_len == 0 && cli_input) {
+        text_start = cli_input;
+        text_len = cli_input_len;
+    }
+    if (fs_write_file(name, text_start, text_len, append) != 0) {
         console_write("efile: failed to write ");
         console_write_line(name);
     }
 }
 
-/* Change directory: cd <name> or cd .. */
+/* Move/rename: mv <src> <dst>. If dst is an existing directory, src is
+ * moved into it under its current name.
+ */
+static void cli_cmd_mv(const char* args)
+{
+    char src[CLI_PATH_MAX];
+    char dst[CLI_PATH_MAX];
+
+    cli_first_arg(args, src, sizeof(src));
+    cli_second_arg(args, dst, sizeof(dst));
+    if (src[0] == '\0' || dst[0] == '\0') {
+        console_write_line("mv: usage: mv <src> <dst>");
+        return;
+    }
+
+    const char* target = dst;
+    char into[CLI_PATH_MAX + ENIXNEL_MAX_NAME_LEN + 1];
+    int src_idx = fs_find_index(src);
+    int dst_idx = fs_find_index(dst);
+    if (src_idx >= 0 && dst_idx >= 0 && fs_entries[dst_idx].is_dir &&
+        path_join(dst, fs_entry_basename(src_idx), into, sizeof(into)) == 0) {
+        target = into;
+    }
+
+    /* The working directory is a node, so it follows a move for free. */
+    if (fs_rename(src, target) != 0) {
+        console_write("mv: failed to move ");
+        console_write_line(src);
+    }
+}
+
+/* Copy: cp <src> <dst>, directories included. If dst is an existing
+ * directory, src is copied into it under its current name. Files share
+ * their blocks with the original until either side writes them.
+ */
+static void cli_cmd_cp(const char* args)
+{
+    char src[CLI_PATH_MAX];
+    char dst[CLI_PATH_MAX];
+
+    cli_first_arg(args, src, sizeof(src));
+    cli_second_arg(args, dst, sizeof(dst));
+    if (src[0] == '\0' || dst[0] == '\0') {
+        console_write_line("cp: usage: cp <src> <dst>");
+        return;
+    }
+
+    const char* target = dst;
+    char into[CLI_PATH_MAX + ENIXNEL_MAX_NAME_LEN + 1];
+    int src_idx = fs_find_index(src);
+    int dst_idx = fs_find_index(dst);
+    if (src_idx >= 0 && dst_idx >= 0 && fs_entries[dst_idx].is_dir &&
+        path_join(dst, fs_entry_basename(src_idx), into, sizeof(into)) == 0) {
+        target = into;
+    }
+
+    if (fs_clone(src, target) != 0) {
+        console_write("cp: failed to copy ");
+        console_write_line(src);
+    }
+}
+
+/* Snapshot: snap <path> <name> keeps a copy of path as /snap/<name>. */
+static void cli_cmd_snap(const char* args)
+{
+    char src[CLI_PATH_MAX];
+    char name[CLI_PATH_MAX];
+    char target[CLI_PATH_MAX];
+
+    cli_first_arg(args, src, sizeof(src));
+    cli_second_arg(args, name, sizeof(name));
+    if (src[0] == '\0' || name[0] == '\0' || path_join("/snap", name, target, sizeof(target)) != 0) {
+        console_write_line("snap: usage: snap <path> <name>");
+        return;
+    }
+
+    size_t before = fs_blocks_used();
+    fs_create_dir("/snap");
+    if (fs_clone(src, target) != 0) {
+        console_write("snap: failed to snapshot ");
+        console_write_line(src);
+        return;
+    }
+    console_write("Snapshot created: ");
+    console_write(target);
+    console_write(" (");
+    console_write_dec((uint32_t)(fs_blocks_used() - before));
+    console_write_line(" new blocks)");
+}
+
+/* find <prefix|glob>: every entry whose name starts with prefix, or
+ * matches a pattern with '*' and '?', by full path. The names come from
+ * the trie, so the cost follows the matches rather than the tree's size.
+ */
+static int cli_find_print(uint32_t name, void* ctx)
+{
+    size_t* found = (size_t*)ctx;
+    char path[4 * CLI_LINE_MAX];    /* deeper paths print as .../name */
+
+    for (int i = fs_name_first(name); i != FS_NONE; i = fs_entries[i].name_next) {
+        console_putc('/');
+        if (fs_build_path(i, path, sizeof(path)) >= 0) {
+            console_write(path);
+        } else {
+            console_write(".../");
+            console_write(fs_entry_basename(i));
+        }
+        console_write_line(fs_entries[i].is_dir ? "/" : "");
+        ++*found;
+    }
+    return 0;
+}
+
+static void cli_cmd_find(const char* args)
+{
+    char pattern[CLI_PATH_MAX];
+
+    cli_first_arg(args, pattern, sizeof(pattern));
+    if (pattern[0] == '\0') {
+        console_write_line("find: usage: find <prefix|glob>");
+        return;
+    }
+
+    size_t found = 0;
+    fs_find_names(pattern, cli_find_print, &found);
+    if (found == 0) {
+        console_write_line("find: no matches");
+    }
+}
+
+/* grep <text>: the lines of the piped-in input that contain text. */
+static void cli_cmd_grep(const char* args)
+{
+    size_t tlen = strlen(args);
+    if (tlen == 0) {
+        console_write_line("grep: usage: <command> | grep <text>");
+        return;
+    }
+    if (!cli_input) {
+        console_write_line("grep: no input (pipe a command into it)");
+        return;
+    }
+
+    const char* end = cli_input + cli_input_len;
+    for (const char* line = cli_input; line < end; ) {
+        const char* eol = line;
+        while (eol < end && *eol != '\n') {
+            ++eol;
+        }
+        for (const char* p = line; p + tlen <= eol; ++p) {
+            if (memcmp(p, args, tlen) == 0) {
+                console_put_n(line, (size_t)(eol - line));
+                console_putc('\n');
+                break;
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+/* Change directory: cd <path>, including "..", "." and "/..." */
 static void cli_cmd_cd(const char* args)
 {
-    char name[ENIXNEL_MAX_NAME_LEN + 1];
-    char target[ENIXNEL_MAX_NAME_LEN + 1];
+    char name[CLI_PATH_MAX];
 
     cli_first_arg(args, name, sizeof(name));
     if (name[0] == '\0') {
@@ -735,46 +635,152 @@ static void cli_cmd_cd(const char* args)
         return;
     }
 
-    if (k_streq(name, ".")) {
-        /* Stay in current directory */
+    if (fs_chdir(name) != 0) {
+        console_write("cd: no such directory: ");
+        console_write_line(name);
+    }
+}
+
+/* Benchmarks: bench [fs|sdir|console], all groups by default. */
+static void cli_cmd_bench(const char* args)
+{
+    char group[16];
+    cli_first_arg(args, group, sizeof(group));
+    if (bench_run(group, cli_list_dir) != 0) {
+        console_write("bench: unknown group: ");
+        console_write_line(group);
+    }
+}
+
+/* Cycle counts: stats prints them, stats reset clears them. */
+static void cli_cmd_stats(const char* args)
+{
+#ifdef ENIXNEL_STATS
+    char opt[8];
+    cli_first_arg(args, opt, sizeof(opt));
+    if (strcmp(opt, "reset") == 0) {
+        kstat_reset(cli_command_stats, CLI_COMMAND_COUNT);
+        kstat_reset(kstat_fs, KSTAT_FS_COUNT);
+        return;
+    }
+    if (opt[0] != '\0') {
+        console_write_line("stats: usage: stats [reset]");
         return;
     }
 
-    if (k_streq(name, "..")) {
-        /* Go to parent of current_dir */
-        char parent[ENIXNEL_MAX_NAME_LEN + 1];
-        path_parent(current_dir, parent, sizeof(parent));
-        /* parent may be "" (root) */
-        /* Copy back to current_dir */
-        size_t i = 0;
-        while (parent[i] && i < sizeof(current_dir) - 1) {
-            current_dir[i] = parent[i];
-            ++i;
+    console_write_line("  name               calls  total cycles    avg cyc  max cycles");
+    kstat_print(cli_command_stats, CLI_COMMAND_COUNT);
+    kstat_print(kstat_fs, KSTAT_FS_COUNT);
+#else
+    (void)args;
+    console_write_line("stats: not built in (make STATS=1)");
+#endif
+}
+
+/* Tracepoints: trace start clears and arms them, trace stop pauses them,
+ * trace dump sends what was recorded over COM1 for tools/trace.py.
+ */
+static void cli_cmd_trace(const char* args)
+{
+#ifdef ENIXNEL_TRACE
+    char opt[8];
+    cli_first_arg(args, opt, sizeof(opt));
+    if (strcmp(opt, "start") == 0) {
+        if (trace_start() != 0) {
+            console_write_line("trace: out of memory");
         }
-        current_dir[i] = '\0';
-        return;
+    } else if (strcmp(opt, "stop") == 0) {
+        trace_stop();
+    } else if (strcmp(opt, "dump") == 0) {
+        int n = trace_dump();
+        if (n < 0) {
+            console_write_line("trace: no serial port");
+            return;
+        }
+        console_putc('\n');    /* after the binary, for a terminal's sake */
+        console_write("trace: ");
+        console_write_dec((uint32_t)n);
+        console_write_line(" events sent over COM1");
+    } else {
+        console_write_line("trace: usage: trace start|stop|dump");
     }
+#else
+    (void)args;
+    console_write_line("trace: not built in (make TRACE=1)");
+#endif
+}
 
-    /* Normal cd: join current_dir and name, and require that it's a directory */
-    path_join(current_dir, name, target, sizeof(target));
+/* Kernel threads and their state. */
+static void cli_cmd_ps(const char* args)
+{
+    (void)args;
+    sched_print();
+}
 
-    int idx = fs_find_index(target);
-    if (idx < 0 || !fs_entries[idx].used || !fs_entries[idx].is_dir) {
-        console_write("cd: no such directory: ");
-        console_write_line(name);
+/* Commit fs changes to the disk journal now rather than at the next interval. */
+static void cli_cmd_sync(const char* args)
+{
+    (void)args;
+    if (!fs_disk_mounted()) {
+        console_write_line("sync: no disk, files are in memory only");
         return;
     }
+    if (fs_sync() != 0) {
+        console_write_line("sync: write failed");
+        return;
+    }
+
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    console_write("Cache: ");
+    console_write_dec(st.hits);
+    console_write(" hits, ");
+    console_write_dec(st.misses);
+    console_write(" misses (");
+    console_write_dec(st.readahead);
+    console_write(" read ahead); ");
+    console_write_dec(st.blocks_written);
+    console_write(" blocks written in ");
+    console_write_dec(st.write_requests);
+    console_write_line(" requests");
+
+    journal_stats_t js;
+    journal_get_stats(&js);
+    console_write("Journal: ");
+    console_write_dec(js.commits);
+    console_write(" commits, ");
+    console_write_dec(js.blocks_logged);
+    console_write(" blocks logged, ");
+    console_write_dec(js.checkpoints);
+    console_write_line(" checkpoints");
+}
 
-    /* Set new current_dir */
-    size_t i = 0;
-    while (target[i] && i < sizeof(current_dir) - 1) {
-        current_dir[i] = target[i];
-        ++i;
+/* Leave the emulator (isa-debug-exit) with the given code, or halt. */
+static void cli_cmd_shutdown(const char* args)
+{
+    uint32_t code = 0;
+    const char* p = args;
+    while (*p >= '0' && *p <= '9' && code <= 0xFF) {
+        code = code * 10 + (uint32_t)(*p++ - '0');
+    }
+    while (*p == ' ') {
+        ++p;
+    }
+    if (code > 0xFF || *p != '\0') {
+        console_write_line("shutdown: code must be 0-255");
+        return;
     }
-    current_dir[i] = '\0';
+    if (fs_sync() != 0) {
+        console_write_line("shutdown: could not write the fs back to disk");
+    }
+    console_write_line("Shutting down.");
+    power_exit((uint8_t)code);
 }
 
-static void cli_handle_line(const char* line)
+/* ---------- Scripts and pipes ---------- */
+
+/* One command, no '|'. Callers hold fs_mutex. */
+static void cli_run_command(const char* line)
 {
     char cmd[16];
     const char* args = 0;
@@ -785,51 +791,373 @@ static void cli_handle_line(const char* line)
         return; /* empty line */
     }
 
-    if (k_streq(cmd, "help")) {
-        cli_cmd_help();
-    } else if (k_streq(cmd, "echo")) {
-        cli_cmd_echo(args);
-    } else if (k_streq(cmd, "crtdir")) {
-        cli_cmd_crtdir(args);
-    } else if (k_streq(cmd, "cfile")) {
-        cli_cmd_cfile(args);
-    } else if (k_streq(cmd, "deldir")) {
-        cli_cmd_deldir(args);
-    } else if (k_streq(cmd, "dfile")) {
-        cli_cmd_dfile(args);
-    } else if (k_streq(cmd, "sdir")) {
-        cli_cmd_sdir();
-    } else if (k_streq(cmd, "sfile")) {
-        cli_cmd_sfile(args);
-    } else if (k_streq(cmd, "efile")) {
-        cli_cmd_efile(args);
-    } else if (k_streq(cmd, "clr")) {
-        cli_cmd_clr();
-    } else if (k_streq(cmd, "cd")) {
-        cli_cmd_cd(args);
+    const cli_command_t* c = cli_find_command(cmd);
+    if (c) {
+        KSTAT_SCOPE(&cli_command_stats[c - cli_commands]);
+        c->handler(args);
     } else {
         console_write("Unknown command: ");
         console_write_line(cmd);
     }
 }
 
+/*
+ * One command line, with fs_mutex held. In "a | b | c" the stages run in
+ * turn: a's output is captured in a CLI_PIPE_SIZE buffer that b reads as
+ * its input, and so on; only c prints. A stage is done before the next
+ * starts, so output past a full buffer is dropped, and reported once the
+ * line is through.
+ */
+static void cli_run_line(const char* line)
+{
+    const char* p = line;
+    while (*p && *p != '|') {
+        ++p;
+    }
+    if (*p == '\0') {
+        cli_run_command(line);
+        return;
+    }
+
+    char* bufs = (char*)pmm_alloc_pages(1);    /* two buffers, used in turn */
+    if (!bufs) {
+        console_write_line("pipe: out of memory");
+        return;
+    }
+
+    const char* saved_input = cli_input;
+    size_t saved_len = cli_input_len;
+    size_t dropped = 0;
+    console_pipe_t pipe;
+    char stage[CLI_LINE_MAX];
+
+    for (int cur = 0; ; cur ^= 1) {
+        const char* end = line;
+        while (*end && *end != '|') {
+            ++end;
+        }
+        size_t n = (size_t)(end - line);
+        while (n > 0 && line[n - 1] == ' ') {
+            --n;    /* "a | b": args end before the space */
+        }
+        if (n >= sizeof(stage)) {
+            n = sizeof(stage) - 1;
+        }
+        memcpy(stage, line, n);
+        stage[n] = '\0';
+
+        if (*end == '\0') {
+            cli_run_command(stage);     /* to the screen, or an outer pipe */
+            break;
+        }
+
+        pipe.buf = bufs + cur * CLI_PIPE_SIZE;
+        pipe.size = CLI_PIPE_SIZE;
+        pipe.len = 0;
+        pipe.dropped = 0;
+        console_pipe_t* outer = console_redirect(&pipe);
+        cli_run_command(stage);
+        console_redirect(outer);
+
+        dropped += pipe.dropped;
+        cli_input = pipe.buf;
+        cli_input_len = pipe.len;
+        line = end + 1;
+    }
+
+    cli_input = saved_input;
+    cli_input_len = saved_len;
+    pmm_free_pages(bufs, 1);
+    if (dropped) {
+        console_write("pipe: ");
+        console_write_dec((uint32_t)dropped);
+        console_write_line(" bytes dropped (buffer full)");
+    }
+}
+
+/* Next line of a script at *off into line (size bytes), without its
+ * '\n' or a '\r' before it. Returns 1, 0 at the end of the file, or -1
+ * for a line that does not fit (skipped).
+ */
+static int cli_script_line(int fd, size_t* off, char* line, size_t size)
+{
+    int n = fs_pread(fd, line, size - 1, *off);
+    if (n <= 0) {
+        return 0;
+    }
+
+    int len = 0;
+    while (len < n && line[len] != '\n') {
+        ++len;
+    }
+    /* A full buffer without a newline still fits when the file ends or
+     * the newline comes right after it. */
+    int eol = len < n;
+    int fits = eol || (size_t)n < size - 1;
+    if (!fits) {
+        char c;
+        int more = fs_pread(fd, &c, 1, *off + (size_t)n);
+        eol = more > 0 && c == '\n';
+        fits = more <= 0 || eol;
+    }
+    if (fits) {
+        *off += (size_t)len + (eol ? 1 : 0);
+        if (len > 0 && line[len - 1] == '\r') {
+            --len;
+        }
+        line[len] = '\0';
+        return 1;
+    }
+
+    /* Too long: skip to the next line. */
+    do {
+        *off += (size_t)n;
+        n = fs_pread(fd, line, size - 1, *off);
+        len = 0;
+        while (len < n && line[len] != '\n') {
+            ++len;
+        }
+    } while (n > 0 && len == n);
+    if (n > 0) {
+        *off += (size_t)len + 1;
+    }
+    return -1;
+}
+
+static int cli_run_depth = 0;
+
+/* run [-q] <file>: each line as if typed at the prompt, skipping blank
+ * lines and '#' comments. -q throws the output away, so a bulk workload
+ * does not wait for the screen. fs_mutex is let go between lines, which
+ * gives the sync thread its turn during a long script.
+ */
+static void cli_cmd_run(const char* args)
+{
+    char name[CLI_PATH_MAX];
+    int quiet = 0;
+
+    cli_first_arg(args, name, sizeof(name));
+    if (strcmp(name, "-q") == 0) {
+        quiet = 1;
+        cli_second_arg(args, name, sizeof(name));
+    }
+    if (name[0] == '\0') {
+        console_write_line("run: usage: run [-q] <file>");
+        return;
+    }
+    if (cli_run_depth >= CLI_RUN_DEPTH) {
+        console_write_line("run: scripts nested too deep");
+        return;
+    }
+
+    int fd = fs_open(name, 0);
+    if (fd < 0) {
+        console_write("run: no such file: ");
+        console_write_line(name);
+        return;
+    }
+
+    /* A pipe with no room: everything printed is counted and dropped. */
+    console_pipe_t discard = { 0, 0, 0, 0 };
+    console_pipe_t* outer = quiet ? console_redirect(&discard) : 0;
+    ++cli_run_depth;
+
+    char line[CLI_LINE_MAX];
+    size_t off = 0;
+    uint32_t lineno = 0;
+    int rc;
+    while ((rc = cli_script_line(fd, &off, line, sizeof(line))) != 0) {
+        ++lineno;
+        if (rc < 0) {
+            console_write("run: line ");
+            console_write_dec(lineno);
+            console_write_line(" too long, skipped");
+            continue;
+        }
+        const char* p = line;
+        while (*p == ' ') {
+            ++p;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        cli_run_line(p);
+
+        mutex_unlock(&fs_mutex);
+        mutex_lock(&fs_mutex);
+    }
+
+    --cli_run_depth;
+    if (quiet) {
+        console_redirect(outer);
+    }
+    fs_close(fd);   /* fails harmlessly if the script deleted itself */
+}
+
+static void cli_handle_line(const char* line)
+{
+    mutex_lock(&fs_mutex);
+    cli_run_line(line);
+    mutex_unlock(&fs_mutex);
+}
+
 static void cli_print_prompt(void)
 {
-    /* Show a simple PWD-style prefix in the prompt */
-    if (current_dir[0] == '\0') {
-        /* Root */
-        console_write("/$ ");
+    /* Show a simple PWD-style prefix in the prompt, from the node up */
+    char path[CLI_LINE_MAX];
+    int cwd = fs_cwd();
+    console_putc('/');
+    if (fs_build_path(cwd, path, sizeof(path)) >= 0) {
+        console_write(path);
     } else {
-        console_putc('/');
-        console_write(current_dir);
-        console_write("$ ");
+        console_write(".../");
+        console_write(fs_entry_basename(cwd));
+    }
+    console_write("$ ");
+}
+
+/* ---------- Tab completion ---------- */
+
+/* What the word being completed can still become. */
+typedef struct cli_matches {
+    int         dir;            /* directory searched, for paths */
+    const char* prefix;
+    size_t      prefix_len;
+    size_t      count;
+    char        common[CLI_LINE_MAX];   /* longest prefix shared by all */
+    size_t      common_len;
+    int         is_dir;         /* of the last match (the only one, if count is 1) */
+    int         list;           /* print each match instead */
+} cli_matches_t;
+
+static void cli_match_add(cli_matches_t* m, const char* name, size_t len, int is_dir)
+{
+    if (m->list) {
+        console_write(name);
+        console_write(is_dir ? "/  " : "  ");
+        return;
+    }
+
+    if (m->count == 0) {
+        m->common_len = len < sizeof(m->common) ? len : sizeof(m->common) - 1;
+        memcpy(m->common, name, m->common_len);
+    } else {
+        size_t k = 0;
+        while (k < m->common_len && k < len && m->common[k] == name[k]) {
+            ++k;
+        }
+        m->common_len = k;
+    }
+    m->is_dir = is_dir;
+    ++m->count;
+}
+
+/* fs_trie_walk() callback: keep the names that exist in m->dir. */
+static int cli_match_name(uint32_t name, void* ctx)
+{
+    cli_matches_t* m = (cli_matches_t*)ctx;
+    const char* s = fs_name_str(name);
+    size_t len = fs_name_len(name);
+    int idx = fs_index_lookup(m->dir, s, len, fs_name_hash(m->dir, s, len));
+    if (idx >= 0) {
+        cli_match_add(m, s, len, fs_entries[idx].is_dir);
+    }
+    return 0;
+}
+
+static void cli_collect_matches(cli_matches_t* m)
+{
+    if (m->dir == FS_NONE) {
+        for (size_t i = 0; i < CLI_COMMAND_COUNT; ++i) {
+            const char* name = cli_commands[i].name;
+            size_t len = strlen(name);
+            if (len >= m->prefix_len && memcmp(name, m->prefix, m->prefix_len) == 0) {
+                cli_match_add(m, name, len, 0);
+            }
+        }
+    } else if (m->prefix_len == 0) {
+        /* Everything in the directory: its own list beats every name. */
+        for (int i = fs_entries[m->dir].first_child; i != FS_NONE; i = fs_entries[i].next_sibling) {
+            cli_match_add(m, fs_entry_basename(i), fs_name_len(fs_entries[i].name),
+                          fs_entries[i].is_dir);
+        }
+    } else {
+        fs_trie_walk(m->prefix, m->prefix_len, cli_match_name, m);
+    }
+}
+
+/*
+ * console_read_line() completer: the first word completes to a command,
+ * later ones to a path, one component at a time. A unique match is
+ * finished with ' ' (or '/' for a directory), several are extended to
+ * what they share, and a second Tab lists them.
+ */
+static size_t cli_complete(char* buf, size_t len, size_t buflen, int again)
+{
+    size_t start = len;
+    while (start > 0 && buf[start - 1] != ' ') {
+        --start;
     }
+    size_t first = 0;
+    while (first < start && buf[first] == ' ') {
+        ++first;
+    }
+
+    cli_matches_t m;
+    m.dir = FS_NONE;
+    m.prefix = buf + start;
+    m.prefix_len = len - start;
+    m.count = 0;
+    m.common_len = 0;
+    m.is_dir = 0;
+    m.list = 0;
+
+    mutex_lock(&fs_mutex);
+    if (first < start) {
+        /* "a/b/pre" looks in a/b for names starting with "pre". */
+        size_t slash = m.prefix_len;
+        while (slash > 0 && m.prefix[slash - 1] != '/') {
+            --slash;
+        }
+        char dir[CLI_PATH_MAX];
+        size_t dlen = slash > 1 ? slash - 1 : slash;    /* keep a lone leading '/' */
+        memcpy(dir, m.prefix, dlen);
+        dir[dlen] = '\0';
+        m.dir = fs_find_index(dir);
+        m.prefix += slash;
+        m.prefix_len -= slash;
+        if (m.dir < 0 || !fs_entries[m.dir].is_dir) {
+            mutex_unlock(&fs_mutex);
+            return len;
+        }
+    }
+    cli_collect_matches(&m);
+
+    size_t old_len = len;
+    for (size_t i = m.prefix_len; i < m.common_len && len + 1 < buflen; ++i) {
+        buf[len++] = m.common[i];
+    }
+    if (m.count == 1 && len + 1 < buflen) {
+        buf[len++] = (m.dir != FS_NONE && m.is_dir) ? '/' : ' ';
+    } else if (m.count > 1 && len == old_len && again) {
+        buf[len] = '\0';
+        m.list = 1;
+        console_putc('\n');
+        cli_collect_matches(&m);
+        console_putc('\n');
+        cli_print_prompt();
+        console_write(buf);
+    }
+    mutex_unlock(&fs_mutex);
+    buf[len] = '\0';
+    return len;
 }
 
 static void cli_loop(void)
 {
-    char line[128];
+    char line[CLI_LINE_MAX];
 
+    console_set_completer(cli_complete);
     for (;;) {
         cli_print_prompt();
         console_read_line(line, sizeof(line));
@@ -837,12 +1165,115 @@ static void cli_loop(void)
     }
 }
 
-void kernel_main(void)
+static void cli_thread(void* arg)
+{
+    (void)arg;
+    cli_loop();
+}
+
+/* Report usable RAM, or why the page allocator is unavailable. */
+static void kernel_init_memory(uint32_t magic, const multiboot_info_t* mbi)
+{
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        console_write_line("Memory: not booted by Multiboot, no page allocator");
+        return;
+    }
+    if (pmm_init(mbi) != 0) {
+        console_write_line("Memory: no usable memory map, no page allocator");
+        return;
+    }
+
+    console_write("Memory: ");
+    console_write_dec((uint32_t)(pmm_free_pages_count() * (PAGE_SIZE / 1024)));
+    console_write_line(" KiB free");
+
+    if (paging_init() != 0) {
+        console_write_line("Paging: out of memory for page tables, staying unpaged");
+    }
+}
+
+/* Probe the ATA disk and give it a block cache (needs the page allocator). */
+static void kernel_init_disk(void)
 {
+    if (ata_init() != 0) {
+        console_write_line("Disk: none, files are kept in memory only");
+        return;
+    }
+    uint32_t blocks = ata_sectors() / ATA_PAGE_SECTORS;
+    if (bcache_init(blocks) != 0) {
+        console_write_line("Disk: no memory for the block cache");
+        return;
+    }
+
+    console_write("Disk: ");
+    console_write_dec(blocks * (BCACHE_BLOCK_SIZE / 1024));
+    console_write_line(ata_dma() ? " KiB, ATA bus-master DMA" : " KiB, ATA PIO");
+}
+
+/* Find the boot image among the Multiboot modules. */
+static void kernel_init_initrd(uint32_t magic, const multiboot_info_t* mbi)
+{
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || initrd_init(mbi) != 0) {
+        console_write_line("Initrd: none");
+        return;
+    }
+    console_write("Initrd: ");
+    console_write_dec(initrd_count());
+    console_write(" entries, ");
+    console_write_dec((initrd_size() + 1023) / 1024);
+    console_write_line(" KiB");
+}
+
+/* 1 if the Multiboot command line holds the word opt. */
+static int kernel_has_option(uint32_t magic, const multiboot_info_t* mbi, const char* opt)
+{
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !(mbi->flags & MULTIBOOT_INFO_CMDLINE)) {
+        return 0;
+    }
+
+    size_t len = strlen(opt);
+    const char* p = (const char*)mbi->cmdline;
+    while (*p) {
+        while (*p == ' ') {
+            ++p;
+        }
+        const char* word = p;
+        while (*p && *p != ' ') {
+            ++p;
+        }
+        if ((size_t)(p - word) == len && memcmp(word, opt, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void kernel_main(uint32_t magic, const multiboot_info_t* mbi)
+{
+    /* Descriptor tables first: everything after may take interrupts. */
+    gdt_init();
+    idt_init();
+    apic_init();        /* I/O APIC routing, if any, before drivers unmask */
+    keyboard_init();
+    serial_init();      /* before any output, so COM1 sees all of it */
+    timer_init();
+    interrupts_enable();
+
     console_clear();
     console_write_line("Welcome to Enixnel");
     console_write_line("-------------------");
     console_write_line("");
+
+    /* autorun: commands arrive over COM1 from a script (make perf), and
+     * faults end the run through isa-debug-exit instead of halting. */
+    if (kernel_has_option(magic, mbi, "autorun")) {
+        power_set_batch(1);
+        console_write_line("Batch mode: faults exit the emulator");
+    }
+
+    kernel_init_memory(magic, mbi);
+    kernel_init_disk();
+    kernel_init_initrd(magic, mbi);
     console_write_line("Type 'help' for a list of commands.");
     console_write_line("");
 
@@ -850,8 +1281,21 @@ void kernel_main(void)
     fs_init_layout();
 
     /* Start the user in /user by default */
-    current_dir[0] = '\0';
-    path_join("", "user", current_dir, sizeof(current_dir));
-
+    fs_chdir("user");
+
+    /* The shell gets its own thread; the boot context stays on as idle. */
+    if (sched_init() == 0) {
+        smp_init();
+        console_write("CPUs: ");
+        console_write_dec(smp_cpu_count());
+        console_write_line(apic_active() ? " online" : " online (no APIC)");
+        if (fs_disk_mounted() && !thread_create("fsync", fs_sync_thread, 0)) {
+            console_write_line("Filesystem: no sync thread, use sync to save changes");
+        }
+        if (thread_create("shell", cli_thread, 0)) {
+            sched_idle();
+        }
+    }
+    console_write_line("Threads: out of memory, shell runs on the boot stack");
     cli_loop();
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+#include "kstat.h"
+#include "string.h"
+
+/*
+ * Rename/move side of the simple in-memory "filesystem" for Enixnel.
+ *
+ * Entries store only their last path component and are indexed by
+ * (parent, component), so moving an entry relinks and rehashes that one
+ * node. Descendants keep pointing at it through their parent index and
+ * need no changes, however large the subtree is.
+ *
+ * Exposed API (declared in fs.h):
+ *
+ *   int fs_rename(const char* old_name, const char* new_name);
+ *
+ * Returns 0 on success, <0 on error.
+ */
+
+int fs_rename(const char* old_name, const char* new_name)
+{
+    KSTAT_FS(FS_RENAME);
+    int idx = fs_find_index(old_name);
+    if (idx < 0 || idx == FS_ROOT_INDEX) {
+        return -1;  /* not found, or the root */
+    }
+
+    const char* leaf;
+    size_t leaf_len;
+    int parent = fs_resolve_parent(new_name, &leaf, &leaf_len);
+    if (parent < 0) {
+        return -1;  /* target directory missing */
+    }
+
+    uint32_t hash = fs_name_hash(parent, leaf, leaf_len);
+    if (fs_index_lookup(parent, leaf, leaf_len, hash) >= 0) {
+        return -1;  /* target already exists (includes renaming to itself) */
+    }
+
+    if (fs_is_within(parent, idx)) {
+        return -1;  /* cannot move a directory into its own subtree */
+    }
+
+    uint32_t name = fs_name_intern(leaf, leaf_len);
+    if (name == FS_NAME_NONE) {
+        return -1;
+    }
+
+    /* Take the node out under its old key, then relink under the new one. */
+    fs_index_remove(idx);
+    fs_unlink_child(idx);
+
+    fs_entry_t* e = &fs_entries[idx];
+    fs_name_release(e->name);
+    e->name = name;
+    e->hash = hash;
+
+    fs_link_child(parent, idx);
+    fs_index_insert(idx);
+
+    return 0;
+}
@@ -0,0 +1,352 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "pmm.h"
+#include "spinlock.h"
+#include "string.h"
+
+/*
+ * Buddy page frame allocator for Enixnel.
+ *
+ * Every page frame up to the highest usable address gets one byte of
+ * state in pmm_pages[]. The first page of a free block is tagged with
+ * PMM_PAGE_FREE and the block's order; all other pages are either in use
+ * or the tail of some block. Free blocks of each order sit on a doubly
+ * linked list whose nodes live inside the free pages themselves, so the
+ * only fixed cost is the state array, placed in the first usable gap
+ * after the kernel image and the boot information.
+ *
+ * Freeing a block merges it with its buddy (pfn ^ (1 << order)) for as
+ * long as the buddy is free and of the same order.
+ *
+ * pmm_lock covers the free lists and the state array once other CPUs
+ * and threads exist; pmm_init() runs before either.
+ */
+
+#define PMM_PAGE_FREE   0x80
+
+/* Memory below 1 MiB is left alone (BIOS data, real-mode trampolines). */
+#define PMM_LOW_LIMIT   0x100000u
+
+/* Linker-provided kernel image bounds (linker.ld). */
+extern char _kernel_start[];
+extern char _kernel_end[];
+
+typedef struct pmm_block {
+    struct pmm_block* next;
+    struct pmm_block* prev;
+} pmm_block_t;
+
+static pmm_block_t* pmm_free_lists[PMM_MAX_ORDER + 1];
+static uint8_t*     pmm_pages = 0;      /* one state byte per page frame */
+static size_t       pmm_page_count = 0; /* frames covered by pmm_pages */
+static size_t       pmm_total = 0;
+static size_t       pmm_free = 0;
+static spinlock_t   pmm_lock = SPINLOCK_INIT;
+
+/* ---------- Reserved ranges used while building the free lists ---------- */
+
+#define PMM_MAX_RESERVED 32     /* a few fixed ones plus two per module */
+
+typedef struct pmm_range {
+    uint32_t start;
+    uint32_t end;   /* exclusive */
+} pmm_range_t;
+
+static pmm_range_t pmm_reserved[PMM_MAX_RESERVED];
+static int         pmm_reserved_count = 0;
+
+static uint32_t pmm_align_up(uint32_t v)
+{
+    return (v + PAGE_SIZE - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+}
+
+static void pmm_reserve(uint32_t start, uint32_t end)
+{
+    if (pmm_reserved_count < PMM_MAX_RESERVED && end > start) {
+        pmm_reserved[pmm_reserved_count].start = start & ~(uint32_t)(PAGE_SIZE - 1);
+        pmm_reserved[pmm_reserved_count].end = pmm_align_up(end);
+        ++pmm_reserved_count;
+    }
+}
+
+/* A NUL-terminated string the loader left in memory, which may cross a
+ * page boundary. */
+static void pmm_reserve_string(uint32_t addr)
+{
+    pmm_reserve(addr, addr + (uint32_t)strlen((const char*)addr) + 1);
+}
+
+/* If [start, end) overlaps a reserved range, return that range's end. */
+static uint32_t pmm_overlap_end(uint32_t start, uint32_t end)
+{
+    for (int i = 0; i < pmm_reserved_count; ++i) {
+        if (start < pmm_reserved[i].end && pmm_reserved[i].start < end) {
+            return pmm_reserved[i].end;
+        }
+    }
+    return 0;
+}
+
+/* ---------- Memory map iteration ---------- */
+
+typedef void (*pmm_region_fn)(uint32_t start, uint32_t end);
+
+/* Call fn for every usable region, clipped to [1 MiB, 4 GiB). */
+static int pmm_for_each_region(const multiboot_info_t* mbi, pmm_region_fn fn)
+{
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        uint32_t p = mbi->mmap_addr;
+        uint32_t end = mbi->mmap_addr + mbi->mmap_length;
+        while (p < end) {
+            const multiboot_mmap_entry_t* m = (const multiboot_mmap_entry_t*)p;
+            if (m->type == MULTIBOOT_MEMORY_AVAILABLE && m->addr < 0x100000000ull) {
+                uint64_t top = m->addr + m->len;
+                if (top > 0xFFFFF000ull) {
+                    top = 0xFFFFF000ull;
+                }
+                uint32_t s = (uint32_t)m->addr;
+                uint32_t e = (uint32_t)top;
+                if (s < PMM_LOW_LIMIT) {
+                    s = PMM_LOW_LIMIT;
+                }
+                if (e > s) {
+                    fn(s, e);
+                }
+            }
+            p += m->size + sizeof(m->size);
+        }
+        return 0;
+    }
+
+    if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        /* Fallback: one region from 1 MiB up. */
+        fn(PMM_LOW_LIMIT, PMM_LOW_LIMIT + mbi->mem_upper * 1024u);
+        return 0;
+    }
+
+    return -1;
+}
+
+static uint32_t pmm_highest = 0;
+
+static void pmm_note_highest(uint32_t start, uint32_t end)
+{
+    (void)start;
+    if (end > pmm_highest) {
+        pmm_highest = end;
+    }
+}
+
+static uint32_t pmm_meta_size = 0;
+static uint32_t pmm_meta_addr = 0;
+
+/* First fit for the state array, stepping over reserved ranges. */
+static void pmm_place_meta(uint32_t start, uint32_t end)
+{
+    if (pmm_meta_addr) {
+        return;
+    }
+
+    uint32_t cand = pmm_align_up(start);
+    while (cand + pmm_meta_size > cand && cand + pmm_meta_size <= end) {
+        uint32_t skip = pmm_overlap_end(cand, cand + pmm_meta_size);
+        if (!skip) {
+            pmm_meta_addr = cand;
+            return;
+        }
+        cand = skip;
+    }
+}
+
+/* ---------- Buddy free lists ---------- */
+
+static void pmm_list_push(unsigned order, pmm_block_t* b)
+{
+    b->prev = 0;
+    b->next = pmm_free_lists[order];
+    if (b->next) {
+        b->next->prev = b;
+    }
+    pmm_free_lists[order] = b;
+}
+
+static void pmm_list_remove(unsigned order, pmm_block_t* b)
+{
+    if (b->prev) {
+        b->prev->next = b->next;
+    } else {
+        pmm_free_lists[order] = b->next;
+    }
+    if (b->next) {
+        b->next->prev = b->prev;
+    }
+}
+
+static void pmm_free_block(size_t pfn, unsigned order)
+{
+    pmm_free += (size_t)1 << order;
+
+    while (order < PMM_MAX_ORDER) {
+        size_t buddy = pfn ^ ((size_t)1 << order);
+        if (buddy >= pmm_page_count || pmm_pages[buddy] != (PMM_PAGE_FREE | order)) {
+            break;
+        }
+        pmm_list_remove(order, (pmm_block_t*)(buddy << PAGE_SHIFT));
+        pmm_pages[buddy] = 0;
+        pfn &= ~((size_t)1 << order);
+        ++order;
+    }
+
+    pmm_pages[pfn] = (uint8_t)(PMM_PAGE_FREE | order);
+    pmm_list_push(order, (pmm_block_t*)(pfn << PAGE_SHIFT));
+}
+
+/* Hand [start, end) to the free lists in the largest aligned blocks. */
+static void pmm_free_range(uint32_t start, uint32_t end)
+{
+    size_t pfn = pmm_align_up(start) >> PAGE_SHIFT;
+    size_t last = end >> PAGE_SHIFT;
+
+    while (pfn < last) {
+        unsigned order = 0;
+        while (order < PMM_MAX_ORDER &&
+               (pfn & (((size_t)1 << (order + 1)) - 1)) == 0 &&
+               pfn + ((size_t)1 << (order + 1)) <= last) {
+            ++order;
+        }
+        pmm_total += (size_t)1 << order;
+        pmm_free_block(pfn, order);
+        pfn += (size_t)1 << order;
+    }
+}
+
+/* Free a usable region minus every reserved range inside it. */
+static void pmm_add_region(uint32_t start, uint32_t end)
+{
+    uint32_t cur = pmm_align_up(start);
+    end &= ~(uint32_t)(PAGE_SIZE - 1);
+
+    while (cur < end) {
+        /* Lowest reserved range that still overlaps [cur, end). */
+        const pmm_range_t* hit = 0;
+        for (int i = 0; i < pmm_reserved_count; ++i) {
+            const pmm_range_t* r = &pmm_reserved[i];
+            if (r->end > cur && r->start < end && (!hit || r->start < hit->start)) {
+                hit = r;
+            }
+        }
+        if (!hit) {
+            pmm_free_range(cur, end);
+            return;
+        }
+        if (hit->start > cur) {
+            pmm_free_range(cur, hit->start);
+        }
+        cur = hit->end;
+    }
+}
+
+int pmm_init(const multiboot_info_t* mbi)
+{
+    if (!mbi) {
+        return -1;
+    }
+
+    /* Everything the kernel may still read must stay out of the lists. */
+    pmm_reserve((uint32_t)_kernel_start, (uint32_t)_kernel_end);
+    pmm_reserve((uint32_t)mbi, (uint32_t)mbi + sizeof(*mbi));
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        pmm_reserve(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+    }
+    if (mbi->flags & MULTIBOOT_INFO_CMDLINE) {
+        pmm_reserve_string(mbi->cmdline);
+    }
+    if (mbi->flags & MULTIBOOT_INFO_MODS) {
+        const multiboot_module_t* mods = (const multiboot_module_t*)mbi->mods_addr;
+        pmm_reserve(mbi->mods_addr, mbi->mods_addr + mbi->mods_count * sizeof(*mods));
+        for (uint32_t i = 0; i < mbi->mods_count; ++i) {
+            pmm_reserve(mods[i].mod_start, mods[i].mod_end);
+            if (mods[i].string) {
+                pmm_reserve_string(mods[i].string);
+            }
+        }
+    }
+
+    if (pmm_for_each_region(mbi, pmm_note_highest) != 0 || pmm_highest == 0) {
+        return -1;
+    }
+
+    pmm_page_count = pmm_highest >> PAGE_SHIFT;
+    pmm_meta_size = pmm_align_up((uint32_t)pmm_page_count);
+    pmm_for_each_region(mbi, pmm_place_meta);
+    if (!pmm_meta_addr) {
+        return -1;
+    }
+
+    pmm_pages = (uint8_t*)pmm_meta_addr;
+    memset(pmm_pages, 0, pmm_page_count);
+    pmm_reserve(pmm_meta_addr, pmm_meta_addr + pmm_meta_size);
+
+    pmm_for_each_region(mbi, pmm_add_region);
+    return 0;
+}
+
+void* pmm_alloc_pages(unsigned order)
+{
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    unsigned o = order;
+    while (o <= PMM_MAX_ORDER && !pmm_free_lists[o]) {
+        ++o;
+    }
+    if (o > PMM_MAX_ORDER) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return 0;
+    }
+
+    pmm_block_t* b = pmm_free_lists[o];
+    pmm_list_remove(o, b);
+    size_t pfn = (size_t)b >> PAGE_SHIFT;
+    pmm_pages[pfn] = 0;
+
+    /* Split down, returning the upper halves to the smaller lists. */
+    while (o > order) {
+        --o;
+        size_t half = pfn + ((size_t)1 << o);
+        pmm_pages[half] = (uint8_t)(PMM_PAGE_FREE | o);
+        pmm_list_push(o, (pmm_block_t*)(half << PAGE_SHIFT));
+    }
+
+    pmm_free -= (size_t)1 << order;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return (void*)(pfn << PAGE_SHIFT);
+}
+
+void pmm_free_pages(void* addr, unsigned order)
+{
+    size_t pfn = (size_t)addr >> PAGE_SHIFT;
+    if (!addr || order > PMM_MAX_ORDER || pfn >= pmm_page_count) {
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    pmm_free_block(pfn, order);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+size_t pmm_total_pages(void)
+{
+    return pmm_total;
+}
+
+size_t pmm_free_pages_count(void)
+{
+    return pmm_free;
+}
+
+uint32_t pmm_memory_end(void)
+{
+    return (uint32_t)pmm_page_count << PAGE_SHIFT;
+}
@@ -0,0 +1,49 @@
+#include <stdint.h>
+#include "power.h"
+#include "io.h"
+#include "serial.h"
+#include "console.h"
+
+/*
+ * Halting and shutdown for Enixnel.
+ *
+ * Every exit path drains the COM1 transmit ring first, so with the
+ * interrupt-driven serial console the last lines of output are not lost
+ * when the emulator goes away.
+ */
+
+static int power_batch_mode = 0;
+
+void power_set_batch(int on)
+{
+    power_batch_mode = on;
+}
+
+int power_batch(void)
+{
+    return power_batch_mode;
+}
+
+void power_halt(void)
+{
+    serial_flush_sync();
+    for (;;) {
+        __asm__ __volatile__("cli; hlt");
+    }
+}
+
+void power_exit(uint8_t code)
+{
+    serial_flush_sync();
+    outb(POWER_EXIT_PORT, code);
+    power_halt();   /* no isa-debug-exit device */
+}
+
+void power_fatal(void)
+{
+    console_redirect(0);    /* nothing after this may vanish into a pipe */
+    if (power_batch_mode) {
+        power_exit(POWER_EXIT_FAULT);
+    }
+    power_halt();
+}
@@ -0,0 +1,557 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "sched.h"
+#include "idt.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "timer.h"
+#include "console.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "string.h"
+#include "trace.h"
+
+/*
+ * Kernel threads and scheduling for Enixnel.
+ *
+ * Each CPU has its own run queue and runs it round robin. A thread stays
+ * on the CPU it last ran on; a CPU whose queue is empty steals the head
+ * of the longest other queue when it next switches, and an idle CPU
+ * looks for such work on every tick. New threads go to the CPU with the
+ * shortest queue. A CPU that gets work while idle is kicked with a
+ * reschedule IPI.
+ *
+ * All scheduler state is under sched_lock, always taken with interrupts
+ * off. A switch keeps holding it until isr.S has moved onto the new
+ * thread's stack (sched_switch_finish()), so no other CPU can resume the
+ * old thread while its stack is still in use here. To block, a thread
+ * queues itself under the lock and yields with the lock still held,
+ * which closes the window for lost wakeups.
+ *
+ * A thread that is not running is fully described by its saved frame
+ * pointer. A new thread gets a hand-built frame at the top of its stack
+ * that "returns" into thread_start() with interrupts enabled.
+ *
+ * A thread is on at most one list through next: a run queue, one wait
+ * queue, the sleep list or the zombie list. Exited threads are still on
+ * their own stack until they switch away, so they are freed later, by
+ * the next thread_create(), from ordinary thread context.
+ */
+
+typedef enum {
+    THREAD_RUNNING,
+    THREAD_READY,
+    THREAD_BLOCKED,
+    THREAD_SLEEPING,
+    THREAD_DEAD,
+} thread_state_t;
+
+struct thread {
+    interrupt_frame_t* frame;       /* saved context while switched out */
+    thread_state_t     state;
+    uint32_t           id;
+    uint32_t           cpu;         /* CPU it runs or is queued on */
+    const char*        name;
+    void*              stack;       /* 0 for idle threads */
+    thread_fn          fn;
+    void*              arg;
+    uint64_t           wake_tick;   /* THREAD_SLEEPING */
+    uint32_t           ticks;       /* timer ticks spent running */
+    thread_t*          next;        /* list membership, see above */
+    thread_t*          all_next;    /* every live thread, for sched_print */
+};
+
+typedef struct sched_cpu {
+    thread_t*    current;           /* 0 until the CPU joins */
+    thread_t*    idle;
+    wait_queue_t runq;
+    uint32_t     nr_ready;
+    uint32_t     slice;             /* ticks left for current */
+    int          need_resched;      /* touched by its own CPU only */
+} sched_cpu_t;
+
+static const char* const thread_state_names[] = {
+    "run", "ready", "blocked", "sleep", "dead",
+};
+
+static spinlock_t    sched_lock = SPINLOCK_INIT;
+static volatile uint32_t sched_lock_owner = 0;  /* CPU + 1 of a switch holding it */
+static sched_cpu_t   sched_cpus[SMP_MAX_CPUS];
+static kmem_cache_t* thread_cache = 0;
+static thread_t*     sched_all = 0;
+static thread_t*     sched_sleepers = 0;
+static thread_t*     sched_zombies = 0;
+static uint32_t      sched_next_id = 0;
+
+/* Only meaningful with interrupts off: a thread may migrate otherwise. */
+static sched_cpu_t* sched_this_cpu(void)
+{
+    return &sched_cpus[smp_cpu_id()];
+}
+
+uint32_t sched_lock_irqsave(void)
+{
+    return spin_lock_irqsave(&sched_lock);
+}
+
+void sched_unlock_irqrestore(uint32_t flags)
+{
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/* ---------- Queues ---------- */
+
+static void queue_push(wait_queue_t* q, thread_t* t)
+{
+    t->next = 0;
+    if (q->tail) {
+        q->tail->next = t;
+    } else {
+        q->head = t;
+    }
+    q->tail = t;
+}
+
+static thread_t* queue_pop(wait_queue_t* q)
+{
+    thread_t* t = q->head;
+    if (t) {
+        q->head = t->next;
+        if (!q->head) {
+            q->tail = 0;
+        }
+        t->next = 0;
+    }
+    return t;
+}
+
+static void runq_push(uint32_t cpu, thread_t* t)
+{
+    t->state = THREAD_READY;
+    t->cpu = cpu;
+    queue_push(&sched_cpus[cpu].runq, t);
+    ++sched_cpus[cpu].nr_ready;
+}
+
+/* Longest queue other than self's, or -1 when they are all empty. */
+static int sched_busiest(uint32_t self)
+{
+    int best = -1;
+    uint32_t most = 0;
+    for (uint32_t i = 0; i < smp_cpu_count(); ++i) {
+        if (i != self && sched_cpus[i].nr_ready > most) {
+            most = sched_cpus[i].nr_ready;
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+/* Queue t on its CPU; kick that CPU if it is idling. Lock held. */
+static void sched_make_ready(thread_t* t)
+{
+    uint32_t cpu = t->cpu;
+    runq_push(cpu, t);
+
+    sched_cpu_t* c = &sched_cpus[cpu];
+    if (c->current == c->idle) {
+        if (cpu == smp_cpu_id()) {
+            c->need_resched = 1;
+        } else {
+            smp_send_resched(cpu);
+        }
+    }
+}
+
+/* ---------- Switching ---------- */
+
+static interrupt_frame_t* sched_switch(uint32_t cpu, interrupt_frame_t* frame)
+{
+    sched_cpu_t* c = &sched_cpus[cpu];
+    thread_t* prev = c->current;
+    prev->frame = frame;
+    if (prev->state == THREAD_RUNNING && prev != c->idle) {
+        runq_push(cpu, prev);
+    }
+
+    thread_t* next = queue_pop(&c->runq);
+    if (next) {
+        --c->nr_ready;
+    } else {
+        int victim = sched_busiest(cpu);
+        if (victim >= 0) {
+            next = queue_pop(&sched_cpus[victim].runq);
+            --sched_cpus[victim].nr_ready;
+            next->cpu = cpu;
+        } else {
+            next = c->idle;
+        }
+    }
+
+    next->state = THREAD_RUNNING;
+    c->current = next;
+    c->slice = SCHED_QUANTUM_TICKS;
+    c->need_resched = 0;
+    TRACE_POINT(SCHED_SWITCH, prev->id, next->id);
+    return next->frame;
+}
+
+interrupt_frame_t* sched_preempt(interrupt_frame_t* frame)
+{
+    uint32_t cpu = smp_cpu_id();
+    sched_cpu_t* c = &sched_cpus[cpu];
+    if (!c->current) {
+        return frame;
+    }
+    if (frame->vector == VECTOR_YIELD || frame->vector == VECTOR_RESCHED) {
+        c->need_resched = 1;
+    }
+    if (!c->need_resched) {
+        return frame;
+    }
+
+    /* A blocking yield arrives with the lock already held. */
+    if (sched_lock_owner != cpu + 1) {
+        spin_lock(&sched_lock);
+        sched_lock_owner = cpu + 1;
+    }
+    return sched_switch(cpu, frame);
+}
+
+void sched_switch_finish(void)
+{
+    uint32_t owner = sched_lock_owner;
+    if (owner != 0 && owner == smp_cpu_id() + 1) {
+        sched_lock_owner = 0;
+        spin_unlock(&sched_lock);
+    }
+}
+
+void sched_tick(void)
+{
+    uint32_t cpu = smp_cpu_id();
+    sched_cpu_t* c = &sched_cpus[cpu];
+    if (!c->current) {
+        return;
+    }
+
+    spin_lock(&sched_lock);     /* IRQ context: interrupts are off */
+    ++c->current->ticks;
+
+    uint64_t now = timer_ticks();
+    thread_t** link = &sched_sleepers;
+    while (*link) {
+        thread_t* t = *link;
+        if (t->wake_tick <= now) {
+            *link = t->next;
+            sched_make_ready(t);
+        } else {
+            link = &t->next;
+        }
+    }
+
+    if (c->slice > 0) {
+        --c->slice;
+    }
+    if (c->slice == 0 && c->nr_ready) {
+        c->need_resched = 1;
+    }
+    if (c->current == c->idle && sched_busiest(cpu) >= 0) {
+        c->need_resched = 1;    /* steal on the way out */
+    }
+    spin_unlock(&sched_lock);
+}
+
+void thread_yield(void)
+{
+    __asm__ __volatile__("int %0" : : "i"(VECTOR_YIELD) : "memory");
+}
+
+/* Yield with sched_lock held; the switch releases it. */
+static void sched_yield_locked(void)
+{
+    sched_lock_owner = smp_cpu_id() + 1;
+    thread_yield();
+}
+
+/* ---------- Threads ---------- */
+
+static void thread_start(void)
+{
+    uint32_t flags = irq_save();
+    thread_t* self = sched_this_cpu()->current;
+    irq_restore(flags);
+    self->fn(self->arg);
+    thread_exit();
+}
+
+static void sched_reap(void)
+{
+    uint32_t flags = sched_lock_irqsave();
+    thread_t* list = sched_zombies;
+    sched_zombies = 0;
+    sched_unlock_irqrestore(flags);
+
+    while (list) {
+        thread_t* t = list;
+        list = t->next;
+        pmm_free_pages(t->stack, THREAD_STACK_ORDER);
+        kmem_cache_free(thread_cache, t);
+    }
+}
+
+int sched_init(void)
+{
+    thread_cache = kmem_cache_create("thread", sizeof(thread_t));
+    if (!thread_cache) {
+        return -1;
+    }
+    return sched_init_cpu();
+}
+
+int sched_init_cpu(void)
+{
+    thread_t* idle = (thread_t*)kmem_cache_alloc(thread_cache);
+    if (!idle) {
+        return -1;
+    }
+
+    uint32_t cpu = smp_cpu_id();
+    memset(idle, 0, sizeof(*idle));
+    idle->state = THREAD_RUNNING;
+    idle->cpu = cpu;
+    idle->name = "idle";
+
+    uint32_t flags = sched_lock_irqsave();
+    idle->id = sched_next_id++;
+    idle->all_next = sched_all;
+    sched_all = idle;
+
+    sched_cpu_t* c = &sched_cpus[cpu];
+    c->idle = idle;
+    c->slice = SCHED_QUANTUM_TICKS;
+    c->current = idle;
+    sched_unlock_irqrestore(flags);
+    return 0;
+}
+
+int sched_running(void)
+{
+    return sched_cpus[0].current != 0;
+}
+
+void sched_idle(void)
+{
+    for (;;) {
+        interrupts_disable();
+        if (sched_this_cpu()->nr_ready) {
+            interrupts_enable();
+            thread_yield();
+        } else {
+            interrupts_enable_and_halt();
+        }
+    }
+}
+
+thread_t* thread_create(const char* name, thread_fn fn, void* arg)
+{
+    sched_reap();
+
+    thread_t* t = (thread_t*)kmem_cache_alloc(thread_cache);
+    uint8_t* stack = (uint8_t*)pmm_alloc_pages(THREAD_STACK_ORDER);
+    if (!t || !stack) {
+        kmem_cache_free(thread_cache, t);
+        pmm_free_pages(stack, THREAD_STACK_ORDER);
+        return 0;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->name = name;
+    t->stack = stack;
+    t->fn = fn;
+    t->arg = arg;
+
+    /* A fake return address on top leaves the 16-byte alignment the ABI
+     * expects at function entry; thread_start() never returns to it.
+     */
+    uint32_t* sp = (uint32_t*)(stack + ((size_t)PAGE_SIZE << THREAD_STACK_ORDER));
+    *--sp = 0;
+    interrupt_frame_t* f = (interrupt_frame_t*)sp - 1;
+    memset(f, 0, sizeof(*f));
+    f->gs = f->fs = f->es = f->ds = GDT_KERNEL_DATA;
+    f->cs = GDT_KERNEL_CODE;
+    f->eip = (uint32_t)thread_start;
+    f->eflags = 0x202;          /* IF, plus the always-set bit 1 */
+    t->frame = f;
+
+    uint32_t flags = sched_lock_irqsave();
+    t->id = sched_next_id++;
+    t->all_next = sched_all;
+    sched_all = t;
+
+    /* Start on the least loaded CPU; stealing evens things out later. */
+    uint32_t best = smp_cpu_id();
+    for (uint32_t i = 0; i < smp_cpu_count(); ++i) {
+        sched_cpu_t* c = &sched_cpus[i];
+        if (c->current && c->nr_ready + (c->current != c->idle) <
+                          sched_cpus[best].nr_ready + (sched_cpus[best].current != sched_cpus[best].idle)) {
+            best = i;
+        }
+    }
+    t->cpu = best;
+    sched_make_ready(t);
+    sched_unlock_irqrestore(flags);
+    return t;
+}
+
+void thread_exit(void)
+{
+    sched_lock_irqsave();
+    thread_t* self = sched_this_cpu()->current;
+
+    thread_t** link = &sched_all;
+    while (*link != self) {
+        link = &(*link)->all_next;
+    }
+    *link = self->all_next;
+
+    self->state = THREAD_DEAD;
+    self->next = sched_zombies;
+    sched_zombies = self;
+    sched_yield_locked();
+    for (;;) {
+        /* never scheduled again */
+    }
+}
+
+void thread_sleep_ms(uint32_t ms)
+{
+    uint32_t ticks = (ms * TIMER_HZ + 999) / 1000;
+
+    uint32_t flags = sched_lock_irqsave();
+    sched_cpu_t* c = sched_this_cpu();
+    if (!c->current || c->current == c->idle) {
+        sched_unlock_irqrestore(flags);
+        return;
+    }
+
+    thread_t* self = c->current;
+    self->wake_tick = timer_ticks() + (ticks ? ticks : 1);
+    self->state = THREAD_SLEEPING;
+    self->next = sched_sleepers;
+    sched_sleepers = self;
+    sched_yield_locked();
+    irq_restore(flags);
+}
+
+/* ---------- Wait queues and mutexes ---------- */
+
+void wait_queue_sleep_locked(wait_queue_t* q, uint32_t flags)
+{
+    sched_cpu_t* c = sched_this_cpu();
+    if (!c->current || c->current == c->idle) {
+        /* No thread to block (early boot): wait for any interrupt. */
+        spin_unlock(&sched_lock);
+        interrupts_enable_and_halt();
+        interrupts_disable();
+        irq_restore(flags);
+        return;
+    }
+
+    c->current->state = THREAD_BLOCKED;
+    queue_push(q, c->current);
+    sched_yield_locked();
+    irq_restore(flags);
+}
+
+void wait_queue_wake_all(wait_queue_t* q)
+{
+    uint32_t flags = sched_lock_irqsave();
+    thread_t* t;
+    while ((t = queue_pop(q)) != 0) {
+        sched_make_ready(t);
+    }
+    sched_unlock_irqrestore(flags);
+}
+
+/* Called with sched_lock held, from wait_event(). */
+static int mutex_try_take(mutex_t* m)
+{
+    if (m->locked) {
+        return 0;
+    }
+    m->locked = 1;
+    return 1;
+}
+
+void mutex_lock(mutex_t* m)
+{
+    wait_event(&m->wait, mutex_try_take(m));
+}
+
+void mutex_unlock(mutex_t* m)
+{
+    uint32_t flags = sched_lock_irqsave();
+    m->locked = 0;
+    sched_unlock_irqrestore(flags);
+    wait_queue_wake_all(&m->wait);
+}
+
+/* ---------- Report ---------- */
+
+#define SCHED_PRINT_MAX 32
+
+typedef struct thread_snapshot {
+    uint32_t    id;
+    uint32_t    cpu;
+    uint32_t    ticks;
+    const char* state;
+    const char* name;
+} thread_snapshot_t;
+
+static void sched_write_padded(uint32_t v, int width)
+{
+    uint32_t n = v;
+    int digits = 1;
+    while (n >= 10) {
+        n /= 10;
+        ++digits;
+    }
+    for (; digits < width; ++digits) {
+        console_putc(' ');
+    }
+    console_write_dec(v);
+}
+
+void sched_print(void)
+{
+    /* Copy under the lock, print without it: the console may block. */
+    thread_snapshot_t snap[SCHED_PRINT_MAX];
+    int n = 0;
+
+    uint32_t flags = sched_lock_irqsave();
+    for (thread_t* t = sched_all; t && n < SCHED_PRINT_MAX; t = t->all_next, ++n) {
+        snap[n].id = t->id;
+        snap[n].cpu = t->cpu;
+        snap[n].ticks = t->ticks;
+        snap[n].state = thread_state_names[t->state];
+        snap[n].name = t->name;
+    }
+    sched_unlock_irqrestore(flags);
+
+    console_write_dec(smp_cpu_count());
+    console_write_line(" CPU(s)");
+    console_write_line("    id  cpu  state      ticks  name");
+    for (int i = 0; i < n; ++i) {
+        sched_write_padded(snap[i].id, 6);
+        sched_write_padded(snap[i].cpu, 5);
+        console_write("  ");
+        console_write(snap[i].state);
+        for (size_t pad = strlen(snap[i].state); pad < 8; ++pad) {
+            console_putc(' ');
+        }
+        sched_write_padded(snap[i].ticks, 7);
+        console_write("  ");
+        console_write_line(snap[i].name);
+    }
+}
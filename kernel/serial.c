@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "serial.h"
+#include "console.h"
+#include "idt.h"
+#include "io.h"
+#include "spinlock.h"
+
+/*
+ * Interrupt-driven 16550 driver for COM1.
+ *
+ * Transmit: serial_putc() appends to ser_tx[] and, if the transmitter is
+ * idle, enables the THRE interrupt. Each THRE interrupt means the FIFO is
+ * empty, so the handler refills it with up to SER_FIFO_SIZE bytes at once
+ * and turns THRE off again when the ring runs dry. When the ring is full,
+ * or interrupts are off, the writer drains it by polling instead.
+ *
+ * Receive: the handler moves bytes from the FIFO into ser_rx[], a
+ * single-producer/single-consumer ring like the keyboard's.
+ *
+ * The TX indices, the busy flag and IER belong to ser_tx_lock: writers
+ * may run on any CPU while the IRQ arrives on the BSP, so disabling
+ * interrupts alone would not keep them out of each other's way. Writers
+ * take it with interrupts off, as the handler does too. RX follows the
+ * SPSC rule (head by the IRQ, tail by the reader).
+ */
+
+#define COM1            0x3F8
+#define UART_DATA       (COM1 + 0)
+#define UART_IER        (COM1 + 1)
+#define UART_DLL        (COM1 + 0)      /* with DLAB set */
+#define UART_DLM        (COM1 + 1)
+#define UART_IIR        (COM1 + 2)
+#define UART_FCR        (COM1 + 2)
+#define UART_LCR        (COM1 + 3)
+#define UART_MCR        (COM1 + 4)
+#define UART_LSR        (COM1 + 5)
+#define UART_MSR        (COM1 + 6)
+
+#define IER_RX          0x01
+#define IER_THRE        0x02
+#define IIR_NONE        0x01
+#define IIR_ID_MASK     0x0E
+#define IIR_MSR         0x00
+#define IIR_THRE        0x02
+#define IIR_RX          0x04
+#define IIR_LSR         0x06
+#define IIR_RX_TIMEOUT  0x0C
+#define LCR_8N1         0x03
+#define LCR_DLAB        0x80
+#define FCR_ENABLE_14   0xC7            /* enable, clear both, RX trigger 14 */
+#define MCR_DTR_RTS_OUT2 0x0B           /* OUT2 gates the IRQ line */
+#define MCR_LOOPBACK    0x1E
+#define LSR_DR          0x01
+#define LSR_THRE        0x20
+
+#define SER_FIFO_SIZE   16
+#define SER_TX_SIZE     4096            /* powers of two */
+#define SER_RX_SIZE     256
+
+static int ser_ok = 0;
+
+static volatile uint8_t  ser_tx[SER_TX_SIZE];
+static volatile uint32_t ser_tx_head = 0;   /* next byte written */
+static volatile uint32_t ser_tx_tail = 0;   /* next byte sent */
+static volatile int      ser_tx_busy = 0;   /* THRE interrupt enabled */
+static spinlock_t        ser_tx_lock = SPINLOCK_INIT;
+
+static volatile uint8_t  ser_rx[SER_RX_SIZE];
+static volatile uint32_t ser_rx_head = 0;
+static volatile uint32_t ser_rx_tail = 0;
+static int               ser_rx_cr = 0;     /* last byte read was '\r' */
+static int               ser_rx_esc = 0;    /* 1 after ESC, 2 inside "ESC [" */
+
+/* Refill the (empty) FIFO from the ring. Holds ser_tx_lock. */
+static void serial_tx_burst(void)
+{
+    for (int n = 0; n < SER_FIFO_SIZE && ser_tx_tail != ser_tx_head; ++n) {
+        outb(UART_DATA, ser_tx[ser_tx_tail & (SER_TX_SIZE - 1)]);
+        ++ser_tx_tail;
+    }
+}
+
+static void serial_set_thre(int on)
+{
+    ser_tx_busy = on;
+    outb(UART_IER, (uint8_t)(IER_RX | (on ? IER_THRE : 0)));
+}
+
+static void serial_rx_drain(void)
+{
+    while (inb(UART_LSR) & LSR_DR) {
+        uint8_t b = inb(UART_DATA);
+        uint32_t head = ser_rx_head;
+        if (head - ser_rx_tail < SER_RX_SIZE) {
+            ser_rx[head & (SER_RX_SIZE - 1)] = b;
+            __asm__ __volatile__("" ::: "memory");
+            ser_rx_head = head + 1;
+        }
+    }
+}
+
+static void serial_irq(interrupt_frame_t* frame)
+{
+    (void)frame;
+
+    uint8_t iir;
+    while (!((iir = inb(UART_IIR)) & IIR_NONE)) {
+        switch (iir & IIR_ID_MASK) {
+        case IIR_RX:
+        case IIR_RX_TIMEOUT:
+            serial_rx_drain();
+            console_input_ready();
+            break;
+        case IIR_THRE:
+            spin_lock(&ser_tx_lock);
+            if (ser_tx_tail == ser_tx_head) {
+                serial_set_thre(0);
+            } else {
+                serial_tx_burst();
+            }
+            spin_unlock(&ser_tx_lock);
+            break;
+        case IIR_LSR:
+            (void)inb(UART_LSR);
+            break;
+        case IIR_MSR:
+            (void)inb(UART_MSR);
+            break;
+        }
+    }
+}
+
+int serial_init(void)
+{
+    outb(UART_IER, 0);
+    outb(UART_LCR, LCR_DLAB);
+    outb(UART_DLL, 1);                  /* 115200 baud */
+    outb(UART_DLM, 0);
+    outb(UART_LCR, LCR_8N1);
+    outb(UART_FCR, FCR_ENABLE_14);
+
+    /* Loopback self-test: no UART (or a broken one) reads back garbage. */
+    outb(UART_MCR, MCR_LOOPBACK);
+    outb(UART_DATA, 0xAE);
+    if (inb(UART_DATA) != 0xAE) {
+        return -1;
+    }
+
+    outb(UART_MCR, MCR_DTR_RTS_OUT2);
+    ser_ok = 1;
+    irq_install_handler(IRQ_COM1, serial_irq);
+    serial_set_thre(0);
+    return 0;
+}
+
+int serial_present(void)
+{
+    return ser_ok;
+}
+
+/* Wait for the FIFO to empty and refill it: the polled THRE path. */
+static void serial_poll_burst(void)
+{
+    while (!(inb(UART_LSR) & LSR_THRE)) {
+    }
+    serial_tx_burst();
+}
+
+/* Append one byte; holds ser_tx_lock. */
+static void serial_queue_locked(uint8_t b)
+{
+    while (ser_tx_head - ser_tx_tail >= SER_TX_SIZE) {
+        serial_poll_burst();
+    }
+    ser_tx[ser_tx_head & (SER_TX_SIZE - 1)] = b;
+    ++ser_tx_head;
+}
+
+static void serial_kick_locked(void)
+{
+    if (!ser_tx_busy) {
+        serial_set_thre(1);     /* fires at once if the FIFO is empty */
+    }
+}
+
+static void serial_queue(uint8_t b)
+{
+    uint32_t flags = spin_lock_irqsave(&ser_tx_lock);
+    serial_queue_locked(b);
+    serial_kick_locked();
+    spin_unlock_irqrestore(&ser_tx_lock, flags);
+}
+
+void serial_putc(char c)
+{
+    if (!ser_ok) {
+        return;
+    }
+    if (c == '\n') {
+        serial_queue('\r');
+    }
+    serial_queue((uint8_t)c);
+}
+
+/* A FIFO's worth at a time, so the lock is never held for long. */
+static void serial_queue_n(const uint8_t* s, size_t len, int crlf)
+{
+    for (size_t done = 0; done < len;) {
+        size_t end = len - done > SER_FIFO_SIZE ? done + SER_FIFO_SIZE : len;
+        uint32_t flags = spin_lock_irqsave(&ser_tx_lock);
+        for (; done < end; ++done) {
+            if (crlf && s[done] == '\n') {
+                serial_queue_locked('\r');
+            }
+            serial_queue_locked(s[done]);
+        }
+        serial_kick_locked();
+        spin_unlock_irqrestore(&ser_tx_lock, flags);
+    }
+}
+
+void serial_write(const char* s, size_t len)
+{
+    if (ser_ok) {
+        serial_queue_n((const uint8_t*)s, len, 1);
+    }
+}
+
+void serial_write_raw(const void* data, size_t len)
+{
+    if (ser_ok) {
+        serial_queue_n((const uint8_t*)data, len, 0);
+    }
+}
+
+void serial_flush_sync(void)
+{
+    if (!ser_ok) {
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&ser_tx_lock);
+    while (ser_tx_tail != ser_tx_head) {
+        serial_poll_burst();
+    }
+    spin_unlock_irqrestore(&ser_tx_lock, flags);
+}
+
+int serial_input_pending(void)
+{
+    return ser_rx_tail != ser_rx_head;
+}
+
+int serial_poll_char(void)
+{
+    while (serial_input_pending()) {
+        uint32_t tail = ser_rx_tail;
+        uint8_t b = ser_rx[tail & (SER_RX_SIZE - 1)];
+        __asm__ __volatile__("" ::: "memory");
+        ser_rx_tail = tail + 1;
+
+        int after_cr = ser_rx_cr;
+        ser_rx_cr = (b == '\r');
+
+        /* Escape sequences: the cursor keys become history keys, the
+         * rest are dropped whole. */
+        if (ser_rx_esc == 1) {
+            ser_rx_esc = (b == '[' || b == 'O') ? 2 : 0;
+            continue;
+        }
+        if (ser_rx_esc == 2) {
+            if (b >= 0x40 && b <= 0x7E) {
+                ser_rx_esc = 0;
+                if (b == 'A') {
+                    return CONSOLE_KEY_UP;
+                }
+                if (b == 'B') {
+                    return CONSOLE_KEY_DOWN;
+                }
+            }
+            continue;
+        }
+        if (b == 0x1B) {
+            ser_rx_esc = 1;
+            continue;
+        }
+
+        if (b == '\r') {
+            return '\n';
+        }
+        if (b == '\n' && after_cr) {
+            continue;   /* "\r\n" from the terminal is one newline */
+        }
+        if (b == 0x7F || b == '\b') {
+            return '\b';
+        }
+        if (b == '\n' || b == '\t' || b == CONSOLE_KEY_UP || b == CONSOLE_KEY_DOWN ||
+            (b >= 32 && b < 127)) {
+            return b;
+        }
+        /* Other control bytes are dropped. */
+    }
+    return -1;
+}
@@ -0,0 +1,233 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "string.h"
+
+/*
+ * Memory and string routines for Enixnel.
+ *
+ * Copies and fills use the x86 string instructions a dword at a time, with
+ * a byte tail. Above STRING_SSE2_MIN bytes, and when SSE2 is enabled,
+ * memcpy/memset move 64-byte chunks through xmm0-xmm3 into a 16-byte
+ * aligned destination. Interrupt entry (isr.S) saves those four registers,
+ * so an IRQ that itself copies memory cannot corrupt an interrupted copy.
+ *
+ * strlen/strcmp/memcmp compare four bytes per step. An aligned dword load
+ * never crosses a page boundary, so reading a little past the terminator
+ * is safe.
+ *
+ * This file is compiled with -fno-tree-loop-distribute-patterns (see the
+ * Makefile), so GCC cannot turn the loops here back into calls to
+ * themselves.
+ */
+
+#define STRING_SSE2_MIN  256
+
+#define ONES   0x01010101u
+#define HIGHS  0x80808080u
+
+/* Nonzero if any byte of w is zero. */
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+/* Word loads of char data; may_alias keeps them legal under strict aliasing. */
+typedef uint32_t __attribute__((may_alias)) word_alias_t;
+
+uint32_t cpu_has_sse2 = 0;   /* set by boot.S */
+
+static inline void copy_dwords_bytes(uint8_t* d, const uint8_t* s, size_t n)
+{
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+    __asm__ __volatile__("rep movsl" : "+D"(d), "+S"(s), "+c"(dwords) : : "memory");
+    __asm__ __volatile__("rep movsb" : "+D"(d), "+S"(s), "+c"(bytes) : : "memory");
+}
+
+static inline void fill_dwords_bytes(uint8_t* d, uint32_t pattern, size_t n)
+{
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+    __asm__ __volatile__("rep stosl" : "+D"(d), "+c"(dwords) : "a"(pattern) : "memory");
+    __asm__ __volatile__("rep stosb" : "+D"(d), "+c"(bytes) : "a"(pattern) : "memory");
+}
+
+/*
+ * Copy n (a nonzero multiple of 64) bytes to a 16-byte aligned d. The
+ * kernel is built without -msse, so GCC never keeps values in xmm
+ * registers and the asm needs no clobbers for them (nor may it name any).
+ */
+static void copy_sse2(uint8_t* d, const uint8_t* s, size_t n)
+{
+    __asm__ __volatile__(
+        "1:\n\t"
+        "movdqu   (%1), %%xmm0\n\t"
+        "movdqu 16(%1), %%xmm1\n\t"
+        "movdqu 32(%1), %%xmm2\n\t"
+        "movdqu 48(%1), %%xmm3\n\t"
+        "movdqa %%xmm0,   (%0)\n\t"
+        "movdqa %%xmm1, 16(%0)\n\t"
+        "movdqa %%xmm2, 32(%0)\n\t"
+        "movdqa %%xmm3, 48(%0)\n\t"
+        "add $64, %1\n\t"
+        "add $64, %0\n\t"
+        "sub $64, %2\n\t"
+        "jnz 1b"
+        : "+r"(d), "+r"(s), "+r"(n)
+        :
+        : "memory");
+}
+
+/* Fill n (a nonzero multiple of 64) bytes at a 16-byte aligned d. */
+static void fill_sse2(uint8_t* d, uint32_t pattern, size_t n)
+{
+    __asm__ __volatile__(
+        "movd %2, %%xmm0\n\t"
+        "pshufd $0, %%xmm0, %%xmm0\n"
+        "1:\n\t"
+        "movdqa %%xmm0,   (%0)\n\t"
+        "movdqa %%xmm0, 16(%0)\n\t"
+        "movdqa %%xmm0, 32(%0)\n\t"
+        "movdqa %%xmm0, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "sub $64, %1\n\t"
+        "jnz 1b"
+        : "+r"(d), "+r"(n)
+        : "r"(pattern)
+        : "memory");
+}
+
+void* memcpy(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    if (cpu_has_sse2 && n >= STRING_SSE2_MIN) {
+        size_t head = (size_t)(-(uintptr_t)d & 15);
+        copy_dwords_bytes(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+
+        size_t bulk = n & ~(size_t)63;
+        copy_sse2(d, s, bulk);
+        d += bulk;
+        s += bulk;
+        n -= bulk;
+    }
+
+    copy_dwords_bytes(d, s, n);
+    return dst;
+}
+
+void* memmove(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    /* Forward copies read each chunk before writing it, so they are fine
+     * whenever the destination does not start inside the source. */
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+
+    /* Overlap with dst above src: copy backwards. */
+    d += n - 1;
+    s += n - 1;
+    __asm__ __volatile__("std\n\t"
+                         "rep movsb\n\t"
+                         "cld"
+                         : "+D"(d), "+S"(s), "+c"(n)
+                         :
+                         : "memory");
+    return dst;
+}
+
+void* memset(void* dst, int c, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    uint32_t pattern = (uint8_t)c * ONES;
+
+    if (cpu_has_sse2 && n >= STRING_SSE2_MIN) {
+        size_t head = (size_t)(-(uintptr_t)d & 15);
+        fill_dwords_bytes(d, pattern, head);
+        d += head;
+        n -= head;
+
+        size_t bulk = n & ~(size_t)63;
+        fill_sse2(d, pattern, bulk);
+        d += bulk;
+        n -= bulk;
+    }
+
+    fill_dwords_bytes(d, pattern, n);
+    return dst;
+}
+
+int memcmp(const void* a, const void* b, size_t n)
+{
+    const uint8_t* p = (const uint8_t*)a;
+    const uint8_t* q = (const uint8_t*)b;
+
+    /* Skip equal dwords; the byte loop then finds the differing byte. */
+    while (n >= 4 && *(const word_alias_t*)p == *(const word_alias_t*)q) {
+        p += 4;
+        q += 4;
+        n -= 4;
+    }
+    for (; n; --n, ++p, ++q) {
+        if (*p != *q) {
+            return (int)*p - (int)*q;
+        }
+    }
+    return 0;
+}
+
+size_t strlen(const char* s)
+{
+    const char* p = s;
+
+    while ((uintptr_t)p & 3) {
+        if (*p == '\0') {
+            return (size_t)(p - s);
+        }
+        ++p;
+    }
+
+    const word_alias_t* w = (const word_alias_t*)p;
+    while (!HAS_ZERO(*w)) {
+        ++w;
+    }
+
+    p = (const char*)w;
+    while (*p) {
+        ++p;
+    }
+    return (size_t)(p - s);
+}
+
+int strcmp(const char* a, const char* b)
+{
+    /* Word steps only work when both strings reach alignment together. */
+    if ((((uintptr_t)a ^ (uintptr_t)b) & 3) == 0) {
+        while ((uintptr_t)a & 3) {
+            if (*a != *b || *a == '\0') {
+                return (int)(uint8_t)*a - (int)(uint8_t)*b;
+            }
+            ++a;
+            ++b;
+        }
+
+        const word_alias_t* wa = (const word_alias_t*)a;
+        const word_alias_t* wb = (const word_alias_t*)b;
+        while (*wa == *wb && !HAS_ZERO(*wa)) {
+            ++wa;
+            ++wb;
+        }
+        a = (const char*)wa;
+        b = (const char*)wb;
+    }
+
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return (int)(uint8_t)*a - (int)(uint8_t)*b;
+}
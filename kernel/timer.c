@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "timer.h"
+#include "sched.h"
+#include "idt.h"
+#include "io.h"
+#include "math64.h"
+
+/*
+ * TSC calibration and the PIT tick for Enixnel.
+ *
+ * Calibration runs PIT channel 2 as a one-shot of PIT_CAL_COUNT input
+ * clocks (10 ms), polling its OUT pin through port 0x61, and counts TSC
+ * cycles over the same window. Channel 2 is used because its output can
+ * be read back without taking an interrupt.
+ *
+ * Channel 0 then runs in rate-generator mode at TIMER_HZ.
+ */
+
+#define PIT_INPUT_HZ   1193182u
+#define PIT_CH0        0x40
+#define PIT_CH2        0x42
+#define PIT_CMD        0x43
+#define PIT_GATE_PORT  0x61            /* bit 0 gate, bit 1 speaker, bit 5 OUT2 */
+
+#define PIT_CMD_CH0_RATE    0x34       /* ch 0, lo/hi byte, mode 2 */
+#define PIT_CMD_CH2_ONESHOT 0xB0       /* ch 2, lo/hi byte, mode 0 */
+
+#define PIT_CAL_MS     10
+#define PIT_CAL_COUNT  (PIT_INPUT_HZ * PIT_CAL_MS / 1000)
+
+static uint32_t tsc_khz = 0;
+static volatile uint64_t ticks = 0;
+
+static uint32_t timer_calibrate_tsc_khz(void)
+{
+    /* Gate on, speaker off. */
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (uint8_t)((gate & ~0x02) | 0x01));
+
+    outb(PIT_CMD, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CH2, (uint8_t)(PIT_CAL_COUNT & 0xFF));
+    outb(PIT_CH2, (uint8_t)(PIT_CAL_COUNT >> 8));   /* count starts here */
+
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+    }
+    uint64_t end = rdtsc();
+
+    outb(PIT_GATE_PORT, gate);
+    return (uint32_t)div64_u32(end - start, PIT_CAL_MS);
+}
+
+static void timer_irq(interrupt_frame_t* frame)
+{
+    (void)frame;
+    ++ticks;
+    sched_tick();
+}
+
+void timer_init(void)
+{
+    tsc_khz = timer_calibrate_tsc_khz();
+
+    uint32_t divisor = PIT_INPUT_HZ / TIMER_HZ;
+    outb(PIT_CMD, PIT_CMD_CH0_RATE);
+    outb(PIT_CH0, (uint8_t)(divisor & 0xFF));
+    outb(PIT_CH0, (uint8_t)(divisor >> 8));
+    irq_install_handler(IRQ_TIMER, timer_irq);
+}
+
+uint32_t timer_tsc_khz(void)
+{
+    return tsc_khz;
+}
+
+uint64_t timer_ticks(void)
+{
+    /* A 64-bit read is two loads; retry if the tick moved in between. */
+    uint64_t t;
+    do {
+        t = ticks;
+    } while (t != ticks);
+    return t;
+}
+
+uint64_t timer_cycles_to_ns(uint64_t cycles)
+{
+    if (tsc_khz == 0) {
+        return 0;
+    }
+    /* Split so cycles * 1e6 cannot overflow: whole milliseconds first. */
+    uint32_t rem;
+    uint64_t ms = div64_u32_rem(cycles, tsc_khz, &rem);
+    return ms * 1000000u + div64_u32((uint64_t)rem * 1000000u, tsc_khz);
+}
+
+void timer_udelay(uint32_t us)
+{
+    /* kHz is cycles per millisecond; round up so the wait is never short. */
+    uint64_t cycles = div64_u32((uint64_t)us * tsc_khz + 999, 1000);
+    uint64_t start = rdtsc();
+    while (rdtsc() - start < cycles) {
+        __asm__ __volatile__("pause");
+    }
+}
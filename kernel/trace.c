@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "trace.h"
+#include "pmm.h"
+#include "serial.h"
+#include "smp.h"
+#include "string.h"
+#include "timer.h"
+
+/*
+ * Trace rings for the static tracepoints in trace.h.
+ *
+ * Each CPU has a ring of TRACE_RING_EVENTS slots, allocated by the first
+ * trace_start(), and a free-running head counter. A writer claims slot
+ * head++ with lock xadd and fills it in; the counter is never reset while
+ * tracing runs, so the newest TRACE_RING_EVENTS events are the ones kept
+ * and anything older is lost. An interrupt on the same CPU, or a thread
+ * that migrated between reading its CPU number and claiming, takes the
+ * next slot rather than the same one.
+ *
+ * trace_dump() only reads the rings after stopping, so the one race left
+ * is an event claimed just before the stop and still being written.
+ */
+
+#ifdef ENIXNEL_TRACE
+
+#define TRACE_RING_EVENTS ((PAGE_SIZE << TRACE_RING_ORDER) / sizeof(trace_event_t))
+
+_Static_assert(sizeof(trace_event_t) == 16, "trace_event_t is the wire format");
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "ring size is a power of two");
+
+/* Counters on their own cache lines: each is hammered by its own CPU. */
+typedef struct trace_head {
+    volatile uint32_t next;
+} __attribute__((aligned(64))) trace_head_t;
+
+volatile uint32_t trace_on = 0;
+
+static trace_event_t* trace_rings[SMP_MAX_CPUS];
+static trace_head_t   trace_heads[SMP_MAX_CPUS];
+
+static const char* const trace_names[TRACE_COUNT] = {
+#define TRACE_NAME(id, name) name,
+    TRACE_LIST(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+typedef struct trace_header {
+    char     magic[8];
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t tsc_khz;
+    uint32_t cpus;
+    uint32_t names;
+} __attribute__((packed)) trace_header_t;
+
+typedef struct trace_cpu_header {
+    uint32_t cpu;
+    uint32_t events;
+    uint32_t lost;
+} __attribute__((packed)) trace_cpu_header_t;
+
+void trace_record(uint32_t id, uint32_t phase, uint32_t a0, uint32_t a1)
+{
+    uint32_t cpu = smp_cpu_id();
+    trace_event_t* ring = trace_rings[cpu];
+    if (!ring) {
+        return;
+    }
+
+    uint32_t slot = 1;
+    __asm__ __volatile__("lock xadd %0, %1" : "+r"(slot), "+m"(trace_heads[cpu].next) : : "memory");
+
+    trace_event_t* e = &ring[slot & (TRACE_RING_EVENTS - 1)];
+    e->tsc = rdtsc();
+    e->id = (uint8_t)id;
+    e->phase = (uint8_t)phase;
+    e->a0 = (uint16_t)a0;
+    e->a1 = a1;
+}
+
+int trace_start(void)
+{
+    trace_on = 0;
+
+    uint32_t cpus = smp_cpu_count();
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        if (!trace_rings[cpu]) {
+            trace_rings[cpu] = (trace_event_t*)pmm_alloc_pages(TRACE_RING_ORDER);
+            if (!trace_rings[cpu]) {
+                return -1;
+            }
+        }
+        trace_heads[cpu].next = 0;
+    }
+
+    __asm__ __volatile__("" ::: "memory");  /* rings empty before the flag */
+    trace_on = 1;
+    return 0;
+}
+
+void trace_stop(void)
+{
+    trace_on = 0;
+}
+
+int trace_dump(void)
+{
+    trace_stop();
+    if (!serial_present()) {
+        return -1;
+    }
+
+    uint32_t cpus = 0;
+    while (cpus < SMP_MAX_CPUS && trace_rings[cpus]) {
+        ++cpus;
+    }
+
+    trace_header_t h;
+    memcpy(h.magic, "ENXTRACE", sizeof(h.magic));
+    h.version = TRACE_VERSION;
+    h.event_size = sizeof(trace_event_t);
+    h.tsc_khz = timer_tsc_khz();
+    h.cpus = cpus;
+    h.names = TRACE_COUNT;
+    serial_write_raw(&h, sizeof(h));
+
+    for (int i = 0; i < TRACE_COUNT; ++i) {
+        uint8_t len = (uint8_t)strlen(trace_names[i]);
+        serial_write_raw(&len, 1);
+        serial_write_raw(trace_names[i], len);
+    }
+
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        uint32_t head = trace_heads[cpu].next;
+        uint32_t count = head < TRACE_RING_EVENTS ? head : (uint32_t)TRACE_RING_EVENTS;
+
+        trace_cpu_header_t ch = { cpu, count, head - count };
+        serial_write_raw(&ch, sizeof(ch));
+
+        /* Oldest first: the run from the first kept slot to the end of the
+         * ring, then the part that wrapped around to its start. */
+        uint32_t first = (head - count) & (TRACE_RING_EVENTS - 1);
+        uint32_t tail = TRACE_RING_EVENTS - first < count ? TRACE_RING_EVENTS - first : count;
+        serial_write_raw(&trace_rings[cpu][first], tail * sizeof(trace_event_t));
+        serial_write_raw(&trace_rings[cpu][0], (count - tail) * sizeof(trace_event_t));
+        total += count;
+    }
+    return (int)total;
+}
+
+#endif /* ENIXNEL_TRACE */
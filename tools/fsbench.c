@@ -0,0 +1,502 @@
+/*
+ * Host benchmark and self-check for the Enixnel fs core (make bench-host).
+ *
+ * Links the fs core (HOST_FS_SRCS in the Makefile) natively, with
+ * tools/host_kmalloc.c as the heap, so the fs can be profiled with perf or
+ * valgrind without booting the kernel.
+ *
+ *   fsbench [-n entries] [-d seq|random|prefix|deep] [-r rounds] [-s seed]
+ *           [-w write-bytes] [-c clone-ops]
+ *
+ * First, a model check runs clone-ops random operations on a handful of
+ * files: clones, positional writes through descriptors, overwrites,
+ * appends, resizes and deletes. After each one, the files are compared
+ * with copies kept in plain memory. Regularly and at the end, each
+ * block's reference count is compared with the references the files
+ * actually hold.
+ *
+ * Each round builds a tree of n files under "b", named by the chosen
+ * distribution, then times create, lookup (hits and misses), append
+ * writes, overwrites of write-bytes, reads and delete. Every result is checked as well,
+ * so a data-structure change that breaks the fs fails here (exit 1)
+ * rather than on the next boot.
+ *
+ * Output: one line per phase, "name ns/op Mops/s", median over rounds.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fs.h"
+
+#define PATH_MAX_LEN  256
+#define MAX_ROUNDS    32
+
+typedef enum { DIST_SEQ, DIST_RANDOM, DIST_PREFIX, DIST_DEEP } dist_t;
+
+static const char* const dist_names[] = { "seq", "random", "prefix", "deep" };
+
+enum { PH_CREATE, PH_LOOKUP_HIT, PH_LOOKUP_MISS, PH_APPEND, PH_OVERWRITE,
+       PH_READ, PH_DELETE, PH_COUNT };
+
+static const char* const phase_names[PH_COUNT] = {
+    "create", "lookup-hit", "lookup-miss", "write-append",
+    "write-overwrite", "read", "delete",
+};
+
+static int      n_entries = 10000;
+static dist_t   dist = DIST_SEQ;
+static int      rounds = 5;
+static uint64_t seed = 1;
+static size_t   write_bytes = 256;
+static int      clone_ops = 20000;
+
+static char**   paths;
+static char**   misses;     /* same shapes, never created */
+static int*     order;      /* shuffled lookup order */
+static double   results[PH_COUNT][MAX_ROUNDS];
+
+static uint64_t rng;
+
+static uint32_t rand32(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void fail(const char* what, const char* path)
+{
+    fprintf(stderr, "fsbench: %s failed for \"%s\"\n", what, path);
+    exit(1);
+}
+
+/* Names per distribution. Directories for "deep" are made separately. */
+static void make_paths(void)
+{
+    paths = malloc((size_t)n_entries * sizeof(*paths));
+    misses = malloc((size_t)n_entries * sizeof(*misses));
+    order = malloc((size_t)n_entries * sizeof(*order));
+    if (!paths || !misses || !order) {
+        fail("malloc", "");
+    }
+
+    for (int i = 0; i < n_entries; ++i) {
+        char buf[PATH_MAX_LEN];
+        switch (dist) {
+        case DIST_SEQ:
+            snprintf(buf, sizeof(buf), "b/f%d", i);
+            break;
+        case DIST_RANDOM: {
+            int len = 1 + (int)(rand32() % ENIXNEL_MAX_NAME_LEN);
+            int pos = snprintf(buf, sizeof(buf), "b/");
+            for (int k = 0; k < len - 8; ++k) {
+                buf[pos++] = (char)('a' + rand32() % 26);
+            }
+            /* Unique suffix keeps names distinct. */
+            snprintf(buf + pos, sizeof(buf) - (size_t)pos, "%08x", (unsigned)i);
+            break;
+        }
+        case DIST_PREFIX:
+            /* Long shared prefix: collisions cost full compares. */
+            snprintf(buf, sizeof(buf), "b/common_prefix_name_%010d", i);
+            break;
+        case DIST_DEEP:
+            /* 16 x 16 directories, files spread across the leaves. */
+            snprintf(buf, sizeof(buf), "b/d%d/e%d/f%d", i % 16, (i / 16) % 16, i);
+            break;
+        }
+        paths[i] = strdup(buf);
+        /* Flip the last character: same directory, same length. */
+        buf[strlen(buf) - 1] ^= 0x40;
+        misses[i] = strdup(buf);
+        order[i] = i;
+    }
+
+    for (int i = n_entries - 1; i > 0; --i) {
+        int j = (int)(rand32() % (uint32_t)(i + 1));
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+static void setup_round(void)
+{
+    if (fs_create_dir("b") != 0) {
+        fail("fs_create_dir", "b");
+    }
+    if (dist == DIST_DEEP) {
+        char buf[PATH_MAX_LEN];
+        for (int a = 0; a < 16; ++a) {
+            snprintf(buf, sizeof(buf), "b/d%d", a);
+            fs_create_dir(buf);
+            for (int b = 0; b < 16; ++b) {
+                snprintf(buf, sizeof(buf), "b/d%d/e%d", a, b);
+                fs_create_dir(buf);
+            }
+        }
+    }
+}
+
+static void run_round(int r)
+{
+    static char data[ENIXNEL_MAX_FILE_SIZE];
+    double t;
+
+    setup_round();
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_create_file(paths[i]) != 0) {
+            fail("fs_create_file", paths[i]);
+        }
+    }
+    results[PH_CREATE][r] = (now_ns() - t) / n_entries;
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_find_index(paths[order[i]]) < 0) {
+            fail("fs_find_index", paths[order[i]]);
+        }
+    }
+    results[PH_LOOKUP_HIT][r] = (now_ns() - t) / n_entries;
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_find_index(misses[order[i]]) >= 0) {
+            fail("fs_find_index miss", misses[order[i]]);
+        }
+    }
+    results[PH_LOOKUP_MISS][r] = (now_ns() - t) / n_entries;
+
+    memset(data, 'x', write_bytes);
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_write_file(paths[order[i]], data, 64, 1) != 0) {
+            fail("fs_write_file append", paths[order[i]]);
+        }
+    }
+    results[PH_APPEND][r] = (now_ns() - t) / n_entries;
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_write_file(paths[order[i]], data, write_bytes, 0) != 0) {
+            fail("fs_write_file overwrite", paths[order[i]]);
+        }
+    }
+    results[PH_OVERWRITE][r] = (now_ns() - t) / n_entries;
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        static char buf[sizeof(data)];
+        size_t got = 0;
+        if (fs_read_file(paths[order[i]], 0, buf, write_bytes, &got) != 0 ||
+            got != write_bytes || memcmp(buf, data, got) != 0) {
+            fail("fs_read_file", paths[order[i]]);
+        }
+    }
+    results[PH_READ][r] = (now_ns() - t) / n_entries;
+
+    t = now_ns();
+    for (int i = 0; i < n_entries; ++i) {
+        if (fs_delete_file(paths[order[i]]) != 0) {
+            fail("fs_delete_file", paths[order[i]]);
+        }
+    }
+    results[PH_DELETE][r] = (now_ns() - t) / n_entries;
+
+    for (int i = 0; i < n_entries; i += 97) {
+        if (fs_find_index(paths[i]) >= 0) {
+            fail("delete left entry", paths[i]);
+        }
+    }
+    if (fs_delete_dir("b") != 0 || fs_blocks_used() != 0) {
+        fail("fs_delete_dir / block leak", "b");
+    }
+}
+
+/* ---------- Clone model check ---------- */
+
+#define CHECK_FILES    8
+#define CHECK_MAX_SIZE (12 * 1024)  /* reaches the double indirect block */
+
+typedef struct check_file {
+    int      present;
+    size_t   size;
+    uint8_t* data;
+} check_file_t;
+
+static check_file_t check_files[CHECK_FILES];
+static uint32_t     check_refs[1u << (8 * sizeof(fs_blkno_t))];
+
+static void check_name(int k, char* buf, size_t size)
+{
+    snprintf(buf, size, "c/k%d", k);
+}
+
+/* fs_file_for_each_block() callback: a block met again is shared, and
+ * what it lists was counted the first time. */
+static int check_count_block(fs_blkno_t blk)
+{
+    return ++check_refs[blk] > 1 ? 1 : 0;
+}
+
+static void check_refcounts(void)
+{
+    char name[32];
+    memset(check_refs, 0, sizeof(check_refs));
+    for (int k = 0; k < CHECK_FILES; ++k) {
+        if (check_files[k].present) {
+            check_name(k, name, sizeof(name));
+            fs_file_for_each_block(fs_find_index(name), check_count_block);
+        }
+    }
+
+    size_t distinct = 0;
+    for (size_t blk = 1; blk < sizeof(check_refs) / sizeof(check_refs[0]); ++blk) {
+        if (check_refs[blk] != fs_block_refcount((fs_blkno_t)blk)) {
+            fprintf(stderr, "fsbench: block %zu has %u references, %u counted\n",
+                    blk, fs_block_refcount((fs_blkno_t)blk), check_refs[blk]);
+            exit(1);
+        }
+        distinct += check_refs[blk] > 0;
+    }
+    if (distinct != fs_blocks_used()) {
+        fail("block accounting", "c");
+    }
+}
+
+static void check_contents(int k)
+{
+    static char buf[CHECK_MAX_SIZE];
+    char name[32];
+    size_t got = 0;
+    check_name(k, name, sizeof(name));
+    if (!check_files[k].present) {
+        if (fs_find_index(name) >= 0) {
+            fail("deleted file still there", name);
+        }
+        return;
+    }
+    if (fs_read_file(name, 0, buf, sizeof(buf), &got) != 0 ||
+        got != check_files[k].size || memcmp(buf, check_files[k].data, got) != 0) {
+        fail("contents", name);
+    }
+}
+
+/* Put len model bytes at off, zero-filling any gap, as the fs does. */
+static void check_model_write(check_file_t* f, size_t off, const uint8_t* src, size_t len)
+{
+    if (off > f->size) {
+        memset(f->data + f->size, 0, off - f->size);
+    }
+    memcpy(f->data + off, src, len);
+    if (off + len > f->size) {
+        f->size = off + len;
+    }
+}
+
+static void clone_check(void)
+{
+    static uint8_t src[CHECK_MAX_SIZE];
+    char name[32], other[32];
+
+    if (fs_create_dir("c") != 0) {
+        fail("fs_create_dir", "c");
+    }
+    for (int k = 0; k < CHECK_FILES; ++k) {
+        check_files[k].data = malloc(CHECK_MAX_SIZE);
+        if (!check_files[k].data) {
+            fail("malloc", "");
+        }
+    }
+
+    for (int op = 0; op < clone_ops; ++op) {
+        int k = (int)(rand32() % CHECK_FILES);
+        check_file_t* f = &check_files[k];
+        check_name(k, name, sizeof(name));
+        for (size_t i = 0; i < sizeof(src); ++i) {
+            src[i] = (uint8_t)(op + i * 7);
+        }
+
+        if (!f->present) {
+            /* Create, or clone another file into this name. */
+            int j = (int)(rand32() % CHECK_FILES);
+            if (j != k && check_files[j].present && rand32() % 2) {
+                check_name(j, other, sizeof(other));
+                if (fs_clone(other, name) != 0) {
+                    fail("fs_clone", name);
+                }
+                memcpy(f->data, check_files[j].data, check_files[j].size);
+                f->size = check_files[j].size;
+            } else if (fs_create_file(name) != 0) {
+                fail("fs_create_file", name);
+            } else {
+                f->size = 0;
+            }
+            f->present = 1;
+        } else {
+            size_t len = rand32() % 1024;
+            switch (rand32() % 5) {
+            case 0: {   /* positional write, possibly past the end */
+                size_t off = rand32() % (f->size + 256);
+                if (off + len > CHECK_MAX_SIZE) {
+                    break;
+                }
+                int fd = fs_open(name, 0);
+                if (fd < 0 || fs_pwrite(fd, src, len, off) != (int)len) {
+                    fail("fs_pwrite", name);
+                }
+                fs_close(fd);
+                check_model_write(f, off, src, len);
+                break;
+            }
+            case 1:     /* overwrite: the file takes the new size */
+                len = rand32() % CHECK_MAX_SIZE;
+                if (fs_write_file(name, (const char*)src, len, 0) != 0) {
+                    fail("fs_write_file", name);
+                }
+                memcpy(f->data, src, len);
+                f->size = len;
+                break;
+            case 2:     /* append */
+                if (f->size + len > CHECK_MAX_SIZE) {
+                    break;
+                }
+                if (fs_write_file(name, (const char*)src, len, 1) != 0) {
+                    fail("fs_write_file append", name);
+                }
+                check_model_write(f, f->size, src, len);
+                break;
+            case 3: {   /* resize, mostly shrinking within the last block */
+                size_t size = rand32() % 2 ? f->size - f->size % 3 : rand32() % CHECK_MAX_SIZE;
+                if (fs_file_resize(fs_find_index(name), size) != 0) {
+                    fail("fs_file_resize", name);
+                }
+                if (size > f->size) {
+                    memset(f->data + f->size, 0, size - f->size);
+                }
+                f->size = size;
+                break;
+            }
+            case 4:
+                if (fs_delete_file(name) != 0) {
+                    fail("fs_delete_file", name);
+                }
+                f->present = 0;
+                break;
+            }
+        }
+
+        /* A clone's blocks are shared, so any file may have been hit. */
+        for (int j = 0; j < CHECK_FILES; ++j) {
+            check_contents(j);
+        }
+        if (op % 256 == 0) {
+            check_refcounts();
+        }
+    }
+    check_refcounts();
+
+    for (int k = 0; k < CHECK_FILES; ++k) {
+        check_name(k, name, sizeof(name));
+        if (check_files[k].present && fs_delete_file(name) != 0) {
+            fail("fs_delete_file", name);
+        }
+        free(check_files[k].data);
+    }
+    if (fs_delete_dir("c") != 0 || fs_blocks_used() != 0) {
+        fail("fs_delete_dir / block leak", "c");
+    }
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: fsbench [-n entries] [-d seq|random|prefix|deep] "
+                    "[-r rounds] [-s seed] [-w write-bytes] [-c clone-ops]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            usage();
+        }
+        const char* v = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'n':
+            n_entries = atoi(v);
+            break;
+        case 'r':
+            rounds = atoi(v);
+            break;
+        case 'w':
+            write_bytes = (size_t)atol(v);
+            break;
+        case 'c':
+            clone_ops = atoi(v);
+            break;
+        case 's':
+            seed = strtoull(v, NULL, 0);
+            break;
+        case 'd': {
+            int k = 0;
+            while (k < 4 && strcmp(v, dist_names[k]) != 0) {
+                ++k;
+            }
+            if (k == 4) {
+                usage();
+            }
+            dist = (dist_t)k;
+            break;
+        }
+        default:
+            usage();
+        }
+    }
+    if (n_entries <= 0 || rounds <= 0 || rounds > MAX_ROUNDS ||
+        write_bytes == 0 || write_bytes > ENIXNEL_MAX_FILE_SIZE) {
+        usage();
+    }
+    /* Every file holds its data at once; stay inside the 16-bit block ids. */
+    if ((double)n_entries * (double)((write_bytes + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE) > 60000.0) {
+        fprintf(stderr, "fsbench: -n x -w exceeds the block pool\n");
+        return 2;
+    }
+
+    rng = seed ? seed : 1;
+    fs_init();
+    clone_check();
+    make_paths();
+    for (int r = 0; r < rounds; ++r) {
+        run_round(r);
+    }
+
+    printf("fsbench: %d entries, %s names, %zu-byte writes, %d rounds (median)\n",
+           n_entries, dist_names[dist], write_bytes, rounds);
+    for (int p = 0; p < PH_COUNT; ++p) {
+        qsort(results[p], (size_t)rounds, sizeof(double), cmp_double);
+        double ns = results[p][rounds / 2];
+        printf("  %-16s %10.1f ns/op %10.2f Mops/s\n", phase_names[p], ns, 1e3 / ns);
+    }
+    return 0;
+}
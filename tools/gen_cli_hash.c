@@ -0,0 +1,71 @@
+/*
+ * Build-time generator for the shell's command hash (host program).
+ *
+ * Reads the command names from kernel/cli_commands.def, then searches for
+ * the smallest power-of-two table, and a seed for cli_command_hash(), that
+ * puts every name in a distinct slot. Prints a header with the seed and
+ * the slot -> command index table.
+ *
+ *   gen_cli_hash > cli_hash_table.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cli_hash.h"
+
+static const char* const names[] = {
+#define CLI_COMMAND(name, synopsis, help) #name,
+#include "../kernel/cli_commands.def"
+#undef CLI_COMMAND
+};
+
+#define COUNT      (sizeof(names) / sizeof(names[0]))
+#define MAX_BITS   8            /* slots are uint8_t indices, 0xFF = empty */
+#define MAX_SEEDS  1000000u
+
+int main(void)
+{
+    static unsigned char slots[1u << MAX_BITS];
+
+    if (COUNT >= CLI_HASH_EMPTY) {
+        fprintf(stderr, "gen_cli_hash: too many commands\n");
+        return 1;
+    }
+
+    for (unsigned bits = 1; bits <= MAX_BITS; ++bits) {
+        unsigned size = 1u << bits;
+        if (size < COUNT) {
+            continue;
+        }
+
+        for (uint32_t seed = 0; seed < MAX_SEEDS; ++seed) {
+            unsigned i;
+            for (i = 0; i < size; ++i) {
+                slots[i] = CLI_HASH_EMPTY;
+            }
+            for (i = 0; i < COUNT; ++i) {
+                unsigned s = cli_command_hash(names[i], seed) & (size - 1);
+                if (slots[s] != CLI_HASH_EMPTY) {
+                    break;
+                }
+                slots[s] = (unsigned char)i;
+            }
+            if (i < COUNT) {
+                continue;
+            }
+
+            printf("/* Generated by tools/gen_cli_hash.c from kernel/cli_commands.def. */\n");
+            printf("#define CLI_HASH_SEED 0x%08Xu\n", (unsigned)seed);
+            printf("#define CLI_HASH_MASK %uu\n\n", size - 1);
+            printf("static const uint8_t cli_hash_slots[%u] = {", size);
+            for (i = 0; i < size; ++i) {
+                printf("%s%u,", (i % 8) ? " " : "\n    ", slots[i]);
+            }
+            printf("\n};\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "gen_cli_hash: no perfect hash found\n");
+    return 1;
+}
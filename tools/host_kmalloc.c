@@ -0,0 +1,49 @@
+/*
+ * Host stand-in for the kernel heap (kmalloc.h), so the fs core can be
+ * linked into native programs such as tools/fsbench.c. Caches are plain
+ * malloc()ed objects of the cache's size.
+ */
+
+#include <stdlib.h>
+#include "kmalloc.h"
+
+struct kmem_cache {
+    const char* name;
+    size_t      obj_size;
+};
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t obj_size)
+{
+    kmem_cache_t* c = malloc(sizeof(*c));
+    if (c) {
+        c->name = name;
+        c->obj_size = obj_size;
+    }
+    return c;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    return cache ? malloc(cache->obj_size) : NULL;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+    (void)cache;
+    free(obj);
+}
+
+void* kmalloc(size_t size)
+{
+    return size ? malloc(size) : NULL;
+}
+
+void* kzalloc(size_t size)
+{
+    return size ? calloc(1, size) : NULL;
+}
+
+void kfree(void* ptr)
+{
+    free(ptr);
+}
@@ -0,0 +1,172 @@
+/*
+ * Build-time packer for the boot image (host program).
+ *
+ * Walks a directory tree and writes it in the initrd.h layout: header,
+ * entry table sorted by path, name bytes, then the file contents. Names
+ * starting with '.' are skipped.
+ *
+ *   mkinitrd <dir> <image>
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "fs.h"
+#include "initrd.h"
+
+#define MAX_ENTRIES 4096
+
+typedef struct item {
+    char*    path;              /* relative to the root, no leading '/' */
+    int      is_dir;
+    uint32_t size;
+} item_t;
+
+static item_t   items[MAX_ENTRIES];
+static unsigned item_count = 0;
+static const char* root_dir;
+
+static void die(const char* what, const char* path)
+{
+    fprintf(stderr, "mkinitrd: %s: %s\n", path, what);
+    exit(1);
+}
+
+static void walk(const char* rel)
+{
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/%s", root_dir, rel);
+    DIR* d = opendir(dir);
+    if (!d) {
+        die("cannot open directory", dir);
+    }
+
+    struct dirent* de;
+    while ((de = readdir(d)) != 0) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        if (strlen(de->d_name) > ENIXNEL_MAX_NAME_LEN) {
+            die("name too long", de->d_name);
+        }
+
+        char path[INITRD_PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s%s%s", rel, *rel ? "/" : "", de->d_name);
+        if (n < 0 || n >= INITRD_PATH_MAX) {
+            die("path too long", de->d_name);
+        }
+        char full[4096];
+        snprintf(full, sizeof(full), "%s/%s", root_dir, path);
+        struct stat st;
+        if (stat(full, &st) != 0) {
+            die("cannot stat", full);
+        }
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (S_ISREG(st.st_mode) && st.st_size > ENIXNEL_MAX_FILE_SIZE) {
+            die("file too large", full);
+        }
+        if (item_count == MAX_ENTRIES) {
+            die("too many entries", root_dir);
+        }
+
+        item_t* it = &items[item_count++];
+        it->path = strdup(path);
+        it->is_dir = S_ISDIR(st.st_mode);
+        it->size = it->is_dir ? 0 : (uint32_t)st.st_size;
+        if (it->is_dir) {
+            walk(path);
+        }
+    }
+    closedir(d);
+}
+
+/* strcmp() orders by unsigned char, the order initrd.c searches in. */
+static int item_cmp(const void* a, const void* b)
+{
+    return strcmp(((const item_t*)a)->path, ((const item_t*)b)->path);
+}
+
+static void put(FILE* f, const void* p, size_t n, const char* out)
+{
+    if (n && fwrite(p, 1, n, f) != n) {
+        die("write failed", out);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: mkinitrd <dir> <image>\n");
+        return 1;
+    }
+    root_dir = argv[1];
+    walk("");
+    qsort(items, item_count, sizeof(items[0]), item_cmp);
+
+    static initrd_entry_t table[MAX_ENTRIES];
+    uint32_t names_size = 0;
+    uint32_t payload_size = 0;
+    for (unsigned i = 0; i < item_count; ++i) {
+        table[i].name_off = names_size;
+        table[i].name_len = (uint16_t)strlen(items[i].path);
+        table[i].flags = items[i].is_dir ? INITRD_DIR : 0;
+        table[i].data_off = payload_size;
+        table[i].size = items[i].size;
+        names_size += table[i].name_len;
+        payload_size += (items[i].size + 3) & ~3u;
+    }
+
+    initrd_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = INITRD_MAGIC;
+    h.version = INITRD_VERSION;
+    h.count = item_count;
+    h.names_start = (uint32_t)(sizeof(h) + item_count * sizeof(initrd_entry_t));
+    h.names_size = names_size;
+    h.payload_start = (h.names_start + names_size + 15) & ~15u;
+    h.image_size = h.payload_start + payload_size;
+
+    FILE* f = fopen(argv[2], "wb");
+    if (!f) {
+        die("cannot create", argv[2]);
+    }
+    put(f, &h, sizeof(h), argv[2]);
+    put(f, table, item_count * sizeof(table[0]), argv[2]);
+    for (unsigned i = 0; i < item_count; ++i) {
+        put(f, items[i].path, table[i].name_len, argv[2]);
+    }
+    static const char zeros[16];
+    put(f, zeros, h.payload_start - h.names_start - names_size, argv[2]);
+
+    for (unsigned i = 0; i < item_count; ++i) {
+        if (items[i].is_dir) {
+            continue;
+        }
+        char full[4096];
+        snprintf(full, sizeof(full), "%s/%s", root_dir, items[i].path);
+        FILE* in = fopen(full, "rb");
+        if (!in) {
+            die("cannot open", full);
+        }
+        char buf[4096];
+        size_t n, total = 0;
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            put(f, buf, n, argv[2]);
+            total += n;
+        }
+        fclose(in);
+        if (total != items[i].size) {
+            die("changed while packing", full);
+        }
+        put(f, zeros, ((items[i].size + 3) & ~3u) - items[i].size, argv[2]);
+    }
+
+    if (fclose(f) != 0) {
+        die("write failed", argv[2]);
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""Headless Enixnel performance run (make perf).
+
+Boots an ISO built with the "autorun" kernel option in QEMU with
+-nographic and isa-debug-exit, types a command script into the shell over
+COM1 one line at a time (each after the prompt comes back), and turns the
+bench and stats reports into JSON:
+
+  {"tsc_mhz": N,
+   "bench": {"<benchmark>": {"min": .., "median": .., "p99": ..}, ...},
+   "stats": {"<name>": {"calls": .., "cycles": .., "avg": .., "max": ..}, ...},
+   "exit_code": N}
+
+Benchmarks that run once per "bench" command keep the last value. The
+kernel's shutdown code N makes QEMU exit with (N << 1) | 1; anything else
+(a fault, a hang past --timeout) fails the run with exit status 1.
+"""
+
+import argparse
+import json
+import os
+import re
+import selectors
+import subprocess
+import sys
+import time
+
+PROMPT = re.compile(r"(?:^|\n)/[^\n]*\$ $")
+BENCH_HEADER = re.compile(r"^TSC (\d+) MHz; cycles per op:$")
+BENCH_ROW = re.compile(r"^  (\S.*?)\s+(\d+)\s+(\d+)\s+(\d+)$")
+STATS_ROW = re.compile(r"^  (\S+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)$")
+
+
+class Machine:
+    def __init__(self, argv, log):
+        self.proc = subprocess.Popen(argv, stdin=subprocess.PIPE,
+                                     stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT)
+        self.sel = selectors.DefaultSelector()
+        self.sel.register(self.proc.stdout, selectors.EVENT_READ)
+        self.log = log
+        self.buf = ""
+
+    def read_until_prompt(self, timeout):
+        """Collect output until the shell prompt; returns it without the prompt."""
+        deadline = time.monotonic() + timeout
+        while not PROMPT.search(self.buf):
+            left = deadline - time.monotonic()
+            if left <= 0:
+                raise TimeoutError("no prompt within %d s" % timeout)
+            if not self.sel.select(left):
+                continue
+            data = os.read(self.proc.stdout.fileno(), 65536)
+            if not data:
+                raise EOFError("QEMU exited")
+            self.log.write(data)
+            self.buf += data.decode("latin-1").replace("\r", "")
+        out = PROMPT.sub("", self.buf)
+        self.buf = ""
+        return out
+
+    def send(self, line):
+        self.proc.stdin.write(line.encode("ascii") + b"\r")
+        self.proc.stdin.flush()
+
+    def drain(self, timeout):
+        """Read to EOF and return QEMU's exit status (None on timeout)."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if self.sel.select(0.1):
+                data = os.read(self.proc.stdout.fileno(), 65536)
+                if not data:
+                    break
+                self.log.write(data)
+        try:
+            return self.proc.wait(max(0.1, deadline - time.monotonic()))
+        except subprocess.TimeoutExpired:
+            return None
+
+    def kill(self):
+        if self.proc.poll() is None:
+            self.proc.kill()
+            self.proc.wait()
+
+
+def parse_bench(lines, result):
+    for line in lines:
+        m = BENCH_HEADER.match(line)
+        if m:
+            result["tsc_mhz"] = int(m.group(1))
+            continue
+        m = BENCH_ROW.match(line)
+        if m and not line.startswith("  benchmark "):
+            result["bench"][m.group(1)] = {
+                "min": int(m.group(2)),
+                "median": int(m.group(3)),
+                "p99": int(m.group(4)),
+            }
+
+
+def parse_stats(lines, result):
+    for line in lines:
+        m = STATS_ROW.match(line)
+        if m:
+            result["stats"][m.group(1)] = {
+                "calls": int(m.group(2)),
+                "cycles": int(m.group(3)),
+                "avg": int(m.group(4)),
+                "max": int(m.group(5)),
+            }
+
+
+def load_script(path):
+    cmds = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith("#"):
+                cmds.append(line)
+    if not cmds or not cmds[-1].startswith("shutdown"):
+        cmds.append("shutdown 0")
+    return cmds
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--qemu", default="qemu-system-i386")
+    ap.add_argument("--iso", required=True)
+    ap.add_argument("--script", required=True)
+    ap.add_argument("--log", required=True, help="raw serial output")
+    ap.add_argument("--out", help="JSON results (default: stdout)")
+    ap.add_argument("--timeout", type=int, default=300,
+                    help="seconds allowed per command")
+    args = ap.parse_args()
+
+    cmds = load_script(args.script)
+    argv = [args.qemu, "-cdrom", args.iso, "-nographic", "-no-reboot",
+            "-device", "isa-debug-exit,iobase=0xf4,iosize=0x01"]
+
+    result = {"tsc_mhz": None, "bench": {}, "stats": {}, "exit_code": None}
+    os.makedirs(os.path.dirname(os.path.abspath(args.log)), exist_ok=True)
+    with open(args.log, "wb") as log:
+        vm = Machine(argv, log)
+        try:
+            vm.read_until_prompt(args.timeout)
+            for cmd in cmds[:-1]:
+                vm.send(cmd)
+                lines = vm.read_until_prompt(args.timeout).split("\n")
+                if cmd.split()[0] == "bench":
+                    parse_bench(lines, result)
+                elif cmd.split()[0] == "stats":
+                    parse_stats(lines, result)
+            vm.send(cmds[-1])
+            status = vm.drain(args.timeout)
+        except (TimeoutError, EOFError) as e:
+            print("perf: %s (see %s)" % (e, args.log), file=sys.stderr)
+            vm.kill()
+            return 1
+        finally:
+            vm.kill()
+
+    if status is None or status & 1 == 0:
+        print("perf: QEMU did not leave through isa-debug-exit (status %s)"
+              % status, file=sys.stderr)
+        return 1
+    result["exit_code"] = status >> 1
+
+    text = json.dumps(result, indent=2, sort_keys=True) + "\n"
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text)
+    sys.stdout.write(text)
+    return 0 if result["exit_code"] == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
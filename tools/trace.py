@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Decode an Enixnel trace dump ("trace dump") into a timeline.
+
+Reads a raw capture of COM1 (QEMU -serial file:com1.log, or the log that
+make perf writes), finds the last dump in it and prints every event in
+TSC order, one per line:
+
+  time_us  cpu  event  B|E|.  a0  a1  [span_us]
+
+Times are relative to the first event. END events show how long the span
+since the matching BEGIN on the same CPU took. With --chrome FILE the
+events are also written in the Chrome trace event format, which
+chrome://tracing and Perfetto show as a timeline per CPU.
+
+The wire format is described in include/trace.h.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"ENXTRACE"
+HEADER = struct.Struct("<8sHHIII")
+CPU_HEADER = struct.Struct("<III")
+EVENT = struct.Struct("<QBBHI")
+PHASES = {0: ".", 1: "B", 2: "E"}
+CHROME_PHASES = {0: "i", 1: "B", 2: "E"}
+
+
+class FormatError(Exception):
+    pass
+
+
+def decode(data, pos):
+    """Parse the dump at data[pos:]; returns (tsc_khz, names, events, lost)."""
+    if len(data) < pos + HEADER.size:
+        raise FormatError("header cut short")
+    magic, version, event_size, tsc_khz, cpus, nnames = HEADER.unpack_from(data, pos)
+    if version != 1 or event_size != EVENT.size:
+        raise FormatError("version %d, event size %d not understood"
+                          % (version, event_size))
+    pos += HEADER.size
+
+    names = []
+    for _ in range(nnames):
+        n = data[pos]
+        names.append(data[pos + 1:pos + 1 + n].decode("ascii"))
+        pos += 1 + n
+
+    events = []
+    lost = {}
+    for _ in range(cpus):
+        if len(data) < pos + CPU_HEADER.size:
+            raise FormatError("CPU header cut short")
+        cpu, count, dropped = CPU_HEADER.unpack_from(data, pos)
+        pos += CPU_HEADER.size
+        if len(data) < pos + count * EVENT.size:
+            raise FormatError("events of CPU %d cut short" % cpu)
+        for tsc, ev, phase, a0, a1 in EVENT.iter_unpack(data[pos:pos + count * EVENT.size]):
+            name = names[ev] if ev < len(names) else "event%d" % ev
+            events.append((tsc, cpu, name, phase, a0, a1))
+        pos += count * EVENT.size
+        lost[cpu] = dropped
+
+    events.sort()
+    return tsc_khz, names, events, lost
+
+
+def print_timeline(tsc_khz, events, lost, out):
+    def to_us(cycles):
+        return cycles * 1000.0 / tsc_khz if tsc_khz else float(cycles)
+
+    unit = "us" if tsc_khz else "cycles"
+    for cpu in sorted(lost):
+        if lost[cpu]:
+            out.write("# cpu %d: %d older events overwritten\n" % (cpu, lost[cpu]))
+    if not events:
+        out.write("# no events\n")
+        return
+
+    t0 = events[0][0]
+    open_spans = {}
+    out.write("# %12s  %3s  %-16s %s  %8s  %10s  %s\n"
+              % ("time_" + unit, "cpu", "event", "ph", "a0", "a1", "span"))
+    for tsc, cpu, name, phase, a0, a1 in events:
+        span = ""
+        key = (cpu, name)
+        if phase == 1:
+            open_spans.setdefault(key, []).append(tsc)
+        elif phase == 2 and open_spans.get(key):
+            span = "%.3f" % to_us(tsc - open_spans[key].pop())
+        out.write("  %12.3f  %3d  %-16s %s   %8d  %10d  %s\n"
+                  % (to_us(tsc - t0), cpu, name, PHASES.get(phase, "?"), a0, a1, span))
+
+
+def write_chrome(path, tsc_khz, events):
+    t0 = events[0][0] if events else 0
+    scale = 1000.0 / tsc_khz if tsc_khz else 1.0
+    records = []
+    for tsc, cpu, name, phase, a0, a1 in events:
+        r = {"name": name, "ph": CHROME_PHASES.get(phase, "i"),
+             "ts": (tsc - t0) * scale, "pid": 0, "tid": cpu,
+             "args": {"a0": a0, "a1": a1}}
+        if phase == 0:
+            r["s"] = "t"
+        records.append(r)
+    with open(path, "w") as f:
+        json.dump({"traceEvents": records, "displayTimeUnit": "ns"}, f)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("capture", help="raw serial capture ('-' for stdin)")
+    ap.add_argument("--chrome", help="also write Chrome trace event JSON here")
+    args = ap.parse_args()
+
+    if args.capture == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+
+    pos = data.rfind(MAGIC)
+    if pos < 0:
+        print("trace: no dump in %s" % args.capture, file=sys.stderr)
+        return 1
+    try:
+        tsc_khz, names, events, lost = decode(data, pos)
+    except (FormatError, IndexError, UnicodeDecodeError) as e:
+        print("trace: bad dump: %s" % e, file=sys.stderr)
+        return 1
+
+    print_timeline(tsc_khz, events, lost, sys.stdout)
+    if args.chrome:
+        write_chrome(args.chrome, tsc_khz, events)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())